@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <SDL_types.h>
+
+class BenchTimer
+{
+public:
+    BenchTimer()
+        : mStart(std::chrono::high_resolution_clock::now())
+    {
+
+    }
+
+    double Seconds() const
+    {
+        const auto now = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double>(now - mStart).count();
+    }
+
+private:
+    std::chrono::high_resolution_clock::time_point mStart;
+};
+
+void ReportThroughput(const std::string& name, size_t bytes, double seconds);
+
+// Writes size bytes of repeatable noise to fileName, used when no real game file is given
+void WriteTestFile(const std::string& fileName, size_t size);
+void WriteTestLgp(const std::string& fileName, size_t count);
+void WriteTestKernel(const std::string& fileName);
+
+// A TEX file of noise, paletted for 4 and 8 bits, 5551 for 16 and BGRA for 32
+std::vector<Uint8> MakeTestTex(Uint32 width, Uint32 height, Uint32 bits, Uint32 palettes, Uint32 seed);
+
+// Each benchmark takes the arguments after its name on the command line
+typedef int(*BenchFunc)(const std::vector<std::string>& args);
+
+int StreamBench(const std::vector<std::string>& args);
+int AsyncIoBench(const std::vector<std::string>& args);
+int LgpBench(const std::vector<std::string>& args);
+int PackBench(const std::vector<std::string>& args);
+int LzssBench(const std::vector<std::string>& args);
+int KernelBinBench(const std::vector<std::string>& args);
+int DatabaseBench(const std::vector<std::string>& args);
+int TexBench(const std::vector<std::string>& args);
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <map>
+#include <string>
 #include <stdlib.h>
 #include <GL/glew.h>
 
@@ -16,7 +17,8 @@ class Menu;
 class Engine
 {
 public:
-    Engine();
+    // A non empty accessLogFile records the files each field loads in to it
+    explicit Engine(const std::string& accessLogFile = std::string());
     ~Engine();
     int Run();
 private:
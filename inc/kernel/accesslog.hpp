@@ -0,0 +1,49 @@
+#pragma once
+
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Lgp;
+
+// Records which archive entries each scene touches and in what order. The log is
+// used to repack archives so a scene's entries sit together and load as a few big
+// sequential reads instead of seeking all over the archive.
+class AccessLog
+{
+public:
+    struct Scene
+    {
+        std::string name;
+
+        // Archive file name and entry path, first touch only
+        std::vector<std::pair<std::string, std::string>> accesses;
+        std::set<std::pair<std::string, std::string>> seen;
+    };
+
+    // Following accesses are put down to this scene, safe to call from any thread
+    void BeginScene(const std::string& name);
+    void Record(const std::string& archive, const std::string& entry);
+
+    void Save(const std::string& fileName) const;
+    void Load(const std::string& fileName);
+
+    const std::vector<Scene>& Scenes() const { return mScenes; }
+
+    // Entry indexes of lgp grouped by the first scene to touch them, in the order they
+    // were touched. Entries no scene used are left out. Accesses are matched against
+    // archive, which can differ from lgp's own name when it is a repacked copy.
+    std::vector<std::vector<size_t>> Groups(const Lgp& lgp, const std::string& archive) const;
+
+    // How many separate reads loading the scene from lgp takes, entries closer than
+    // gap bytes apart count as one read
+    size_t CountReads(const Lgp& lgp, const std::string& archive, const Scene& scene, size_t gap) const;
+
+    // Archives are matched on their lower case file name so logs work across installs
+    static std::string ArchiveKey(const std::string& archive);
+private:
+    mutable std::mutex mMutex;
+    std::vector<Scene> mScenes;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <SDL_types.h>
+
+// 64 bit FNV-1a of a normalised path: lower case, / separators and no leading or
+// trailing separators, so "Field\\Flevel.lgp" and "field/flevel.lgp/" are the same
+// asset. Literals are hashed at compile time with "hand.png"_asset, after that lookups
+// by id never build or hash a string. Two paths with the same id are reported when
+// the archive or layer holding them is mounted.
+class AssetId
+{
+public:
+    constexpr AssetId()
+        : mValue(0)
+    {
+
+    }
+
+    constexpr explicit AssetId(Uint64 value)
+        : mValue(value)
+    {
+
+    }
+
+    // Debug builds remember the path so it can be shown by Name
+    explicit AssetId(const std::string& path)
+        : mValue(Hash(path.data(), path.size()))
+    {
+#ifndef NDEBUG
+        Register(*this, path);
+#endif
+    }
+
+    constexpr Uint64 Value() const { return mValue; }
+    constexpr bool IsValid() const { return mValue != 0; }
+
+    constexpr bool operator == (AssetId other) const { return mValue == other.mValue; }
+    constexpr bool operator != (AssetId other) const { return mValue != other.mValue; }
+    constexpr bool operator < (AssetId other) const { return mValue < other.mValue; }
+
+    static constexpr Uint64 Hash(const char* path, size_t length)
+    {
+        size_t begin = 0;
+        while (begin < length && IsSeparator(path[begin]))
+        {
+            begin++;
+        }
+        while (length > begin && IsSeparator(path[length - 1]))
+        {
+            length--;
+        }
+
+        Uint64 hash = 14695981039346656037ull;
+        for (size_t i = begin; i < length; i++)
+        {
+            hash ^= static_cast<Uint8>(Normalize(path[i]));
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static void Register(AssetId id, const std::string& path);
+
+    // The path behind an id, or its hash in hex when it isn't known. Only ids made
+    // from strings in debug builds are known.
+    static std::string Name(AssetId id);
+private:
+    static constexpr bool IsSeparator(char c)
+    {
+        return c == '/' || c == '\\';
+    }
+
+    static constexpr char Normalize(char c)
+    {
+        return c == '\\' ? '/' : (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    Uint64 mValue;
+};
+
+constexpr AssetId operator "" _asset(const char* path, size_t length)
+{
+    return AssetId(AssetId::Hash(path, length));
+}
+
+namespace std
+{
+    template<>
+    struct hash<AssetId>
+    {
+        size_t operator()(AssetId id) const
+        {
+            // Already well mixed
+            return static_cast<size_t>(id.Value());
+        }
+    };
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <SDL_types.h>
+#include "kernel/threadpool.hpp"
+
+class NativeFile;
+
+// Queues file reads and completes them off the calling thread. When built with
+// liburing on Linux the reads go through io_uring, otherwise they are pread from a
+// small thread pool. Callbacks always run on an IO thread, never inside Read, even
+// when the file can't be opened or there is nothing to read. They should only hand
+// the data on.
+class AsyncIo
+{
+public:
+    typedef std::function<void(std::vector<Uint8>&& data, bool ok)> Callback;
+
+    explicit AsyncIo(size_t threadCount = 2);
+    ~AsyncIo();
+    AsyncIo(const AsyncIo&) = delete;
+    AsyncIo& operator = (const AsyncIo&) = delete;
+
+    // A size of 0 reads to the end of the file. Reads that run off the end of the
+    // file complete with fewer bytes than asked for.
+    void Read(const std::string& fileName, size_t offset, size_t size, Callback callback);
+    std::future<std::vector<Uint8>> Read(const std::string& fileName, size_t offset = 0, size_t size = 0);
+
+    // Throws if the file can't be opened
+    size_t FileSize(const std::string& fileName);
+
+    // Runs work on an IO thread, for reads the caller has to do itself such as a
+    // layer decoding its files. Wait blocks until all of it has finished and must
+    // not be called from an IO thread.
+    void Run(std::function<void()> work) { mPool.Post(std::move(work)); }
+    void Wait() { mPool.Wait(); }
+
+    // Closes every cached handle so the next read opens the file again and sees its
+    // current contents and size. Reads already queued keep the handle they started with.
+    void CloseFiles();
+
+    // Handles are kept open between reads, least recently used closed past this many
+    static const size_t kMaxOpenFiles = 64;
+
+    const char* BackendName() const;
+private:
+    struct Request;
+    std::shared_ptr<NativeFile> OpenFile(const std::string& fileName);
+    // A request that already failed is only completed, with ok false
+    void SubmitPool(std::unique_ptr<Request> request, bool ok = true);
+    static void Complete(std::unique_ptr<Request> request, bool ok);
+
+    // Requests hold their own reference, so closing a cached handle never pulls it
+    // out from under a read
+    struct CachedFile
+    {
+        std::shared_ptr<NativeFile> file;
+        std::list<std::string>::iterator lruPosition;
+    };
+
+    std::mutex mFilesMutex;
+    std::map<std::string, CachedFile> mFiles;
+
+    // Most recently used at the front
+    std::list<std::string> mFilesLru;
+    ThreadPool mPool;
+
+    // io_uring state, only created when the kernel library is built with liburing
+    struct Ring;
+    void RingThread();
+    bool SubmitRing(std::unique_ptr<Request>& request);
+    std::unique_ptr<Ring> mRing;
+};
+
+// Streams a file front to back keeping a few chunks in flight ahead of the reader
+class ReadAheadFile
+{
+public:
+    ReadAheadFile(AsyncIo& io, const std::string& fileName, size_t chunkSize = 256 * 1024, size_t depth = 4);
+
+    // Returns false at the end of the file, the chunk is valid until the next call
+    bool Next(const Uint8*& data, size_t& size);
+
+    size_t Size() const { return mFileSize; }
+private:
+    void Queue();
+
+    AsyncIo& mIo;
+    std::string mFileName;
+    size_t mChunkSize = 0;
+    size_t mDepth = 0;
+    size_t mFileSize = 0;
+    size_t mNextOffset = 0;
+    std::deque<std::future<std::vector<Uint8>>> mInFlight;
+    std::vector<Uint8> mCurrent;
+};
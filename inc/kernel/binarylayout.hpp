@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <SDL_types.h>
+
+// All FF7 data is little endian
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define HOST_IS_LITTLE_ENDIAN 0
+#else
+#define HOST_IS_LITTLE_ENDIAN 1
+#endif
+
+// Describes a structure that is stored on disk exactly as it is in memory so it can
+// be read with a single copy. kWordSize is the size of the fields that need their
+// bytes swapping on a big endian host. Types must be declared with BINARY_LAYOUT
+// before they can be used with Stream::ReadStruct/ReadArray.
+template<typename T, typename Enable = void>
+struct BinaryLayout
+{
+    static const size_t kWordSize = 0;
+};
+
+template<typename T>
+struct BinaryLayout<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+{
+    static const size_t kWordSize = sizeof(T);
+};
+
+#define BINARY_LAYOUT(type, size, wordSize) \
+    static_assert(sizeof(type) == size, #type " is not " #size " bytes"); \
+    static_assert(std::is_trivially_copyable<type>::value, #type " must be trivially copyable"); \
+    static_assert(size % wordSize == 0, #type " is not made of " #wordSize " byte words"); \
+    template<> struct BinaryLayout<type> { static const size_t kWordSize = wordSize; }
+
+#define BINARY_FIELD(type, field, offset) \
+    static_assert(offsetof(type, field) == offset, #type "::" #field " is not at " #offset)
+
+template<bool swap>
+struct LayoutToHost
+{
+    template<typename T>
+    static void Apply(T* /*items*/, size_t /*count*/)
+    {
+        // Little endian host, data is already in host order
+    }
+};
+
+template<>
+struct LayoutToHost<true>
+{
+    template<typename T>
+    static void Apply(T* items, size_t count)
+    {
+        const size_t wordSize = BinaryLayout<T>::kWordSize;
+        Uint8* p = reinterpret_cast<Uint8*>(items);
+        Uint8* end = p + sizeof(T) * count;
+        for (; p != end; p += wordSize)
+        {
+            std::reverse(p, p + wordSize);
+        }
+    }
+};
+
+template<typename T>
+void BinaryLayoutToHost(T* items, size_t count)
+{
+    static_assert(BinaryLayout<T>::kWordSize != 0, "Type has no BINARY_LAYOUT");
+    LayoutToHost<!HOST_IS_LITTLE_ENDIAN && (BinaryLayout<T>::kWordSize > 1)>::Apply(items, count);
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <SDL_types.h>
+#include "kernel/assetid.hpp"
+#include "kernel/binarylayout.hpp"
+#include "kernel/stream.hpp"
+
+class ThreadPool;
+
+// Cooked asset pack, the game's data converted offline in to one file the runtime
+// can load without decoding FF7's own formats. Each asset is split in to blocks that
+// are compressed on their own, so blocks decompress in parallel straight in to the
+// asset's final buffer. Assets big enough to need a page start on a page boundary.
+//
+// Layout: PackHeader, block data, then the directory of PackAsset, PackBlock, the
+// open addressed hash slots (asset index + 1, 0 is empty) and the names.
+struct PackHeader
+{
+    Uint32 magic;
+    Uint32 version;
+    Uint32 blockSize;
+    Uint32 assetCount;
+    Uint32 blockCount;
+    Uint32 slotCount;
+    Uint32 namesSize;
+    Uint32 directoryOffset;
+};
+BINARY_LAYOUT(PackHeader, 32, sizeof(Uint32));
+
+struct PackAsset
+{
+    Uint32 hashLow;
+    Uint32 hashHigh;
+    Uint32 nameOffset;
+    Uint32 nameLength;
+    Uint32 size;
+    Uint32 firstBlock;
+    Uint32 blockCount;
+    Uint32 reserved;
+
+    AssetId Id() const { return AssetId(static_cast<Uint64>(hashHigh) << 32 | hashLow); }
+};
+BINARY_LAYOUT(PackAsset, 32, sizeof(Uint32));
+
+struct PackBlock
+{
+    Uint32 offset;
+    Uint32 compressedSize;  // Equal to rawSize when the block is stored as is
+    Uint32 rawSize;
+    Uint32 reserved;
+};
+BINARY_LAYOUT(PackBlock, 16, sizeof(Uint32));
+
+// What a converter made of an asset, see PackCooker::AddConverter
+enum eCookedFormat
+{
+    eCookedDecompressed = 1,    // LZSS files, the decompressed bytes
+    eCookedKernelBin,           // KERNEL.BIN with every section inflated
+    eCookedTexture              // A parsed TEX file, see TexFile::Cook
+};
+
+// Converted assets start with this so their loaders can tell them from the game's
+// own formats, which every one of them still reads
+struct CookedHeader
+{
+    Uint32 magic;
+    Uint32 format;
+};
+BINARY_LAYOUT(CookedHeader, 8, sizeof(Uint32));
+
+class CookedPack
+{
+public:
+    static const Uint32 kMagic = 0x4B504737; // "7GPK"
+    static const Uint32 kVersion = 1;
+    static const Uint32 kCookedMagic = 0x4B434737; // "7GCK"
+    static const size_t kNotFound = static_cast<size_t>(-1);
+
+    // True, with the stream moved past the CookedHeader, if the data from the stream's
+    // position on was made by a converter for format. Leaves the stream alone if not.
+    static bool IsCooked(Stream& stream, eCookedFormat format);
+
+    // A CookedHeader for format followed by size bytes for the converter to fill in
+    static std::vector<Uint8> MakeCooked(eCookedFormat format, size_t size);
+
+    // Throws if the file isn't a pack
+    explicit CookedPack(const std::string& fileName);
+
+    size_t Find(AssetId id) const;
+    size_t Find(const std::string& path) const { return Find(AssetId(path)); }
+    size_t AssetCount() const { return mAssets.size(); }
+    std::string AssetPath(size_t index) const;
+    size_t AssetSize(size_t index) const { return mAssets.at(index).size; }
+
+    // True when the asset is stored uncompressed, its bytes are then at offset
+    bool IsStored(size_t index, size_t& offset) const;
+
+    // Decompresses in to dest, which must hold AssetSize bytes. Blocks are spread over
+    // pool when one is given. Throws on corrupt data.
+    void LoadInto(size_t index, Uint8* dest, ThreadPool* pool) const;
+    std::vector<Uint8> Load(size_t index, ThreadPool* pool) const;
+
+    std::string Name() const { return mStream.Name(); }
+private:
+    void LoadBlock(const PackBlock& block, Uint8* dest) const;
+
+    Stream mStream;
+    PackHeader mHeader = {};
+    std::vector<PackAsset> mAssets;
+    std::vector<PackBlock> mBlocks;
+    std::vector<Uint32> mSlots;
+    std::string mNames;
+};
+
+// Builds a CookedPack. Converters turn files in to their runtime form, so the decoding
+// cost is paid once when cooking: Lzss::Cook, KernelBin::Cook and TexFile::Cook.
+class PackCooker
+{
+public:
+    typedef std::function<std::vector<Uint8>(Stream& input)> Converter;
+
+    // Used for every path ending in suffix, such as ".tex" or "kernel.bin"
+    void AddConverter(const std::string& suffix, Converter converter);
+    void Add(const std::string& path, Stream&& data);
+
+    // For files that can only be told apart by where they are listed, such as the
+    // fields in flevel.lgp's maplist
+    void Add(const std::string& path, Stream&& data, Converter converter);
+
+    // Converts and compresses every asset on the pool, then writes the pack. Returns its
+    // size, throws if it can't be written.
+    size_t Write(const std::string& fileName, ThreadPool& pool, size_t blockSize = 64 * 1024);
+private:
+    struct Asset
+    {
+        std::string path;
+        Stream input;
+        std::vector<Uint8> data;
+        Converter converter;
+    };
+
+    std::vector<Asset> mAssets;
+    std::vector<std::pair<std::string, Converter>> mConverters;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <SDL_types.h>
+#include "kernel/binarylayout.hpp"
+#include "kernel/resourcecache.hpp"
+
+class FileSystem;
+class Stream;
+class TextureDedup;
+
+// Where a field's exit lines lead, from the triggers section
+struct FieldGateway
+{
+    Sint16 exitLine[2][3];
+    Sint16 destination[3];
+    Uint16 fieldId;
+    Uint8 unknown[4];
+};
+BINARY_LAYOUT(FieldGateway, 24, sizeof(Sint16));
+BINARY_FIELD(FieldGateway, fieldId, 18);
+
+// A decompressed PC field file: a u16 0, a u32 section count and that many absolute
+// section offsets. Each section starts with its u32 length.
+class FieldFile
+{
+public:
+    enum eSection
+    {
+        eSectionScript,
+        eSectionCamera,
+        eSectionModelLoader,
+        eSectionPalette,
+        eSectionWalkmesh,
+        eSectionTileMap,
+        eSectionEncounter,
+        eSectionTriggers,
+        eSectionBackground,
+        eSectionCount
+    };
+
+    static const Uint16 kUnusedGateway = 0x7FFF;
+    static const size_t kGatewayCount = 12;
+
+    // Throws if the sections don't fit the data
+    explicit FieldFile(std::vector<Uint8>&& data);
+
+    // As stored in flevel.lgp, LZSS compressed
+    static std::shared_ptr<const FieldFile> Load(Stream& stream);
+
+    const Uint8* Section(eSection section, size_t& size) const;
+
+    // Only the gateways in use
+    const std::vector<FieldGateway>& Gateways() const { return mGateways; }
+
+    size_t Size() const { return mData.size(); }
+private:
+    static const size_t kGatewaysOffset = 0x38;
+
+    std::vector<Uint8> mData;
+    size_t mSectionOffsets[eSectionCount] = {};
+    size_t mSectionSizes[eSectionCount] = {};
+    std::vector<FieldGateway> mGateways;
+};
+
+// flevel.lgp's maplist, a u16 count then 32 byte field names. Gateways refer to
+// fields by their index in it.
+class FieldList
+{
+public:
+    static const Uint16 kNotFound = 0xFFFF;
+
+    explicit FieldList(Stream& stream);
+
+    size_t Count() const { return mNames.size(); }
+
+    // Empty for an id past the end
+    std::string Name(Uint16 id) const;
+    Uint16 Find(const std::string& name) const;
+private:
+    std::vector<std::string> mNames;
+    std::unordered_map<std::string, Uint16> mIds;
+};
+
+// Loads fields through the ResourceCache and, as each one is entered, prefetches the
+// fields its gateways lead to. A field file holds the background, walkmesh and
+// scripts, so once the prefetch has landed crossing a gateway is only a cache lookup.
+class FieldLoader
+{
+public:
+    // Fields are read from <archive>/<name>, throws if there is no maplist. Each field
+    // entered starts a new scene in textures when given.
+    FieldLoader(FileSystem& fileSystem, ResourceCache& cache, const std::string& archive = "flevel", TextureDedup* textures = nullptr);
+
+    // Throws if the field can't be loaded
+    void Enter(const std::string& name);
+    void Enter(Uint16 fieldId);
+
+    // Takes the current field's gateway, which must be in use
+    void Cross(size_t gateway);
+
+    const FieldFile* Current() const { return mCurrent.Get<FieldFile>(); }
+    const std::string& CurrentName() const { return mCurrentName; }
+    const FieldList& Fields() const { return *mFields; }
+
+    // Share of prefetched fields that were later entered
+    double PrefetchHitRate() const;
+private:
+    AssetId FieldAsset(const std::string& name) const;
+
+    FileSystem& mFileSystem;
+    ResourceCache& mCache;
+    TextureDedup* mTextures;
+    std::string mArchive;
+    std::unique_ptr<FieldList> mFields;
+    ResourceHandle mCurrent;
+    std::string mCurrentName;
+};
@@ -1,11 +1,154 @@
 #pragma once
 
+#include <map>
+#include <memory>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
+#include "kernel/assetid.hpp"
+#include "kernel/asyncio.hpp"
+#include "kernel/loadqueue.hpp"
+#include "kernel/stream.hpp"
 
+class Lgp;
+class AccessLog;
+class CookedPack;
+class ThreadPool;
+
+// A source of files that can be mounted in to the FileSystem, such as a folder of
+// loose files or an LGP archive. Paths are relative to the layer and normalised with
+// FileSystem::NormalizePath.
+class FileSystemLayer
+{
+public:
+    static const size_t kNotFound = static_cast<size_t>(-1);
+
+    virtual ~FileSystemLayer() = default;
+
+    // Rebuilds the list of files, called when the layer is mounted or remounted
+    virtual void Refresh() = 0;
+
+    virtual size_t FileCount() const = 0;
+    virtual std::string FilePath(size_t index) const = 0;
+    virtual size_t Find(const std::string& path) const = 0;
+    virtual Stream Open(size_t index) const = 0;
+
+    // Where the file's bytes are stored as is on disk, false if they have to be decoded
+    virtual bool Locate(size_t index, std::string& fileName, size_t& offset, size_t& size) const = 0;
+
+    virtual std::string Name() const = 0;
+};
+
+// Merges a stack of mounted layers in to one case insensitive tree. Higher priority
+// layers hide files of the same path in lower ones (for equal priorities the last
+// mounted wins), which is how mods replace game files. The merged index is keyed by
+// AssetId and kept up to date as layers come and go, so every lookup is a single hash
+// probe. Paths whose ids collide are reported when the second one is mounted.
+//
+// Threading: lookups, opens and reads are safe from any thread, including the IO and
+// load threads. Mount, Unmount and Remount may be called while loads are in flight,
+// they take the index exclusively and wait for lookups already running. A queued
+// load resolves its id when its read starts, so it sees whichever layers are mounted
+// at that point and fails as not found if the file went away. Streams already opened
+// keep their data alive after their layer is unmounted. Layers themselves are only
+// touched with the index locked.
 class FileSystem
 {
 public:
+    typedef size_t LayerId;
+
     FileSystem();
+    ~FileSystem();
+
+    LayerId Mount(std::unique_ptr<FileSystemLayer> layer, const std::string& mountPoint, int priority);
+    LayerId MountDirectory(const std::string& directory, const std::string& mountPoint, int priority);
+    LayerId MountLgp(const std::shared_ptr<Lgp>& lgp, const std::string& mountPoint, int priority);
+
+    // Compressed assets are decoded on pool when opened, null decodes on the caller
+    LayerId MountPack(const std::shared_ptr<CookedPack>& pack, const std::string& mountPoint, int priority, ThreadPool* pool);
+    void Unmount(LayerId id);
+
+    // Picks up changes to a layer's files, only paths from that layer are touched
+    void Remount(LayerId id);
+
+    bool Exists(AssetId id) const;
+    bool Exists(const std::string& path) const { return Exists(AssetId(path)); }
+
+    // Throws if no layer has the file
+    Stream Open(AssetId id) const;
+    Stream Open(const std::string& path) const { return Open(AssetId(path)); }
+
+    // Reads a whole file on the IO threads so the caller never waits on the disk,
+    // files a layer has to decode are decoded there too. The callback always runs on
+    // an IO thread, with ok false if the file is missing or fails to decode.
+    std::future<std::vector<Uint8>> ReadAsync(AssetId id);
+    std::future<std::vector<Uint8>> ReadAsync(const std::string& path) { return ReadAsync(AssetId(path)); }
+    void ReadAsync(AssetId id, AsyncIo::Callback callback);
+    void ReadAsync(const std::string& path, AsyncIo::Callback callback) { ReadAsync(AssetId(path), std::move(callback)); }
+
+    // Queues a read and decode on the load pipeline, see LoadQueue. Completions only
+    // run from PollLoads, which the engine calls once a frame.
+    LoadHandle LoadAsync(AssetId id, eLoadPriority priority, LoadQueue::Decoder decoder = nullptr,
+        LoadQueue::Completion completion = nullptr, Uint32 tag = 0);
+    void CancelLoads(Uint32 tag);
+    size_t PollLoads(size_t max = static_cast<size_t>(-1));
+
+    // False if no layer has the file. Otherwise stored says whether the file's bytes
+    // are on disk as is at fileName, offset and size, or the layer has to decode them
+    // with Open.
+    bool Locate(AssetId id, std::string& fileName, size_t& offset, size_t& size, bool& stored) const;
+
+    size_t FileCount() const;
+
+    // While set every file opened or read is recorded against the log's current scene,
+    // null stops recording. Safe while loads are running, once it returns nothing is
+    // still recording to the old log, so that can then be destroyed.
+    void SetAccessLog(AccessLog* log);
+    AccessLog* GetAccessLog() const;
+
+    // Lower case with / separators and no leading or trailing separators
+    static std::string NormalizePath(const std::string& path);
+
+    // Every file under directory with / separators and the case left alone. Symlinked
+    // folders are listed once however many links lead to them.
+    static void ListDirectory(const std::string& directory, std::vector<std::string>& files);
+
+    AsyncIo& Io() { return mIo; }
 private:
+    struct Layer
+    {
+        std::unique_ptr<FileSystemLayer> files;
+        std::string mountPoint;
+        int priority;
+        size_t order;
+    };
+
+    struct Resolved
+    {
+        LayerId layer;
+        size_t index;
+    };
+
+    bool Outranks(LayerId a, LayerId b) const;
+    std::string FullPath(const Layer& layer, size_t index) const;
+    void AddToIndex(LayerId id);
+    void RemoveFromIndex(LayerId id);
+    const Resolved* Resolve(AssetId id) const;
+    void RecordAccess(const Resolved& resolved) const;
+
+    AsyncIo mIo;
+
+    // Lookups from the IO and load threads share it, mounting takes it alone
+    mutable std::shared_timed_mutex mIndexMutex;
+    std::map<LayerId, Layer> mLayers;
+    std::unordered_map<AssetId, Resolved> mIndex;
+    LayerId mNextId = 1;
+    size_t mMountCount = 0;
+    AccessLog* mAccessLog = nullptr;
 
+    // Made on first use, last so in flight loads finish before anything else goes
+    std::mutex mLoadsMutex;
+    std::unique_ptr<LoadQueue> mLoads;
+    LoadQueue& Loads();
 };
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <SDL_types.h>
+
+class KernelBin;
+
+// The inventory shares one id space, in this order
+enum eInventoryKind
+{
+    eInventoryItem,
+    eInventoryWeapon,
+    eInventoryArmor,
+    eInventoryAccessory,
+    eInventoryKindCount,
+    eInventoryNone = eInventoryKindCount
+};
+
+struct InventoryRef
+{
+    Uint16 kind;    // eInventoryKind
+    Uint16 row;
+};
+
+// Indexed by inventory id, what a scan over a whole inventory needs without first
+// finding each id's table. power is attack power for weapons and items, defense for armor.
+struct InventoryColumns
+{
+    size_t count;
+    const Uint8* kind;      // eInventoryKind
+    const Uint16* row;
+    const Uint32* names;
+    const Uint16* restrictions;
+    const Uint16* equipMask;
+    const Uint8* power;
+};
+
+// Each table is a set of columns, one value per record, so a scan over one field
+// of every weapon only touches that field. Names are offsets for GameDatabase::Name.
+struct ItemColumns
+{
+    size_t count;
+    const Uint32* names;
+    const Uint16* restrictions;
+    const Uint8* targetFlags;
+    const Uint8* attackPower;
+    const Uint16* elements;
+    const Uint32* statusMask;
+};
+
+struct WeaponColumns
+{
+    size_t count;
+    const Uint32* names;
+    const Uint16* restrictions;
+    const Uint16* equipMask;
+    const Uint8* attackPower;
+    const Uint8* accuracy;
+    const Uint8* criticalRate;
+    const Uint16* elements;
+    const Uint8* materiaGrowth;
+    const Uint8* materiaSlots;  // 8 per weapon
+};
+
+struct ArmorColumns
+{
+    size_t count;
+    const Uint32* names;
+    const Uint16* restrictions;
+    const Uint16* equipMask;
+    const Uint8* defense;
+    const Uint8* magicDefense;
+    const Uint8* evade;
+    const Uint8* magicEvade;
+    const Uint16* elements;
+    const Uint8* materiaGrowth;
+    const Uint8* materiaSlots;  // 8 per armor
+};
+
+struct AccessoryColumns
+{
+    size_t count;
+    const Uint32* names;
+    const Uint16* restrictions;
+    const Uint16* equipMask;
+    const Uint16* elements;
+    const Uint32* statusMask;
+    const Uint8* specialEffect;
+};
+
+struct MateriaColumns
+{
+    size_t count;
+    const Uint32* names;
+    const Uint8* type;
+    const Uint8* element;
+    const Uint32* apToMaster;   // AP, not hundreds of it
+};
+
+struct AttackColumns
+{
+    size_t count;
+    const Uint32* names;
+    const Uint16* mpCost;
+    const Uint8* targetFlags;
+    const Uint8* damageCalculation;
+    const Uint8* attackPower;
+    const Uint16* elements;
+    const Uint32* statusMask;
+};
+
+// Read only tables of the items, equipment, materia and attacks from KERNEL.BIN,
+// built once after it is loaded. Every column, the inventory id map and the decoded
+// names live in one allocation and each distinct name is stored once, so menus and
+// battle formulas can walk whole columns without chasing pointers.
+class GameDatabase
+{
+public:
+    static const Uint16 kInventoryIdCount = 320;
+    static const Uint32 kNoName = 0;
+
+    explicit GameDatabase(const KernelBin& kernel);
+    GameDatabase(const GameDatabase&) = delete;
+    GameDatabase& operator = (const GameDatabase&) = delete;
+
+    const ItemColumns& Items() const { return mItems; }
+    const WeaponColumns& Weapons() const { return mWeapons; }
+    const ArmorColumns& Armor() const { return mArmor; }
+    const AccessoryColumns& Accessories() const { return mAccessories; }
+    const MateriaColumns& Materia() const { return mMateria; }
+    const AttackColumns& Attacks() const { return mAttacks; }
+    const InventoryColumns& Inventory() const { return mInventory; }
+
+    // kind is eInventoryNone for an id past the end or one KERNEL.BIN has no record for
+    InventoryRef Find(Uint16 inventoryId) const;
+    Uint16 InventoryId(eInventoryKind kind, Uint16 row) const;
+
+    // Empty for kNoName
+    const char* Name(Uint32 name) const { return mNames + name; }
+
+    size_t ArenaSize() const { return mArenaSize; }
+    size_t DistinctNames() const { return mDistinctNames; }
+private:
+    std::unique_ptr<Uint8[]> mArena;
+    size_t mArenaSize = 0;
+    const char* mNames = nullptr;
+    size_t mDistinctNames = 0;
+    InventoryColumns mInventory = {};
+    ItemColumns mItems = {};
+    WeaponColumns mWeapons = {};
+    ArmorColumns mArmor = {};
+    AccessoryColumns mAccessories = {};
+    MateriaColumns mMateria = {};
+    AttackColumns mAttacks = {};
+};
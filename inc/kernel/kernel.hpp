@@ -1,12 +1,63 @@
 #pragma once
 
+#include <map>
+#include <memory>
+#include <string>
 #include "kernel/filesystem.hpp"
+#include "kernel/resourcecache.hpp"
+#include "kernel/texturededup.hpp"
+#include "kernel/threadpool.hpp"
+
+class AccessLog;
+class Lgp;
+class FieldLoader;
+class KernelBin;
+class GameDatabase;
 
 class Kernel
 {
 public:
     Kernel();
+    ~Kernel();
+
+    // Opens the game's LGP archives under dataPath, skipping any that are missing.
+    // Their indexes are kept in indexCacheFile so later starts don't parse them.
+    void MountArchives(const std::string& dataPath, const std::string& indexCacheFile);
+
+    // Records which archive entries each field touches from now on and writes them to
+    // logFile when the kernel goes away, for 7-Gears-LgpTool optimize to repack with
+    void RecordAccesses(const std::string& logFile);
+
+    // Decodes data/kernel/KERNEL.BIN and, if it is there, KERNEL2.BIN under dataPath
+    void LoadKernelData(const std::string& dataPath);
+
+    // By file name, e.g "char.lgp", null if it wasn't mounted
+    std::shared_ptr<Lgp> Archive(const std::string& name) const;
+
+    FileSystem& GetFileSystem() { return mFileSystem; }
+    ResourceCache& GetResources() { return mResources; }
+
+    // Call BeginScene on it when a field or battle starts to log what the last one shared
+    TextureDedup& GetTextureDedup() { return mTextureDedup; }
+
+    // Null until flevel.lgp has been mounted
+    FieldLoader* Fields() { return mFields.get(); }
+
+    // Null until LoadKernelData has succeeded
+    const KernelBin* GetKernelBin() const { return mKernelBin.get(); }
+    const GameDatabase* GetDatabase() const { return mDatabase.get(); }
 private:
 
+    ThreadPool mPool;
+
+    // Texture decoders still in flight use these until mFileSystem has waited for them
+    TextureDedup mTextureDedup;
+    std::unique_ptr<AccessLog> mAccessLog;
+    std::string mAccessLogFile;
     FileSystem mFileSystem;
+    ResourceCache mResources;
+    std::unique_ptr<FieldLoader> mFields;
+    std::unique_ptr<KernelBin> mKernelBin;
+    std::unique_ptr<GameDatabase> mDatabase;
+    std::map<std::string, std::shared_ptr<Lgp>> mArchives;
 };
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <SDL_types.h>
+#include "kernel/binarylayout.hpp"
+
+class Stream;
+class ThreadPool;
+
+// Records are used where they were decoded, so multi byte fields are little endian
+// and the word size only says not to swap anything
+struct KernelCommand
+{
+    Uint8 initialCursorAction;
+    Uint8 targetFlags;
+    Uint8 unknown[2];
+    Uint16 cameraSingle;
+    Uint16 cameraMultiple;
+};
+BINARY_LAYOUT(KernelCommand, 8, 1);
+
+struct KernelAttack
+{
+    Uint8 attackPercent;
+    Uint8 impactEffect;
+    Uint8 targetHurtAction;
+    Uint8 unknown;
+    Uint16 mpCost;
+    Uint16 impactSound;
+    Uint16 cameraSingle;
+    Uint16 cameraMultiple;
+    Uint8 targetFlags;
+    Uint8 attackEffect;
+    Uint8 damageCalculation;
+    Uint8 attackPower;
+    Uint8 conditionSubmenu;
+    Uint8 statusChance;
+    Uint8 additionalEffects;
+    Uint8 additionalEffectsModifier;
+    Uint32 statusMask;
+    Uint16 elements;
+    Uint16 specialFlags;
+};
+BINARY_LAYOUT(KernelAttack, 28, 1);
+BINARY_FIELD(KernelAttack, statusMask, 0x14);
+
+struct KernelItem
+{
+    Uint8 unknown[8];
+    Uint16 cameraMovement;
+    Uint16 restrictions;
+    Uint8 targetFlags;
+    Uint8 attackEffect;
+    Uint8 damageCalculation;
+    Uint8 attackPower;
+    Uint8 conditionSubmenu;
+    Uint8 statusChance;
+    Uint8 additionalEffects;
+    Uint8 additionalEffectsModifier;
+    Uint32 statusMask;
+    Uint16 elements;
+    Uint16 specialFlags;
+};
+BINARY_LAYOUT(KernelItem, 28, 1);
+BINARY_FIELD(KernelItem, statusMask, 0x14);
+
+struct KernelWeapon
+{
+    Uint8 targetFlags;
+    Uint8 attackEffect;
+    Uint8 damageCalculation;
+    Uint8 unknown0;
+    Uint8 attackPower;
+    Uint8 statusAttack;
+    Uint8 materiaGrowth;
+    Uint8 criticalRate;
+    Uint8 accuracy;
+    Uint8 model;
+    Uint8 alignment;
+    Uint8 highSoundMask;
+    Uint16 cameraMovement;
+    Uint16 equipMask;
+    Uint16 elements;
+    Uint16 unknown1;
+    Uint8 statTypes[4];
+    Uint8 statAmounts[4];
+    Uint8 materiaSlots[8];
+    Uint8 hitSound;
+    Uint8 criticalSound;
+    Uint8 missSound;
+    Uint8 impactEffect;
+    Uint16 specialFlags;
+    Uint16 restrictions;
+};
+BINARY_LAYOUT(KernelWeapon, 44, 1);
+BINARY_FIELD(KernelWeapon, materiaSlots, 0x1C);
+
+struct KernelArmor
+{
+    Uint8 unknown0;
+    Uint8 elementModifier;
+    Uint8 defense;
+    Uint8 magicDefense;
+    Uint8 evade;
+    Uint8 magicEvade;
+    Uint8 statusDefense;
+    Uint8 unknown1[2];
+    Uint8 materiaSlots[8];
+    Uint8 materiaGrowth;
+    Uint16 equipMask;
+    Uint16 elements;
+    Uint16 unknown2;
+    Uint8 statTypes[4];
+    Uint8 statAmounts[4];
+    Uint16 restrictions;
+    Uint16 unknown3;
+};
+BINARY_LAYOUT(KernelArmor, 36, 1);
+BINARY_FIELD(KernelArmor, equipMask, 0x12);
+
+struct KernelAccessory
+{
+    Uint8 statTypes[2];
+    Uint8 statAmounts[2];
+    Uint8 elementStrength;
+    Uint8 specialEffect;
+    Uint16 elements;
+    Uint32 statusMask;
+    Uint16 equipMask;
+    Uint16 restrictions;
+};
+BINARY_LAYOUT(KernelAccessory, 16, 1);
+
+struct KernelMateria
+{
+    Uint16 apLevels[4];     // In hundreds of AP
+    Uint8 equipEffect;
+    Uint8 status[3];
+    Uint8 element;
+    Uint8 type;
+    Uint8 attributes[6];
+};
+BINARY_LAYOUT(KernelMateria, 20, 1);
+
+// Records of one section, straight out of the decoded data
+template<typename T>
+class KernelTable
+{
+public:
+    KernelTable(const Uint8* data, size_t size)
+        : mData(reinterpret_cast<const T*>(data)), mCount(size / sizeof(T))
+    {
+
+    }
+
+    size_t Count() const { return mCount; }
+    const T& operator[](size_t index) const { return mData[index]; }
+    const T* begin() const { return mData; }
+    const T* end() const { return mData + mCount; }
+private:
+    const T* mData;
+    size_t mCount;
+};
+
+// A text section: a table of u16 offsets then the strings, each ended by 0xFF
+class KernelText
+{
+public:
+    KernelText(const Uint8* data, size_t size);
+
+    size_t Count() const { return mCount; }
+
+    // Still in FF7's encoding, empty past the end
+    void String(size_t index, const Uint8*& data, size_t& size) const;
+
+    // As ASCII, characters outside it become '?' and control codes are dropped
+    std::string Decoded(size_t index) const;
+private:
+    const Uint8* mData;
+    size_t mSize;
+    size_t mCount;
+};
+
+// KERNEL.BIN is a run of gzipped sections, each behind a u16 compressed size, u16
+// size and u16 section number. The headers are walked in one pass and then every
+// section is inflated at once on the pool in to a single arena, so loading takes
+// about as long as the biggest section. KERNEL2.BIN, the PC's LZSS compressed
+// replacement for the text sections, is decoded alongside them.
+class KernelBin
+{
+public:
+    enum eSection
+    {
+        eCommands,
+        eAttacks,
+        eBattleGrowth,
+        eInitData,
+        eItems,
+        eWeapons,
+        eArmor,
+        eAccessories,
+        eMateria,
+        eCommandHelp,
+        eMagicHelp,
+        eItemHelp,
+        eWeaponHelp,
+        eArmorHelp,
+        eAccessoryHelp,
+        eMateriaHelp,
+        eKeyItemHelp,
+        eCommandNames,
+        eMagicNames,
+        eItemNames,
+        eWeaponNames,
+        eArmorNames,
+        eAccessoryNames,
+        eMateriaNames,
+        eKeyItemNames,
+        eBattleText,
+        eSummonNames,
+        eSectionCount
+    };
+
+    // kernel2 can be null, throws on corrupt data. Either file may be as Cook and
+    // Lzss::Cook left it in a cooked pack, their sections are then copied as is.
+    KernelBin(Stream& kernel, Stream* kernel2, ThreadPool& pool);
+    KernelBin(const KernelBin&) = delete;
+    KernelBin& operator = (const KernelBin&) = delete;
+
+    // Empty for sections the files didn't have
+    const Uint8* Section(eSection section, size_t& size) const;
+
+    template<typename T>
+    KernelTable<T> Table(eSection section) const
+    {
+        size_t size = 0;
+        const Uint8* data = Section(section, size);
+        return KernelTable<T>(data, size);
+    }
+
+    KernelText Text(eSection section) const;
+
+    KernelTable<KernelCommand> Commands() const { return Table<KernelCommand>(eCommands); }
+    KernelTable<KernelAttack> Attacks() const { return Table<KernelAttack>(eAttacks); }
+    KernelTable<KernelItem> Items() const { return Table<KernelItem>(eItems); }
+    KernelTable<KernelWeapon> Weapons() const { return Table<KernelWeapon>(eWeapons); }
+    KernelTable<KernelArmor> Armor() const { return Table<KernelArmor>(eArmor); }
+    KernelTable<KernelAccessory> Accessories() const { return Table<KernelAccessory>(eAccessories); }
+    KernelTable<KernelMateria> Materia() const { return Table<KernelMateria>(eMateria); }
+
+    size_t ArenaSize() const { return mArenaSize; }
+
+    // PackCooker converter for KERNEL.BIN, the same section headers with every
+    // section inflated and stored as is
+    static std::vector<Uint8> Cook(Stream& kernel);
+private:
+    struct SectionInfo
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    std::unique_ptr<Uint8[]> mArena;
+    size_t mArenaSize = 0;
+    SectionInfo mSections[eSectionCount] = {};
+};
@@ -1,7 +1,106 @@
 #pragma once
 
+#include <string>
+#include <vector>
+#include <SDL_types.h>
+#include "kernel/assetid.hpp"
+#include "kernel/stream.hpp"
+
+// Reader for FF7's LGP archives. The table of contents is parsed once when the archive
+// is opened and entries come back as Stream slices sharing the archive's mapping, so
+// nothing is copied and different entries can be read from different threads.
 class Lgp
 {
 public:
+    static const size_t kLookupValueMax = 30;
+    static const size_t kLookupTableSize = kLookupValueMax * kLookupValueMax;
+    static const size_t kNotFound = static_cast<size_t>(-1);
+    static const size_t kDataHeaderSize = 24;
+
+    struct TocEntry
+    {
+        Uint32 nameOffset;
+        Uint32 nameLength;
+        Uint32 offset;
+        Uint32 conflict;
+
+        // AssetId of the name, split so the table stays 4 byte aligned
+        Uint32 hashLow;
+        Uint32 hashHigh;
+
+        AssetId Id() const { return AssetId(static_cast<Uint64>(hashHigh) << 32 | hashLow); }
+    };
+
+    // Everything needed to find entries without touching the archive's own TOC. It
+    // either points at the Lgp's own storage or in to an LgpIndexCache mapping.
+    struct Index
+    {
+        const TocEntry* entries;
+        size_t entryCount;
+        const char* names;
+        size_t namesSize;
+
+        // Open addressed hash of AssetIds, holds entry index + 1 with 0 for empty
+        const Uint32* slots;
+        size_t slotCount;
+    };
+
+    explicit Lgp(const std::string& fileName);
+    explicit Lgp(Stream&& stream);
+
+    // Uses an index built on a previous run, owner keeps its memory alive
+    Lgp(Stream&& stream, const Index& index, const std::shared_ptr<const void>& owner);
+    Lgp(const Lgp&) = delete;
+    Lgp& operator = (const Lgp&) = delete;
+
+    // Names are case insensitive and may use / or \ in conflict paths
+    size_t Find(AssetId id) const;
+    size_t Find(const std::string& name) const { return Find(AssetId(name)); }
+    bool Contains(AssetId id) const { return Find(id) != kNotFound; }
+    bool Contains(const std::string& name) const { return Find(name) != kNotFound; }
 
+    // Throw if there is no such entry
+    Stream Open(AssetId id) const;
+    Stream Open(const std::string& name) const { return Open(AssetId(name)); }
+    Stream Open(size_t index) const;
+    Uint32 EntrySize(size_t index) const;
+
+    size_t EntryCount() const { return mIndex.entryCount; }
+
+    // Lower case, prefixed with its folder when the archive holds more than one
+    // file of the same name
+    std::string EntryName(size_t index) const;
+    Uint32 EntryOffset(size_t index) const { return mIndex.entries[index].offset; }
+
+    // Where the entry's bytes start in the archive, after its own small header
+    size_t EntryDataOffset(size_t index) const { return EntryOffset(index) + kDataHeaderSize; }
+
+    const Index& GetIndex() const { return mIndex; }
+    std::string Name() const { return mStream.Name(); }
+    size_t Size() const { return mStream.Size(); }
+
+    // Bucket of the archive's built in lookup table that a name lives in, or -1
+    static int LookupIndex(const std::string& name);
+    static std::string NormalizeName(const std::string& name);
+private:
+    struct LookupEntry
+    {
+        Uint16 tocIndex;    // 1 based, 0 for an empty bucket
+        Uint16 count;
+    };
+
+    void ReadToc();
+    void BuildHash(const std::vector<Uint32>& order);
+    bool NameEquals(size_t index, const char* name, size_t length) const;
+
+    Stream mStream;
+    Index mIndex = {};
+    std::shared_ptr<const void> mIndexOwner;
+
+    // Backing storage for mIndex when the TOC was parsed
+    std::vector<TocEntry> mEntries;
+    std::string mNames;
+    std::vector<Uint32> mSlots;
 };
+
+BINARY_LAYOUT(Lgp::TocEntry, 24, sizeof(Uint32));
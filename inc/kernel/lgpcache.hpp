@@ -0,0 +1,50 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <SDL_types.h>
+
+class Lgp;
+class MappedFile;
+
+// Keeps the parsed index of every archive in one file that is mapped on the next
+// run, so archives that haven't changed are opened without reading their TOC. The
+// file is a local cache in host byte order and isn't meant to be shared.
+class LgpIndexCache
+{
+public:
+    explicit LgpIndexCache(const std::string& fileName);
+    ~LgpIndexCache();
+    LgpIndexCache(const LgpIndexCache&) = delete;
+    LgpIndexCache& operator = (const LgpIndexCache&) = delete;
+
+    // Uses the cached index when the archive's size and modified time still match
+    // and the record holds together, otherwise parses the archive. Throws if the
+    // archive can't be opened.
+    std::shared_ptr<Lgp> Open(const std::string& archivePath);
+
+    // Rewrites the cache with the archives opened so far if any had to be parsed
+    void Save();
+
+    size_t Hits() const { return mHits; }
+    size_t Misses() const { return mMisses; }
+private:
+    struct Opened
+    {
+        std::string path;
+        Uint64 size;
+        Uint64 modifiedTime;
+        std::shared_ptr<Lgp> archive;
+    };
+
+    void Load();
+
+    std::string mFileName;
+    std::shared_ptr<MappedFile> mMapping;
+    std::map<std::string, const Uint8*> mRecords;
+    std::vector<Opened> mOpened;
+    size_t mHits = 0;
+    size_t mMisses = 0;
+};
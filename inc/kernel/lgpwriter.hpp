@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <SDL_types.h>
+#include "kernel/stream.hpp"
+
+class ThreadPool;
+
+// Builds an LGP archive. Entries are copied straight from their source streams in
+// to a mapping of the new archive on a thread pool, then the table of contents, the
+// 30x30 lookup table and the conflict table are built for the final layout.
+class LgpWriter
+{
+public:
+    // Names may have a folder in front, e.g "battle/aaaa.tex", which puts the entry
+    // in the conflict table so files of the same name can live in one archive
+    void Add(const std::string& name, Stream&& data);
+
+    // Entries are written group by group in the order given, with each group starting
+    // on a multiple of alignment so it can be read in whole pages. Indexes are in add
+    // order. Anything not in a group follows in TOC order.
+    void SetDataGroups(const std::vector<std::vector<size_t>>& groups, size_t alignment)
+    {
+        mGroups = groups;
+        mAlignment = alignment;
+    }
+
+    // Throws on names that won't fit or if the file can't be written. Returns the size
+    // of the archive.
+    size_t Write(const std::string& fileName, ThreadPool& pool);
+
+    size_t EntryCount() const { return mEntries.size(); }
+private:
+    struct Entry
+    {
+        std::string name;
+        std::string path;
+        Stream data;
+        size_t offset;
+        Uint16 conflict;
+    };
+
+    std::vector<Entry> mEntries;
+    std::vector<std::vector<size_t>> mGroups;
+    size_t mAlignment = 1;
+};
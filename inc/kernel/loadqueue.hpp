@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <SDL_types.h>
+#include "kernel/assetid.hpp"
+#include "kernel/threadpool.hpp"
+
+class FileSystem;
+class LoadQueue;
+
+enum eLoadPriority
+{
+    eLoadCritical,  // The frame can't go on without it
+    eLoadVisible,   // On screen soon
+    eLoadPrefetch,  // Might be wanted later
+    eLoadPriorityCount
+};
+
+enum eLoadState
+{
+    eLoadQueued,
+    eLoadReading,
+    eLoadDecoding,
+    eLoadReady,
+    eLoadFailed,
+    eLoadCancelled
+};
+
+struct LoadJob;
+
+// Refers to one LoadAsync request, copies refer to the same request
+class LoadHandle
+{
+public:
+    LoadHandle() = default;
+
+    bool IsValid() const { return mJob != nullptr; }
+    eLoadState State() const;
+    bool IsDone() const;
+    AssetId Id() const;
+
+    // Stops the job at its next stage, its completion never runs
+    void Cancel();
+
+    // The decoder's output once State is eLoadReady, null before then
+    template<typename T>
+    std::shared_ptr<const T> Get() const { return std::static_pointer_cast<const T>(Result()); }
+    std::shared_ptr<const void> Result() const;
+private:
+    friend class LoadQueue;
+    explicit LoadHandle(const std::shared_ptr<LoadJob>& job)
+        : mJob(job)
+    {
+
+    }
+
+    std::shared_ptr<LoadJob> mJob;
+};
+
+// Runs asset loads as a pipeline: the read is queued on the FileSystem's AsyncIo (or
+// the file is opened on a worker when its layer has to decompress it), the bytes are
+// decoded on a worker and the finished job waits for Poll. Higher priority jobs jump
+// the queue at every stage and only a few reads are let in to flight at once so a
+// late critical load doesn't wait behind a pile of prefetches. Nothing blocks the
+// caller; the engine polls once a frame and completions run on its thread.
+class LoadQueue
+{
+public:
+    // Turns the file's bytes in to the finished asset, runs on a worker
+    typedef std::function<std::shared_ptr<const void>(std::vector<Uint8>&& data)> Decoder;
+
+    // Runs on the thread calling Poll once the job is ready or has failed
+    typedef std::function<void(const LoadHandle& handle)> Completion;
+
+    LoadQueue(FileSystem& fileSystem, size_t maxReads = 8, size_t threadCount = 0);
+
+    // Cancels everything and waits for reads already in flight
+    ~LoadQueue();
+    LoadQueue(const LoadQueue&) = delete;
+    LoadQueue& operator = (const LoadQueue&) = delete;
+
+    // A null decoder hands back the bytes as a std::vector<Uint8>. Jobs can be
+    // tagged, e.g with a scene number, to cancel them together.
+    LoadHandle Load(AssetId id, eLoadPriority priority, Decoder decoder, Completion completion, Uint32 tag = 0);
+
+    void Cancel(Uint32 tag);
+    void CancelAll();
+
+    // Runs completions for up to max finished jobs, returns how many ran
+    size_t Poll(size_t max = static_cast<size_t>(-1));
+
+    // Jobs not yet polled, cancelled ones excluded
+    size_t Pending() const;
+private:
+    void IssueReads();
+    void StartRead(const std::shared_ptr<LoadJob>& job);
+    void OnRead(const std::shared_ptr<LoadJob>& job, std::vector<Uint8>&& data, bool ok);
+    void DecodeNext();
+    void Finish(const std::shared_ptr<LoadJob>& job, eLoadState state);
+    std::shared_ptr<LoadJob> PopBest(std::deque<std::shared_ptr<LoadJob>>* queues);
+
+    FileSystem& mFileSystem;
+    const size_t mMaxReads;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mFinished;
+    std::deque<std::shared_ptr<LoadJob>> mWaiting[eLoadPriorityCount];
+    std::deque<std::shared_ptr<LoadJob>> mDecodeReady[eLoadPriorityCount];
+    std::vector<std::shared_ptr<LoadJob>> mActive;
+    std::vector<std::shared_ptr<LoadJob>> mCompleted;
+    size_t mReadsInFlight = 0;
+
+    // Last so its workers stop before the rest goes away
+    ThreadPool mPool;
+};
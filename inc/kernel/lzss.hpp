@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <SDL_types.h>
+
+class Stream;
+class ThreadPool;
+
+// FF7's LZSS, used for field files and most of the PC data. A control byte's bits,
+// lowest first, say whether each following item is a literal byte (1) or a two byte
+// reference (0) in to a 4K window: 12 bits of window offset and 4 bits of length - 3.
+// The window starts being written at 0xFEE and reads from before the start of the
+// output give zeros.
+class Lzss
+{
+public:
+    // The header only has the compressed size, this walks the control bytes to add up
+    // the output without writing any of it. Throws on truncated data.
+    static size_t DecompressedSize(const Uint8* data, size_t size);
+
+    // Raw compressed bytes, without the size header, straight in to dest. Returns the
+    // decompressed size and throws if dest is too small or the data is truncated.
+    // Bytes of dest past the returned size may be overwritten.
+    static size_t Decompress(const Uint8* data, size_t size, Uint8* dest, size_t destSize);
+    static std::vector<Uint8> Decompress(const Uint8* data, size_t size);
+
+    // A file as stored in the archives, a u32 compressed size then the data, or as
+    // Cook left it in a cooked pack
+    static std::vector<Uint8> Decompress(Stream& stream);
+
+    // The decompressed contents of stream's file as a Stream of their own
+    static Stream Open(Stream& stream);
+
+    // PackCooker converter, the file decompressed behind an eCookedDecompressed header
+    static std::vector<Uint8> Cook(Stream& stream);
+
+    // Output any FF7 decoder can read, without the size header. Matches are found
+    // with hash chains. Big inputs are split in to chunks that are searched on pool
+    // when one is given; matches can still reach back in to the previous chunk so
+    // splitting costs next to nothing in size.
+    static std::vector<Uint8> Compress(const Uint8* data, size_t size, ThreadPool* pool = nullptr);
+
+    // With the u32 size header, ready to go in an archive
+    static std::vector<Uint8> CompressFile(const Uint8* data, size_t size, ThreadPool* pool = nullptr);
+};
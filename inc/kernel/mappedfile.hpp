@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <SDL_types.h>
+
+// View of a whole file mapped in to the address space. Files are mapped read only
+// with Open, or created at a fixed size and mapped for writing with Create.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    bool Open(const std::string& fileName);
+    bool Create(const std::string& fileName, size_t size);
+    void Close();
+
+    const Uint8* Data() const { return mData; }
+
+    // Null unless the file was made with Create
+    Uint8* MutableData() const { return mWritable ? const_cast<Uint8*>(mData) : nullptr; }
+    size_t Size() const { return mSize; }
+private:
+    const Uint8* mData = nullptr;
+    size_t mSize = 0;
+    bool mWritable = false;
+#ifdef _WIN32
+    void* mFile = nullptr;
+    void* mMapping = nullptr;
+#endif
+};
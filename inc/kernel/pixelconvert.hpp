@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <SDL_types.h>
+
+enum eCpuPath
+{
+    eCpuScalar,
+    eCpuSse2,
+    eCpuSsse3,
+    eCpuAvx2,
+    eCpuPathCount
+};
+
+// Direct color layouts with their own loops, anything else goes through masks and
+// shifts read at run time
+enum ePixelLayout
+{
+    eLayoutGeneric,
+    eLayoutRgb5551,     // Red in the top bits
+    eLayoutBgr5551,     // Red in the bottom bits, as on the PlayStation
+    eLayoutBgr24,
+    eLayoutBgra32,
+    eLayoutCount
+};
+
+// Red, green, blue and alpha, a channel with no bits reads as 0 (or 0xFF for alpha)
+struct PixelMasks
+{
+    Uint32 bytesPerPixel;
+    Uint32 mask[4];
+    Uint32 shift[4];
+    Uint32 bits[4];
+};
+
+// Pixel loops for texture loading. Output pixels are RGBA8, R in the first byte in
+// memory. Each loop has a plain C++ reference and, on x86, SIMD versions picked at
+// run time by what the CPU supports, so the build doesn't need AVX2 on. Palette
+// expansion has SSE2 and AVX2 loops, SSSE3 uses the SSE2 ones. Direct color has SSE2
+// and SSSE3 loops, AVX2 uses the SSSE3 ones.
+class PixelConvert
+{
+public:
+    static bool Supported(eCpuPath path);
+
+    // The fastest supported path, used when none is asked for
+    static eCpuPath Best();
+    static const char* PathName(eCpuPath path);
+
+    // palette must have 256 entries, an unsupported path falls back to Best()
+    static void Expand8(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest);
+    static void Expand8(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest, eCpuPath path);
+
+    // Two pixels a byte, low nibble first. palette must have 16 entries.
+    static void Expand4(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest);
+    static void Expand4(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest, eCpuPath path);
+
+    // A whole image of 4 or 8 bit indices in rows of rowBytes
+    static void ExpandImage(const Uint8* indices, Uint32 bits, Uint32 width, Uint32 height, size_t rowBytes,
+        const Uint32* palette, Uint32* dest);
+
+    static ePixelLayout Recognise(const PixelMasks& masks);
+    static const char* LayoutName(ePixelLayout layout);
+
+    // Little endian direct color pixels to RGBA8. The color key clears pure black
+    // pixels and a non zero reference alpha clears any pixel with less alpha, both
+    // in the same pass as the conversion. The layout must be what Recognise gave.
+    static void ConvertDirect(const Uint8* src, size_t count, const PixelMasks& masks, ePixelLayout layout,
+        bool colorKey, Uint8 referenceAlpha, Uint32* dest);
+    static void ConvertDirect(const Uint8* src, size_t count, const PixelMasks& masks, ePixelLayout layout,
+        bool colorKey, Uint8 referenceAlpha, Uint32* dest, eCpuPath path);
+
+    // Byte order independent way to make a pixel
+    static Uint32 Rgba(Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <SDL_types.h>
+
+// Minimal PNG writer for the tools: 8 bit RGBA, no interlacing, deflated with zlib.
+// Each row gets whichever of the None, Sub and Up filters leaves the smallest sum of
+// bytes, which is what most encoders do and gets close to their sizes.
+class Png
+{
+public:
+    // pixels are RGBA8 with R in the first byte in memory, as PixelConvert makes them.
+    // level is zlib's, 1 is fastest and 9 smallest.
+    static std::vector<Uint8> Encode(const Uint32* pixels, Uint32 width, Uint32 height, int level = 6);
+};
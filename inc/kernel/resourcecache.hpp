@@ -0,0 +1,174 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <SDL_types.h>
+#include "kernel/assetid.hpp"
+#include "kernel/stream.hpp"
+
+class FileSystem;
+class ResourceCache;
+
+enum eResourceClass
+{
+    eTexture,
+    eModel,
+    eAudio,
+    eScript,
+    eField,
+    eResourceClassCount
+};
+
+// A strong reference to a cached resource, the resource can't be evicted while any
+// handle to it is alive. Handles must not outlive their cache.
+class ResourceHandle
+{
+public:
+    ResourceHandle() = default;
+    ResourceHandle(const ResourceHandle& other);
+    ResourceHandle(ResourceHandle&& other);
+    ResourceHandle& operator = (ResourceHandle other);
+    ~ResourceHandle();
+
+    bool IsValid() const { return mCache != nullptr; }
+    explicit operator bool() const { return IsValid(); }
+
+    // The object the class's loader made, std::vector<Uint8> for the default loader
+    template<typename T>
+    const T* Get() const { return static_cast<const T*>(mData); }
+
+    Uint32 Index() const { return mIndex; }
+    Uint32 Generation() const { return mGeneration; }
+private:
+    friend class ResourceCache;
+    ResourceHandle(ResourceCache* cache, Uint32 index, Uint32 generation, const void* data);
+
+    ResourceCache* mCache = nullptr;
+    Uint32 mIndex = 0;
+    Uint32 mGeneration = 0;
+    const void* mData = nullptr;
+};
+
+// Doesn't keep the resource alive, Lock fails once it has been evicted and its slot
+// has been given to something else
+struct WeakResource
+{
+    Uint32 index;
+    Uint32 generation;
+};
+
+// Owns everything loaded through the FileSystem on behalf of the menus, field and
+// battle code so an asset is only ever loaded once. Each class of resource has its
+// own byte budget; resources nothing holds a handle to stay resident until their class
+// goes over budget and are then evicted least recently used first. Safe to use from
+// any thread.
+class ResourceCache
+{
+public:
+    // Turns a file in to the resource handed out by handles and reports how many
+    // bytes it keeps resident
+    typedef std::function<std::shared_ptr<const void>(Stream& data, size_t& residentBytes)> Loader;
+
+    struct Stats
+    {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t residentBytes;
+        size_t budget;
+
+        // Held by more than one entry, such as textures shared by TextureDedup. Each
+        // object is charged to residentBytes once while any entry holds it and the
+        // other entries' bytes are counted here instead.
+        size_t sharedBytes;
+        size_t resources;
+
+        // Prefetched resources that went in, were later acquired, or didn't fit
+        size_t prefetches;
+        size_t prefetchHits;
+        size_t prefetchesDropped;
+    };
+
+    explicit ResourceCache(FileSystem& fileSystem);
+    ~ResourceCache();
+    ResourceCache(const ResourceCache&) = delete;
+    ResourceCache& operator = (const ResourceCache&) = delete;
+
+    // Lowering a budget evicts straight away
+    void SetBudget(eResourceClass resourceClass, size_t bytes);
+    void SetLoader(eResourceClass resourceClass, Loader loader);
+
+    // Loads on a miss, throws if the file can't be loaded
+    ResourceHandle Acquire(AssetId id, eResourceClass resourceClass);
+    ResourceHandle Acquire(const std::string& path, eResourceClass resourceClass) { return Acquire(AssetId(path), resourceClass); }
+
+    // Loads the resource in the background at prefetch priority and keeps it
+    // unreferenced, ready for a later Acquire. It is only kept if it fits in the
+    // class's budget next to the resources still in use. Finished prefetches are
+    // brought in by FileSystem::PollLoads.
+    void Prefetch(AssetId id, eResourceClass resourceClass);
+
+    WeakResource Weak(const ResourceHandle& handle) const { return WeakResource{ handle.mIndex, handle.mGeneration }; }
+    ResourceHandle Lock(const WeakResource& weak);
+
+    // Drops everything nothing holds a handle to
+    void Trim();
+
+    Stats GetStats(eResourceClass resourceClass) const;
+    Stats GetTotalStats() const;
+    void LogStats() const;
+
+    static const char* ClassName(eResourceClass resourceClass);
+private:
+    friend class ResourceHandle;
+
+    struct Entry
+    {
+        AssetId id;
+        eResourceClass resourceClass;
+        Uint32 generation;
+        Uint32 refCount;
+        bool prefetched;
+        size_t bytes;
+        std::shared_ptr<const void> data;
+        std::list<Uint32>::iterator lruPosition;
+    };
+
+    struct ClassState
+    {
+        Loader loader;
+        Stats stats;
+
+        // Unreferenced entries, least recently used at the front
+        std::list<Uint32> lru;
+    };
+
+    struct Prefetched
+    {
+        std::shared_ptr<const void> data;
+        size_t bytes;
+    };
+
+    Uint32 Insert(AssetId id, eResourceClass resourceClass, std::shared_ptr<const void> data, size_t bytes);
+    void OnPrefetched(AssetId id, eResourceClass resourceClass, const Prefetched* prefetched);
+    ResourceHandle Reference(Uint32 index);
+    void AddRef(Uint32 index);
+    void Release(Uint32 index);
+    void EvictOverBudget(eResourceClass resourceClass);
+    void Evict(Uint32 index);
+
+    FileSystem& mFileSystem;
+    mutable std::mutex mMutex;
+    std::vector<Entry> mEntries;
+    std::vector<Uint32> mFreeEntries;
+    std::unordered_map<AssetId, Uint32> mLookup;
+    std::unordered_map<AssetId, eResourceClass> mPrefetching;
+
+    // How many entries hold each object
+    std::unordered_map<const void*, Uint32> mHolders;
+    ClassState mClasses[eResourceClassCount];
+};
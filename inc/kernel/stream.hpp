@@ -4,24 +4,84 @@
 #include <iostream>
 #include <memory>
 #include <SDL_types.h>
+#include "kernel/binarylayout.hpp"
+#include "kernel/streamreader.hpp"
 
 class Stream
 {
 public:
-    explicit Stream(const std::string& fileName);
+    enum eMode
+    {
+        eMapped,    // Map the file read only, falls back to eBuffered if it can't be mapped
+        eBuffered,  // Read through a std::ifstream
+    };
+
+    explicit Stream(const std::string& fileName, eMode mode = eMapped);
     explicit Stream(std::vector<Uint8>&& data);
+
+    // Reads from memory owned by the caller, which must outlive the stream
+    Stream(const Uint8* data, size_t size);
+
     void ReadUInt8(Uint8& output);
     void ReadUInt32(Uint32& output);
     void ReadUInt16(Uint16& output);
     void ReadSInt16(Sint16& output);
     void ReadBytes(Sint8* pDest, size_t destSize);
     void ReadBytes(Uint8* pDest, size_t destSize);
+
+    // Reads a whole BINARY_LAYOUT struct, or an array of them, with one copy
+    template<typename T>
+    void ReadStruct(T& output)
+    {
+        ReadBytes(reinterpret_cast<Uint8*>(&output), sizeof(T));
+        BinaryLayoutToHost(&output, 1);
+    }
+
+    // Counts read from files are checked against what is left before anything is
+    // allocated, so a corrupt one throws rather than asking for gigabytes
+    template<typename T>
+    std::vector<T> ReadArray(size_t count)
+    {
+        CheckRemaining(count, sizeof(T));
+        std::vector<T> output(count);
+        ReadBytes(reinterpret_cast<Uint8*>(output.data()), sizeof(T) * count);
+        BinaryLayoutToHost(output.data(), count);
+        return output;
+    }
+
+    // Throws unless count items of itemSize bytes are left to read
+    void CheckRemaining(size_t count, size_t itemSize) const;
+
+    // Returns the next size bytes and moves past them. When the stream is backed by
+    // memory (mapped or a buffer) this points straight in to it and lives as long as
+    // the stream, otherwise it points to a scratch buffer that is only valid until
+    // the next ReadView.
+    const Uint8* ReadView(size_t size);
+
+    // Bounded view of [offset, offset + length) with its own position. Memory backed
+    // streams share their storage so slices are free to make and can be read from
+    // other threads, buffered streams have to copy the range out.
+    Stream Slice(size_t offset, size_t length) const;
+
+    // Non throwing cursor sharing this stream's position, reads through it move the
+    // stream too. A buffered stream is first loaded in to memory.
+    StreamReader& Reader();
+
     void Seek(size_t pos);
     size_t Pos() const;
     size_t Size() const;
     bool AtEnd() const;
+    bool IsBuffered() const { return mStream != nullptr; }
     std::string Name() const { return mName; }
 private:
+    Stream(const std::shared_ptr<const void>& owner, const Uint8* data, size_t size, const std::string& name);
+    void OpenBuffered(const std::string& fileName);
+
+    // Keeps the mapping or moved in buffer alive, null for borrowed memory
+    std::shared_ptr<const void> mOwner;
+    StreamReader mReader;
+    std::vector<Uint8> mScratch;
+
     mutable std::unique_ptr<std::istream> mStream;
     size_t mSize = 0;
     std::string mName;
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstring>
+#include <SDL_types.h>
+#include "kernel/binarylayout.hpp"
+
+enum eReadStatus
+{
+    eReadOk,
+    eReadPastEnd,
+};
+
+template<typename T>
+struct ReadResult
+{
+    T value;
+    eReadStatus status;
+
+    bool Ok() const { return status == eReadOk; }
+};
+
+// Non throwing cursor over memory. The checked reads return a status and leave the
+// position alone on failure. For tight loops check a whole block up front with Has()
+// and then use the unchecked Get/U8/U16/U32 reads which compile down to plain loads.
+class StreamReader
+{
+public:
+    StreamReader() = default;
+
+    StreamReader(const Uint8* data, size_t size)
+        : mBegin(data), mCur(data), mEnd(data + size)
+    {
+
+    }
+
+    size_t Pos() const { return static_cast<size_t>(mCur - mBegin); }
+    size_t Size() const { return static_cast<size_t>(mEnd - mBegin); }
+    size_t Remaining() const { return static_cast<size_t>(mEnd - mCur); }
+    bool AtEnd() const { return mCur >= mEnd; }
+    bool Has(size_t count) const { return Remaining() >= count; }
+    const Uint8* Data() const { return mBegin; }
+    const Uint8* Cur() const { return mCur; }
+
+    eReadStatus Seek(size_t pos)
+    {
+        if (pos > Size())
+        {
+            return eReadPastEnd;
+        }
+        mCur = mBegin + pos;
+        return eReadOk;
+    }
+
+    eReadStatus Skip(size_t count)
+    {
+        if (!Has(count))
+        {
+            return eReadPastEnd;
+        }
+        mCur += count;
+        return eReadOk;
+    }
+
+    template<typename T>
+    eReadStatus Read(T& output)
+    {
+        if (!Has(sizeof(T)))
+        {
+            return eReadPastEnd;
+        }
+        output = Get<T>();
+        return eReadOk;
+    }
+
+    template<typename T>
+    ReadResult<T> TryRead()
+    {
+        ReadResult<T> result = {};
+        result.status = Read(result.value);
+        return result;
+    }
+
+    eReadStatus ReadBytes(void* pDest, size_t size)
+    {
+        if (!Has(size))
+        {
+            return eReadPastEnd;
+        }
+        memcpy(pDest, mCur, size);
+        mCur += size;
+        return eReadOk;
+    }
+
+    eReadStatus ReadView(const Uint8*& output, size_t size)
+    {
+        if (!Has(size))
+        {
+            return eReadPastEnd;
+        }
+        output = mCur;
+        mCur += size;
+        return eReadOk;
+    }
+
+    // Unchecked reads, the caller must have checked Has() first
+    template<typename T>
+    T Get()
+    {
+        T value;
+        memcpy(&value, mCur, sizeof(T));
+        mCur += sizeof(T);
+        BinaryLayoutToHost(&value, 1);
+        return value;
+    }
+
+    Uint8 U8() { return *mCur++; }
+    Uint16 U16() { return Get<Uint16>(); }
+    Uint32 U32() { return Get<Uint32>(); }
+
+private:
+    const Uint8* mBegin = nullptr;
+    const Uint8* mCur = nullptr;
+    const Uint8* mEnd = nullptr;
+};
@@ -1,10 +1,55 @@
 #pragma once
 
+#include <vector>
+#include <SDL_types.h>
+#include "kernel/binarylayout.hpp"
+#include "kernel/pixelconvert.hpp"
+
+class Stream;
+
+// FF7's PC texture format: the header, palette_count palettes of BGRA colors, the
+// pixels (palette indices or direct color as pixel_format describes) and, if
+// color_key_array_flag is set, a byte per palette saying if it is color keyed.
 class TexFile
 {
 public:
     typedef unsigned int entry_t;
 
+    TexFile() = default;
+
+    // Throws if the header's sizes don't fit the data. Also reads what Cook makes.
+    explicit TexFile(Stream& stream);
+
+    // PackCooker converter. Stores the file already parsed: RGBA palettes with the
+    // color key applied and the indices, or direct color as BGRA with the key and
+    // reference alpha baked in, so loading is two copies and no per pixel work.
+    static std::vector<Uint8> Cook(Stream& stream);
+
+    Uint32 Width() const { return m_header.image_data.width; }
+    Uint32 Height() const { return m_header.image_data.height; }
+    bool IsPaletted() const { return mPaletteSize != 0; }
+    size_t PaletteCount() const { return mPaletteSize ? mPalettes.size() / mPaletteSize : 0; }
+
+    // As RGBA8 with the color key applied, padded to 16 colors for 4 bit images and
+    // 256 for 8 bit ones so any index can be looked up
+    const Uint32* Palette(size_t index) const { return mPalettes.data() + index * mPaletteSize; }
+
+    // How direct color pixels are converted, eLayoutGeneric for paletted images
+    ePixelLayout Layout() const { return mLayout; }
+
+    // As stored, rows of palette indices or direct color
+    const std::vector<Uint8>& Pixels() const { return mPixels; }
+    size_t RowBytes() const { return mRowBytes; }
+
+    // Width * Height RGBA8 pixels through the given palette, ignored for direct color
+    void ToRgba(Uint32* dest, size_t palette = 0) const;
+    std::vector<Uint32> ToRgba(size_t palette = 0) const;
+
+    // Hash of everything the decoded image depends on: its size and format, the
+    // palettes with alpha applied and the pixels. Byte identical files stored under
+    // different names hash the same.
+    Uint64 ContentHash() const { return mContentHash; }
+
     struct BitData
     {
         entry_t color_min;
@@ -96,4 +141,46 @@ public:
         PixelFormat pixel_format;
     };
 
-};
\ No newline at end of file
+private:
+    friend class Texture;
+
+    void LoadPalettes(Stream& stream);
+    void LoadCooked(Stream& stream);
+    void ApplyAlpha(Stream& stream);
+    Uint64 HashContent() const;
+
+    std::vector<Uint32> mPalettes;
+    size_t mPaletteSize = 0;
+    std::vector<Uint8> mPixels;
+    size_t mRowBytes = 0;
+    Uint32 mBitDepth = 0;
+    PixelMasks mMasks = {};
+    ePixelLayout mLayout = eLayoutGeneric;
+    Uint64 mContentHash = 0;
+};
+
+// Follows the CookedHeader of an eCookedTexture asset, then come the palettes and the
+// pixels in rows of rowBytes
+struct CookedTex
+{
+    Uint32 width;
+    Uint32 height;
+    Uint32 bitDepth;
+    Uint32 paletteSize;
+    Uint32 paletteCount;
+    Uint32 rowBytes;
+    Uint32 hashLow;
+    Uint32 hashHigh;
+};
+BINARY_LAYOUT(CookedTex, 32, sizeof(Uint32));
+
+BINARY_LAYOUT(TexFile::Header, 0xEC, sizeof(TexFile::entry_t));
+BINARY_FIELD(TexFile::Header, palette_type, 0x2C);
+BINARY_FIELD(TexFile::Header, image_data, 0x38);
+BINARY_FIELD(TexFile::Header, unknown_0x48, 0x48);
+BINARY_FIELD(TexFile::Header, palette_data, 0x4C);
+BINARY_FIELD(TexFile::Header, pixel_format, 0x64);
+BINARY_FIELD(TexFile::Header, color_key_array_flag, 0xBC);
+BINARY_FIELD(TexFile::Header, reference_alpha, 0xC4);
+BINARY_FIELD(TexFile::Header, unknown_0xCC, 0xCC);
+BINARY_FIELD(TexFile::Header, unknown_09, 0xE8);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <SDL_types.h>
+
+class ResourceCache;
+class TexFile;
+class TextureDedup;
+
+enum eTextureStorage
+{
+    eTextureRgba,       // Expanded through the first palette at load
+    eTextureIndexed     // Paletted images keep their indices and every palette
+};
+
+// A texture as handed out by the ResourceCache. Indexed textures keep a byte (or half
+// a byte) a pixel plus the small table of palettes, so the renderer uploads the
+// indices once and picks a palette per draw: switching palettes only changes which
+// row of the table the lookup uses and never touches the pixels. Direct color images
+// are always stored as RGBA. Immutable once loaded.
+class Texture
+{
+public:
+    // Takes the TEX file's pixels and palettes
+    Texture(TexFile&& tex, eTextureStorage storage);
+
+    Uint32 Width() const { return mWidth; }
+    Uint32 Height() const { return mHeight; }
+    bool IsIndexed() const { return mIndexBits != 0; }
+
+    // 4 or 8, 0 when stored as RGBA
+    Uint32 IndexBits() const { return mIndexBits; }
+
+    // Rows of RowBytes, 4 bit rows low nibble first
+    const std::vector<Uint8>& Indices() const { return mIndices; }
+    size_t RowBytes() const { return mRowBytes; }
+
+    // Each palette is PaletteSize RGBA8 colors with the color key already applied
+    size_t PaletteCount() const { return mPaletteSize ? mPalettes.size() / mPaletteSize : 0; }
+    size_t PaletteSize() const { return mPaletteSize; }
+    const Uint32* Palette(size_t index) const { return mPalettes.data() + index * mPaletteSize; }
+
+    // Empty for indexed textures
+    const std::vector<Uint32>& Rgba() const { return mRgba; }
+
+    // Reference expansion for tools and tests, an indexed texture is looked up
+    // through the given palette
+    void ToRgba(Uint32* dest, size_t palette = 0) const;
+    std::vector<Uint32> ToRgba(size_t palette = 0) const;
+
+    size_t ResidentBytes() const;
+
+    // Same size, storage, pixels and palettes
+    bool SameContent(const Texture& other) const;
+
+    // Makes the cache's eTexture loader read TEX files in to Textures. With dedup,
+    // files with the same content share one Texture, which the cache charges to its
+    // budget once however many entries hold it; dedup must outlive the cache.
+    static void SetLoader(ResourceCache& cache, eTextureStorage storage, TextureDedup* dedup = nullptr);
+private:
+    Uint32 mWidth = 0;
+    Uint32 mHeight = 0;
+    Uint32 mIndexBits = 0;
+    size_t mRowBytes = 0;
+    std::vector<Uint8> mIndices;
+    std::vector<Uint32> mPalettes;
+    size_t mPaletteSize = 0;
+    std::vector<Uint32> mRgba;
+};
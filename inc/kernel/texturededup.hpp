@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <SDL_types.h>
+#include "kernel/texture.hpp"
+
+class TexFile;
+
+// Shares one Texture between every name a byte identical TEX file is stored under,
+// models in battle.lgp and the field archives repeat a lot of them. Textures are
+// looked up by TexFile::ContentHash and only shared once their pixels and palettes
+// compare equal, so a hash collision costs a conversion, never a wrong texture.
+// Every load is still converted before it is compared. The table only holds weak
+// references, so a shared texture lives as long as any cache entry holding it and
+// the shared_ptr's count is the refcount. Counts loads and bytes saved for the
+// whole run and for the current scene. Safe to use from any thread.
+class TextureDedup
+{
+public:
+    struct Stats
+    {
+        size_t loads;
+        size_t duplicates;
+        size_t bytesSaved;
+    };
+
+    // The live texture with the same content if there is one, otherwise a new one
+    // made from tex. duplicate says which it was.
+    std::shared_ptr<const Texture> Load(TexFile&& tex, eTextureStorage storage, bool& duplicate);
+
+    // Logs the scene that is ending and starts counting for the next one
+    void BeginScene(const std::string& name);
+
+    Stats SceneStats() const;
+    Stats TotalStats() const;
+
+    // Distinct textures still alive
+    size_t SharedCount() const;
+
+    void LogStats() const;
+private:
+    void PruneExpired();
+
+    mutable std::mutex mMutex;
+    std::unordered_map<Uint64, std::weak_ptr<const Texture>> mShared;
+    size_t mPruneAt = 64;
+    std::string mScene;
+    Stats mSceneStats = {};
+    Stats mTotalStats = {};
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool. Every worker has its own queue, jobs posted from a worker go on
+// the back of its queue and it takes its newest job first, while idle workers steal
+// the oldest jobs from the others. Jobs posted from other threads are dealt out.
+class ThreadPool
+{
+public:
+    // A count of 0 uses one thread per core
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator = (const ThreadPool&) = delete;
+
+    // Anything job throws is logged and dropped, ParallelFor passes its own on
+    void Post(std::function<void()> job);
+
+    // Blocks until every posted job has finished, must not be called from a worker
+    void Wait();
+
+    // Runs func(0) to func(count - 1) across the pool, in contiguous chunks of about
+    // a quarter of an even share each, and returns when they are all done. The calling
+    // thread helps out, so this is safe to use from a worker. If any call throws the
+    // first exception is rethrown here.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+    size_t ThreadCount() const { return mThreads.size(); }
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    void Worker(size_t index);
+    bool TakeJob(size_t index, std::function<void()>& job);
+    void RunJob(std::function<void()>& job);
+    int CurrentWorker() const;
+
+    std::vector<std::thread> mThreads;
+    std::vector<std::unique_ptr<WorkerQueue>> mQueues;
+    std::atomic<size_t> mNextQueue;
+
+    std::mutex mMutex;
+    std::condition_variable mJobAdded;
+    std::condition_variable mIdle;
+    size_t mQueued = 0;
+    size_t mPending = 0;
+    bool mQuit = false;
+};
@@ -0,0 +1,76 @@
+#include <cstdio>
+#include "bench/bench.hpp"
+#include "kernel/asyncio.hpp"
+#include "kernel/stream.hpp"
+
+int AsyncIoBench(const std::vector<std::string>& args)
+{
+    std::string fileName;
+    bool tempFile = false;
+    if (args.empty())
+    {
+        fileName = "asyncio_bench.tmp";
+        WriteTestFile(fileName, 128 * 1024 * 1024);
+        tempFile = true;
+    }
+    else
+    {
+        fileName = args[0];
+    }
+
+    Uint32 syncSum = 0;
+    {
+        BenchTimer timer;
+        Stream stream(fileName, Stream::eBuffered);
+        while (stream.Size() - stream.Pos() >= 256 * 1024)
+        {
+            syncSum += stream.ReadView(256 * 1024)[0];
+        }
+        ReportThroughput("Sequential buffered Stream", stream.Size(), timer.Seconds());
+    }
+
+    AsyncIo io;
+    Uint32 asyncSum = 0;
+    {
+        BenchTimer timer;
+        ReadAheadFile file(io, fileName);
+        const Uint8* data = nullptr;
+        size_t size = 0;
+        while (file.Next(data, size) && size == 256 * 1024)
+        {
+            asyncSum += data[0];
+        }
+        ReportThroughput(std::string("ReadAheadFile ") + io.BackendName(), file.Size(), timer.Seconds());
+    }
+
+    {
+        // Scattered 64KB reads all queued at once
+        const size_t fileSize = io.FileSize(fileName);
+        const size_t blockSize = 64 * 1024;
+        const size_t blocks = fileSize / blockSize;
+        std::vector<std::future<std::vector<Uint8>>> reads;
+        BenchTimer timer;
+        for (size_t i = 0; i < blocks; i++)
+        {
+            const size_t block = (i * 7919) % blocks;
+            reads.emplace_back(io.Read(fileName, block * blockSize, blockSize));
+        }
+        size_t total = 0;
+        for (auto& read : reads)
+        {
+            total += read.get().size();
+        }
+        ReportThroughput(std::string("Scattered 64KB reads ") + io.BackendName(), total, timer.Seconds());
+    }
+
+    if (syncSum != asyncSum)
+    {
+        printf("Buffered and read ahead reads disagree!\n");
+    }
+
+    if (tempFile)
+    {
+        remove(fileName.c_str());
+    }
+    return syncSum == asyncSum ? 0 : 1;
+}
@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include "bench/bench.hpp"
+#include "kernel/gamedatabase.hpp"
+#include "kernel/kernelbin.hpp"
+#include "kernel/stream.hpp"
+#include "kernel/threadpool.hpp"
+#include "logger.hpp"
+
+// What the tables would be as one object per record
+struct InventoryObject
+{
+    std::string name;
+    eInventoryKind kind;
+    Uint16 equipMask;
+    Uint16 restrictions;
+    Uint8 power;
+};
+
+struct Slot
+{
+    Uint16 id;
+    Uint8 quantity;
+};
+
+static void ReportScan(const std::string& name, size_t slots, double seconds, Uint32 result)
+{
+    std::cout << std::left << std::setw(40) << name
+        << std::right << std::fixed << std::setprecision(2)
+        << std::setw(10) << seconds * 1e9 / slots << " ns/slot "
+        << std::setw(10) << slots / seconds / 1e6 << " M slots/s"
+        << "    (" << result << ")" << std::endl;
+}
+
+static std::vector<std::unique_ptr<InventoryObject>> MakeObjects(const KernelBin& kernel)
+{
+    std::vector<std::unique_ptr<InventoryObject>> objects(GameDatabase::kInventoryIdCount);
+    Uint16 id = 0;
+    const KernelText itemNames = kernel.Text(KernelBin::eItemNames);
+    for (size_t i = 0; i < kernel.Items().Count() && id < 128; i++)
+    {
+        const KernelItem& item = kernel.Items()[i];
+        objects[id++].reset(new InventoryObject{ itemNames.Decoded(i), eInventoryItem, 0, item.restrictions, item.attackPower });
+    }
+    id = 128;
+    const KernelText weaponNames = kernel.Text(KernelBin::eWeaponNames);
+    for (size_t i = 0; i < kernel.Weapons().Count() && id < 256; i++)
+    {
+        const KernelWeapon& weapon = kernel.Weapons()[i];
+        objects[id++].reset(new InventoryObject{ weaponNames.Decoded(i), eInventoryWeapon, weapon.equipMask, weapon.restrictions, weapon.attackPower });
+    }
+    id = 256;
+    const KernelText armorNames = kernel.Text(KernelBin::eArmorNames);
+    for (size_t i = 0; i < kernel.Armor().Count() && id < 288; i++)
+    {
+        const KernelArmor& armor = kernel.Armor()[i];
+        objects[id++].reset(new InventoryObject{ armorNames.Decoded(i), eInventoryArmor, armor.equipMask, armor.restrictions, armor.defense });
+    }
+    id = 288;
+    const KernelText accessoryNames = kernel.Text(KernelBin::eAccessoryNames);
+    for (size_t i = 0; i < kernel.Accessories().Count() && id < 320; i++)
+    {
+        const KernelAccessory& accessory = kernel.Accessories()[i];
+        objects[id++].reset(new InventoryObject{ accessoryNames.Decoded(i), eInventoryAccessory, accessory.equipMask, accessory.restrictions, 0 });
+    }
+    return objects;
+}
+
+// What the equip menu does for one character: the best weapon and armor in the
+// inventory they can use, plus how many of everything can be sold
+struct ScanResult
+{
+    Uint8 bestWeapon;
+    Uint8 bestArmor;
+    Uint32 sellable;
+
+    Uint32 Sum() const { return bestWeapon + bestArmor + sellable; }
+};
+
+static const Uint16 kCantSell = 0x1;
+
+static ScanResult ScanObjects(const std::vector<std::unique_ptr<InventoryObject>>& objects, const std::vector<Slot>& inventory, size_t c)
+{
+    ScanResult result = {};
+    for (const Slot& slot : inventory)
+    {
+        const InventoryObject* object = objects[slot.id].get();
+        if (!object)
+        {
+            continue;
+        }
+        const bool equips = (object->equipMask >> c) & 1;
+        if (object->kind == eInventoryWeapon && equips)
+        {
+            result.bestWeapon = std::max(result.bestWeapon, object->power);
+        }
+        else if (object->kind == eInventoryArmor && equips)
+        {
+            result.bestArmor = std::max(result.bestArmor, object->power);
+        }
+        result.sellable += (object->restrictions & kCantSell) ? 0 : slot.quantity;
+    }
+    return result;
+}
+
+static ScanResult ScanRecords(const KernelBin& kernel, const GameDatabase& db, const std::vector<Slot>& inventory, size_t c)
+{
+    const auto items = kernel.Items();
+    const auto weapons = kernel.Weapons();
+    const auto armor = kernel.Armor();
+    const auto accessories = kernel.Accessories();
+    ScanResult result = {};
+    for (const Slot& slot : inventory)
+    {
+        const InventoryRef ref = db.Find(slot.id);
+        Uint16 restrictions = 0;
+        switch (ref.kind)
+        {
+        case eInventoryItem:
+            restrictions = items[ref.row].restrictions;
+            break;
+        case eInventoryWeapon:
+            restrictions = weapons[ref.row].restrictions;
+            if ((weapons[ref.row].equipMask >> c) & 1)
+            {
+                result.bestWeapon = std::max(result.bestWeapon, weapons[ref.row].attackPower);
+            }
+            break;
+        case eInventoryArmor:
+            restrictions = armor[ref.row].restrictions;
+            if ((armor[ref.row].equipMask >> c) & 1)
+            {
+                result.bestArmor = std::max(result.bestArmor, armor[ref.row].defense);
+            }
+            break;
+        case eInventoryAccessory:
+            restrictions = accessories[ref.row].restrictions;
+            break;
+        default:
+            continue;
+        }
+        result.sellable += (restrictions & kCantSell) ? 0 : slot.quantity;
+    }
+    return result;
+}
+
+static ScanResult ScanColumns(const InventoryColumns& columns, const std::vector<Slot>& inventory, size_t c)
+{
+    const Uint8* kind = columns.kind;
+    const Uint16* equipMask = columns.equipMask;
+    const Uint8* power = columns.power;
+    const Uint16* restrictions = columns.restrictions;
+
+    // Branch free, the kinds come in no particular order
+    Uint32 bestWeapon = 0;
+    Uint32 bestArmor = 0;
+    Uint32 sellable = 0;
+    for (const Slot& slot : inventory)
+    {
+        const Uint16 id = slot.id;
+        const Uint32 usable = ((equipMask[id] >> c) & 1) * power[id];
+        bestWeapon = std::max(bestWeapon, kind[id] == eInventoryWeapon ? usable : 0u);
+        bestArmor = std::max(bestArmor, kind[id] == eInventoryArmor ? usable : 0u);
+        sellable += (kind[id] != eInventoryNone && !(restrictions[id] & kCantSell)) * slot.quantity;
+    }
+    return ScanResult{ static_cast<Uint8>(bestWeapon), static_cast<Uint8>(bestArmor), sellable };
+}
+
+// Runs scan for every character, either over and over with everything in cache or
+// with the cache flushed before each pass as when a menu is opened mid game
+template<typename Scan>
+static void Measure(const std::string& name, size_t slots, size_t passes, bool cold, Scan scan)
+{
+    const size_t kCharacters = 9;
+    static std::vector<Uint8> flush(32 * 1024 * 1024);
+
+    double seconds = 0.0;
+    Uint32 result = 0;
+    for (size_t pass = 0; pass < passes; pass++)
+    {
+        if (cold)
+        {
+            for (size_t i = 0; i < flush.size(); i += 64)
+            {
+                flush[i]++;
+            }
+        }
+
+        BenchTimer timer;
+        for (size_t c = 0; c < kCharacters; c++)
+        {
+            result += scan(c).Sum();
+        }
+        seconds += timer.Seconds();
+    }
+    ReportScan(name + (cold ? " (cold)" : ""), passes * kCharacters * slots, seconds, result);
+}
+
+int DatabaseBench(const std::vector<std::string>& args)
+{
+    std::string fileName = args.empty() ? "" : args[0];
+    if (fileName.empty())
+    {
+        fileName = "kernelbin_bench.tmp";
+        WriteTestKernel(fileName);
+    }
+    std::unique_ptr<Stream> kernel2;
+    if (args.size() > 1)
+    {
+        kernel2 = std::make_unique<Stream>(args[1]);
+    }
+
+    ThreadPool pool;
+    Stream kernelFile(fileName);
+    const KernelBin kernel(kernelFile, kernel2.get(), pool);
+
+    double seconds = 0.0;
+    const size_t kBuilds = 100;
+    std::unique_ptr<GameDatabase> db;
+    {
+        BenchTimer timer;
+        for (size_t i = 0; i < kBuilds; i++)
+        {
+            db = std::make_unique<GameDatabase>(kernel);
+        }
+        seconds = timer.Seconds();
+    }
+    LOG("Build " << seconds * 1000.0 / kBuilds << " ms, arena " << db->ArenaSize() << " bytes, "
+        << db->DistinctNames() << " distinct names");
+
+    // A full inventory, every id in a shuffled order
+    std::vector<Slot> inventory(GameDatabase::kInventoryIdCount);
+    Uint32 seed = 0x1d;
+    for (Uint16 i = 0; i < inventory.size(); i++)
+    {
+        inventory[i] = Slot{ i, static_cast<Uint8>(1 + i % 99) };
+    }
+    for (size_t i = inventory.size() - 1; i > 0; i--)
+    {
+        seed = seed * 1103515245 + 12345;
+        std::swap(inventory[i], inventory[(seed >> 16) % (i + 1)]);
+    }
+
+    const auto objects = MakeObjects(kernel);
+    const InventoryColumns& columns = db->Inventory();
+    for (bool cold : { false, true })
+    {
+        const size_t passes = cold ? 200 : 20000;
+        Measure("Heap objects", inventory.size(), passes, cold, [&](size_t c) { return ScanObjects(objects, inventory, c); });
+        Measure("Records in place", inventory.size(), passes, cold, [&](size_t c) { return ScanRecords(kernel, *db, inventory, c); });
+        Measure("Database columns", inventory.size(), passes, cold, [&](size_t c) { return ScanColumns(columns, inventory, c); });
+    }
+
+    // A battle formula style pass over one whole column
+    {
+        const AttackColumns& attacks = db->Attacks();
+        const size_t kPasses = 200000;
+        BenchTimer timer;
+        Uint32 result = 0;
+        for (size_t pass = 0; pass < kPasses; pass++)
+        {
+            for (size_t i = 0; i < attacks.count; i++)
+            {
+                result += (attacks.elements[i] & (1 << pass % 16)) ? 0 : attacks.attackPower[i];
+            }
+        }
+        ReportScan("Attack column scan", kPasses * attacks.count, timer.Seconds(), result);
+    }
+
+    for (Uint16 id : { 0, 128, 256, 288 })
+    {
+        LOG("Id " << id << ": " << db->Name(db->Inventory().names[id]));
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include <cstring>
+#include <fstream>
+#include <zlib.h>
+#include "bench/bench.hpp"
+#include "kernel/kernelbin.hpp"
+#include "kernel/stream.hpp"
+#include "kernel/threadpool.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+// Record counts of the PC release, enough to make the sections about the real size
+static const size_t kRecordSizes[] = { 8, 28, 1, 1, 28, 44, 36, 16, 20 };
+static const size_t kRecordCounts[] = { 32, 128, 5000, 1500, 128, 128, 32, 32, 96 };
+
+static std::vector<Uint8> Gzip(const std::vector<Uint8>& data)
+{
+    z_stream stream = {};
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw Exception("deflateInit2 failed");
+    }
+
+    std::vector<Uint8> out(deflateBound(&stream, static_cast<uLong>(data.size())) + 32);
+    stream.next_in = const_cast<Bytef*>(data.data());
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = out.data();
+    stream.avail_out = static_cast<uInt>(out.size());
+    const int ret = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (ret != Z_STREAM_END)
+    {
+        throw Exception("deflate failed");
+    }
+    return out;
+}
+
+// A text section of count strings, each a handful of FF7 characters then 0xFF
+static std::vector<Uint8> MakeText(size_t count, Uint32& seed)
+{
+    std::vector<Uint8> data(count * sizeof(Uint16));
+    for (size_t i = 0; i < count; i++)
+    {
+        const Uint16 offset = static_cast<Uint16>(data.size());
+        memcpy(data.data() + i * sizeof(Uint16), &offset, sizeof(offset));
+        seed = seed * 1103515245 + 12345;
+        const size_t length = 4 + (seed >> 16) % 40;
+        for (size_t j = 0; j < length; j++)
+        {
+            data.push_back(static_cast<Uint8>(0x21 + (i + j * 7) % 0x3A));
+        }
+        data.push_back(0xFF);
+    }
+    return data;
+}
+
+void WriteTestKernel(const std::string& fileName)
+{
+    std::ofstream file(fileName, std::ios::binary);
+    Uint32 seed = 0x4b45;
+    for (Uint16 section = 0; section < KernelBin::eSectionCount; section++)
+    {
+        std::vector<Uint8> data;
+        if (section < KernelBin::eCommandHelp)
+        {
+            data.resize(kRecordSizes[section] * kRecordCounts[section]);
+            for (size_t i = 0; i < data.size(); i++)
+            {
+                seed = seed * 1103515245 + 12345;
+                data[i] = (seed >> 29) == 0 ? static_cast<Uint8>(seed >> 16) : static_cast<Uint8>(i % kRecordSizes[section]);
+            }
+        }
+        else
+        {
+            data = MakeText(section == KernelBin::eBattleText ? 512 : 128, seed);
+        }
+
+        const std::vector<Uint8> compressed = Gzip(data);
+        const Uint16 header[3] = { static_cast<Uint16>(compressed.size()), static_cast<Uint16>(data.size()), section };
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+    }
+}
+
+int KernelBinBench(const std::vector<std::string>& args)
+{
+    std::string fileName = args.empty() ? "" : args[0];
+    if (fileName.empty())
+    {
+        fileName = "kernelbin_bench.tmp";
+        WriteTestKernel(fileName);
+    }
+    std::unique_ptr<Stream> kernel2;
+    if (args.size() > 1)
+    {
+        kernel2 = std::make_unique<Stream>(args[1]);
+    }
+
+    Stream kernel(fileName);
+    ThreadPool serial(1);
+    ThreadPool pool;
+    const size_t kRuns = 20;
+    size_t bytes = 0;
+    for (ThreadPool* p : { &serial, &pool })
+    {
+        BenchTimer timer;
+        for (size_t i = 0; i < kRuns; i++)
+        {
+            KernelBin bin(kernel, kernel2.get(), *p);
+            bytes = bin.ArenaSize();
+        }
+        ReportThroughput("Decode (" + std::to_string(p->ThreadCount()) + " threads)", bytes * kRuns, timer.Seconds());
+        LOG("    " << timer.Seconds() * 1000.0 / kRuns << " ms per load");
+    }
+
+    KernelBin bin(kernel, kernel2.get(), pool);
+    LOG("Arena " << bin.ArenaSize() << " bytes, " << bin.Attacks().Count() << " attacks, "
+        << bin.Weapons().Count() << " weapons, " << bin.Materia().Count() << " materia, "
+        << bin.Text(KernelBin::eItemNames).Count() << " item names");
+    return bin.Attacks().Count() > 0 ? 0 : 1;
+}
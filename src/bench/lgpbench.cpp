@@ -0,0 +1,121 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "bench/bench.hpp"
+#include "kernel/lgp.hpp"
+#include "kernel/lgpcache.hpp"
+#include "logger.hpp"
+
+// Writes an archive of count small entries so the benchmark can run without game data
+void WriteTestLgp(const std::string& fileName, size_t count)
+{
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; i++)
+    {
+        names.push_back("e" + std::to_string(i) + ".tex");
+    }
+
+    const size_t tocSize = 16 + count * 27 + Lgp::kLookupTableSize * 4 + 2;
+    std::ofstream out(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write("\0\0SQUARESOFT", 12);
+    const Uint32 count32 = static_cast<Uint32>(count);
+    out.write(reinterpret_cast<const char*>(&count32), 4);
+
+    // Leave the lookup table empty, the reader falls back to hashing every entry
+    Uint32 offset = static_cast<Uint32>(tocSize);
+    for (const std::string& name : names)
+    {
+        char toc[27] = {};
+        name.copy(toc, 20);
+        memcpy(toc + 20, &offset, 4);
+        out.write(toc, sizeof(toc));
+        offset += 24 + 4;
+    }
+
+    const std::vector<char> lookup(Lgp::kLookupTableSize * 4 + 2, 0);
+    out.write(lookup.data(), lookup.size());
+
+    for (size_t i = 0; i < count; i++)
+    {
+        char header[24] = {};
+        names[i].copy(header, 20);
+        const Uint32 size = 4;
+        memcpy(header + 20, &size, 4);
+        out.write(header, sizeof(header));
+        const Uint32 data = static_cast<Uint32>(i);
+        out.write(reinterpret_cast<const char*>(&data), 4);
+    }
+    out.write("FINAL FANTASY7", 14);
+}
+
+int LgpBench(const std::vector<std::string>& args)
+{
+    std::vector<std::string> archives = args;
+    if (archives.empty())
+    {
+        WriteTestLgp("lgp_bench.tmp", 10000);
+        archives.push_back("lgp_bench.tmp");
+    }
+
+    const std::string cacheFile = "lgp_bench_index.tmp";
+    remove(cacheFile.c_str());
+
+    const char* labels[] = { "cold", "warm" };
+    for (const char* label : labels)
+    {
+        BenchTimer timer;
+        LgpIndexCache cache(cacheFile);
+        size_t entries = 0;
+        for (const std::string& archive : archives)
+        {
+            entries += cache.Open(archive)->EntryCount();
+        }
+        const double seconds = timer.Seconds();
+        cache.Save();
+        LOG("Open " << archives.size() << " archives " << label << ": " << seconds * 1000.0 << " ms for " << entries << " entries");
+    }
+
+    {
+        Lgp lgp(archives[0]);
+        std::vector<std::string> names;
+        for (size_t i = 0; i < lgp.EntryCount(); i++)
+        {
+            names.push_back(lgp.EntryName(i));
+        }
+
+        BenchTimer timer;
+        size_t found = 0;
+        for (int pass = 0; pass < 10; pass++)
+        {
+            for (const std::string& name : names)
+            {
+                found += lgp.Find(name) != Lgp::kNotFound;
+            }
+        }
+        const double seconds = timer.Seconds();
+        LOG("Find: " << (seconds * 1e9) / static_cast<double>(found) << " ns per lookup over " << names.size() << " entries");
+
+        // What code holding ids instead of paths pays
+        std::vector<AssetId> ids;
+        for (const std::string& name : names)
+        {
+            ids.push_back(AssetId(AssetId::Hash(name.data(), name.size())));
+        }
+
+        BenchTimer idTimer;
+        found = 0;
+        for (int pass = 0; pass < 10; pass++)
+        {
+            for (const AssetId id : ids)
+            {
+                found += lgp.Find(id) != Lgp::kNotFound;
+            }
+        }
+        const double idSeconds = idTimer.Seconds();
+        LOG("Find by id: " << (idSeconds * 1e9) / static_cast<double>(found) << " ns per lookup over " << ids.size() << " entries");
+    }
+
+    remove(cacheFile.c_str());
+    remove("lgp_bench.tmp");
+    return 0;
+}
@@ -0,0 +1,227 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "bench/bench.hpp"
+#include "kernel/lgp.hpp"
+#include "kernel/lzss.hpp"
+#include "kernel/threadpool.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+// The straightforward byte at a time decoder, to check against and compare with
+static std::vector<Uint8> ReferenceDecompress(const Uint8* data, size_t size)
+{
+    std::vector<Uint8> out;
+    size_t pos = 0;
+    while (pos < size)
+    {
+        const Uint8 control = data[pos++];
+        for (int bit = 0; bit < 8 && pos < size; bit++)
+        {
+            if (control & (1 << bit))
+            {
+                out.push_back(data[pos++]);
+                continue;
+            }
+
+            const size_t offset = data[pos] | ((data[pos + 1] & 0xF0) << 4);
+            const size_t length = (data[pos + 1] & 0x0F) + 3;
+            pos += 2;
+            size_t distance = (out.size() + 0xFEE - offset) & 0xFFF;
+            distance = distance == 0 ? 0x1000 : distance;
+            for (size_t i = 0; i < length; i++)
+            {
+                out.push_back(out.size() >= distance ? out[out.size() - distance] : 0);
+            }
+        }
+    }
+    return out;
+}
+
+// A valid stream about the size of a field file with roughly the literal to match
+// mix real ones have, so the benchmark runs without game data
+static std::vector<Uint8> MakeTestStream(size_t outputSize, Uint32 seed)
+{
+    std::vector<Uint8> compressed;
+    size_t written = 0;
+    while (written < outputSize)
+    {
+        const size_t controlPos = compressed.size();
+        compressed.push_back(0);
+        Uint8 control = 0;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            seed = seed * 1103515245 + 12345;
+            const Uint32 r = seed >> 8;
+            if (written < 16 || (r & 0xFF) < 90)
+            {
+                control |= 1 << bit;
+                compressed.push_back(static_cast<Uint8>(r >> 8));
+                written++;
+                continue;
+            }
+
+            // Mostly short distances like real data, now and then a far one
+            const size_t maxDistance = std::min<size_t>(written, (r & 0x700) ? 256 : 4095);
+            const size_t distance = 1 + (r >> 12) % maxDistance;
+            const size_t length = 3 + (r >> 4) % 16;
+            const size_t offset = (written + 0xFEE - distance) & 0xFFF;
+            compressed.push_back(static_cast<Uint8>(offset));
+            compressed.push_back(static_cast<Uint8>(((offset >> 4) & 0xF0) | (length - 3)));
+            written += length;
+        }
+        compressed[controlPos] = control;
+    }
+    return compressed;
+}
+
+static std::vector<Uint8> ReadFile(const std::string& fileName)
+{
+    std::ifstream in(fileName, std::ios::in | std::ios::binary);
+    return std::vector<Uint8>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// Archives contribute every entry that looks like an LZSS file, anything else is
+// taken to be one
+static void AddInputs(const std::string& fileName, std::vector<std::vector<Uint8>>& inputs)
+{
+    if (fileName.size() > 4 && Lgp::NormalizeName(fileName.substr(fileName.size() - 4)) == ".lgp")
+    {
+        Lgp lgp(fileName);
+        for (size_t i = 0; i < lgp.EntryCount(); i++)
+        {
+            Stream entry = lgp.Open(i);
+            Uint32 compressedSize = 0;
+            if (entry.Size() > 4 && (entry.ReadUInt32(compressedSize), compressedSize == entry.Size() - 4))
+            {
+                const Uint8* data = entry.ReadView(compressedSize);
+                inputs.emplace_back(data, data + compressedSize);
+            }
+        }
+        return;
+    }
+
+    const std::vector<Uint8> file = ReadFile(fileName);
+    if (file.size() > 4)
+    {
+        inputs.emplace_back(file.begin() + 4, file.end());
+    }
+}
+
+int LzssBench(const std::vector<std::string>& args)
+{
+    std::vector<std::vector<Uint8>> inputs;
+    for (const std::string& arg : args)
+    {
+        AddInputs(arg, inputs);
+    }
+
+    if (inputs.empty())
+    {
+        for (Uint32 i = 0; i < 64; i++)
+        {
+            inputs.push_back(MakeTestStream(128 * 1024 + i * 4096, 0x7ea5 + i));
+        }
+    }
+
+    size_t compressedBytes = 0;
+    size_t bytes = 0;
+    std::vector<std::vector<Uint8>> outputs;
+    for (const auto& input : inputs)
+    {
+        compressedBytes += input.size();
+        outputs.emplace_back(Lzss::DecompressedSize(input.data(), input.size()));
+        bytes += outputs.back().size();
+    }
+    LOG(inputs.size() << " inputs, " << compressedBytes << " bytes decompressing to " << bytes);
+
+    const int kPasses = 5;
+    {
+        BenchTimer timer;
+        for (int pass = 0; pass < kPasses; pass++)
+        {
+            for (const auto& input : inputs)
+            {
+                ReferenceDecompress(input.data(), input.size());
+            }
+        }
+        ReportThroughput("LZSS reference", bytes * kPasses, timer.Seconds());
+    }
+
+    {
+        BenchTimer timer;
+        for (int pass = 0; pass < kPasses; pass++)
+        {
+            for (const auto& input : inputs)
+            {
+                Lzss::DecompressedSize(input.data(), input.size());
+            }
+        }
+        ReportThroughput("LZSS size scan", bytes * kPasses, timer.Seconds());
+    }
+
+    {
+        BenchTimer timer;
+        for (int pass = 0; pass < kPasses; pass++)
+        {
+            for (size_t i = 0; i < inputs.size(); i++)
+            {
+                Lzss::Decompress(inputs[i].data(), inputs[i].size(), outputs[i].data(), outputs[i].size());
+            }
+        }
+        ReportThroughput("LZSS in to buffer", bytes * kPasses, timer.Seconds());
+    }
+
+    {
+        BenchTimer timer;
+        for (int pass = 0; pass < kPasses; pass++)
+        {
+            for (const auto& input : inputs)
+            {
+                Lzss::Decompress(input.data(), input.size());
+            }
+        }
+        ReportThroughput("LZSS sized vector", bytes * kPasses, timer.Seconds());
+    }
+
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        if (ReferenceDecompress(inputs[i].data(), inputs[i].size()) != outputs[i])
+        {
+            LOG_ERROR("LZSS output " << i << " differs from the reference");
+            return 1;
+        }
+    }
+
+    // Compress the decoded files back up, one input at a time as the cook would
+    ThreadPool pool;
+    std::vector<std::vector<Uint8>> recompressed(outputs.size());
+    ThreadPool* pools[] = { nullptr, &pool };
+    for (ThreadPool* p : pools)
+    {
+        BenchTimer timer;
+        size_t recompressedBytes = 0;
+        for (size_t i = 0; i < outputs.size(); i++)
+        {
+            recompressed[i] = Lzss::Compress(outputs[i].data(), outputs[i].size(), p);
+            recompressedBytes += recompressed[i].size();
+        }
+        ReportThroughput(p ? "LZSS compress (" + std::to_string(p->ThreadCount()) + " threads)" : std::string("LZSS compress (1 thread)"),
+            bytes, timer.Seconds());
+        LOG("Compressed to " << recompressedBytes << " bytes (" << 100.0 * recompressedBytes / bytes << "%), originals were "
+            << compressedBytes << " (" << 100.0 * compressedBytes / bytes << "%)");
+    }
+
+    // Must come back out the same through both decoders
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        if (Lzss::Decompress(recompressed[i].data(), recompressed[i].size()) != outputs[i]
+            || ReferenceDecompress(recompressed[i].data(), recompressed[i].size()) != outputs[i])
+        {
+            LOG_ERROR("LZSS round trip of input " << i << " failed");
+            return 1;
+        }
+    }
+    LOG("Round trip of " << outputs.size() << " inputs ok");
+    return 0;
+}
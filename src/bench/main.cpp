@@ -0,0 +1,99 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include "bench/bench.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+struct BenchEntry
+{
+    const char* name;
+    const char* usage;
+    BenchFunc func;
+};
+
+static const BenchEntry kBenchmarks[] =
+{
+    { "stream", "[file]", StreamBench },
+    { "asyncio", "[file]", AsyncIoBench },
+    { "lgp", "[archives...]", LgpBench },
+    { "pack", "[archive]", PackBench },
+    { "lzss", "[files or archives...]", LzssBench },
+    { "kernelbin", "[KERNEL.BIN] [kernel2.bin]", KernelBinBench },
+    { "database", "[KERNEL.BIN] [kernel2.bin]", DatabaseBench },
+    { "tex", "[files or archives...]", TexBench },
+};
+
+void ReportThroughput(const std::string& name, size_t bytes, double seconds)
+{
+    const double mb = static_cast<double>(bytes) / (1024.0 * 1024.0);
+    std::cout << std::left << std::setw(40) << name
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << mb << " MB "
+              << std::setw(8) << seconds * 1000.0 << " ms "
+              << std::setw(10) << (seconds > 0.0 ? mb / seconds : 0.0) << " MB/s" << std::endl;
+}
+
+void WriteTestFile(const std::string& fileName, size_t size)
+{
+    std::ofstream out(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    std::vector<Uint8> block(64 * 1024);
+    Uint32 seed = 0x7ea5;
+    while (size > 0)
+    {
+        for (Uint8& b : block)
+        {
+            seed = seed * 1103515245 + 12345;
+            b = static_cast<Uint8>(seed >> 16);
+        }
+        const size_t toWrite = std::min(size, block.size());
+        out.write(reinterpret_cast<const char*>(block.data()), toWrite);
+        size -= toWrite;
+    }
+    if (!out)
+    {
+        throw Exception("Failed to write test file");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string which = argc > 1 ? argv[1] : "";
+    std::vector<std::string> args;
+    for (int i = 2; i < argc; i++)
+    {
+        args.emplace_back(argv[i]);
+    }
+
+    int ret = 0;
+    bool found = false;
+    try
+    {
+        for (const BenchEntry& bench : kBenchmarks)
+        {
+            if (which.empty() || which == bench.name)
+            {
+                found = true;
+                LOG("[" << bench.name << "]");
+                ret |= bench.func(args);
+            }
+        }
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR(ex.what());
+        return 1;
+    }
+
+    if (!found)
+    {
+        LOG("usage: " << argv[0] << " [benchmark] [args]");
+        for (const BenchEntry& bench : kBenchmarks)
+        {
+            LOG("    " << bench.name << " " << bench.usage);
+        }
+        return 1;
+    }
+    return ret;
+}
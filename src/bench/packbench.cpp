@@ -0,0 +1,161 @@
+#include <cstdio>
+#include <cstring>
+#include "bench/bench.hpp"
+#include "kernel/cookedpack.hpp"
+#include "kernel/lgp.hpp"
+#include "kernel/lgpwriter.hpp"
+#include "kernel/lzss.hpp"
+#include "kernel/texfile.hpp"
+#include "kernel/texture.hpp"
+#include "kernel/threadpool.hpp"
+#include "logger.hpp"
+
+// Field sized LZSS files with runs and noise mixed in, plus a spread of TEX files
+static void WriteNativeLgp(const std::string& fileName, ThreadPool& pool)
+{
+    LgpWriter writer;
+    Uint32 seed = 0x7ea5;
+    for (size_t i = 0; i < 16; i++)
+    {
+        std::vector<Uint8> data(512 * 1024);
+        for (size_t j = 0; j < data.size(); j++)
+        {
+            seed = seed * 1103515245 + 12345;
+            data[j] = (seed >> 28) == 0 ? static_cast<Uint8>(seed >> 16) : static_cast<Uint8>(j / 64);
+        }
+        writer.Add("field" + std::to_string(i) + ".lzs", Stream(Lzss::CompressFile(data.data(), data.size(), &pool)));
+    }
+
+    const Uint32 bits[] = { 4, 8, 8, 8, 16, 24, 32 };
+    for (Uint32 i = 0; i < 64; i++)
+    {
+        writer.Add("model" + std::to_string(i) + ".tex", Stream(MakeTestTex(256, 256, bits[i % 7], 4, 0x7e + i)));
+    }
+    writer.Write(fileName, pool);
+}
+
+static bool EndsWith(const std::string& name, const std::string& suffix)
+{
+    return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// What the game does with the file once it has its bytes, native or cooked. Returns
+// the decoded size, TEX files counting as RGBA either way. When output is given it gets something to check
+// against: a TEX file's RGBA pixels or the file's decoded bytes.
+static size_t Decode(const std::string& name, Stream& stream, std::vector<Uint8>* output)
+{
+    if (EndsWith(name, ".tex"))
+    {
+        // As the resource cache's loader makes them
+        const Texture texture(TexFile(stream), eTextureIndexed);
+        if (output)
+        {
+            const std::vector<Uint32> rgba = texture.ToRgba(size_t(0));
+            const Uint8* bytes = reinterpret_cast<const Uint8*>(rgba.data());
+            output->assign(bytes, bytes + rgba.size() * sizeof(Uint32));
+        }
+        return static_cast<size_t>(texture.Width()) * texture.Height() * sizeof(Uint32);
+    }
+
+    std::vector<Uint8> data;
+    if (EndsWith(name, ".lzs") || EndsWith(name, "kernel2.bin"))
+    {
+        data = Lzss::Decompress(stream);
+    }
+    else
+    {
+        data.resize(stream.Size());
+        stream.ReadBytes(data.data(), data.size());
+    }
+    const size_t size = data.size();
+    if (output)
+    {
+        *output = std::move(data);
+    }
+    return size;
+}
+
+int PackBench(const std::vector<std::string>& args)
+{
+    ThreadPool pool;
+    std::string archive = args.empty() ? "" : args[0];
+    if (archive.empty())
+    {
+        archive = "pack_bench_lgp.tmp";
+        WriteNativeLgp(archive, pool);
+    }
+
+    const std::string packFile = "pack_bench.tmp";
+    Lgp lgp(archive);
+    {
+        BenchTimer timer;
+        PackCooker cooker;
+        cooker.AddConverter(".tex", TexFile::Cook);
+        cooker.AddConverter(".lzs", Lzss::Cook);
+        cooker.AddConverter("kernel2.bin", Lzss::Cook);
+        for (size_t i = 0; i < lgp.EntryCount(); i++)
+        {
+            cooker.Add(lgp.EntryName(i), lgp.Open(i));
+        }
+        const size_t packSize = cooker.Write(packFile, pool);
+        ReportThroughput("Cook", lgp.Size(), timer.Seconds());
+        LOG("Pack is " << packSize << " bytes, archive is " << lgp.Size());
+    }
+
+    // Native: the LGP's bytes are free to get at, the decoding is what costs. The pack
+    // trades that for inflating its blocks, on pool when one is given.
+    CookedPack pack(packFile);
+    for (const char* kind : { ".lzs", ".tex", "" })
+    {
+        const std::string suffix = kind;
+        const std::string label = suffix.empty() ? "everything" : suffix;
+        size_t bytes = 0;
+        {
+            BenchTimer timer;
+            for (size_t i = 0; i < lgp.EntryCount(); i++)
+            {
+                if (EndsWith(lgp.EntryName(i), suffix))
+                {
+                    Stream entry = lgp.Open(i);
+                    bytes += Decode(lgp.EntryName(i), entry, nullptr);
+                }
+            }
+            ReportThroughput("Native LGP, " + label, bytes, timer.Seconds());
+        }
+
+        ThreadPool* pools[] = { nullptr, &pool };
+        for (ThreadPool* p : pools)
+        {
+            bytes = 0;
+            BenchTimer timer;
+            for (size_t i = 0; i < pack.AssetCount(); i++)
+            {
+                if (EndsWith(pack.AssetPath(i), suffix))
+                {
+                    Stream asset(pack.Load(i, p));
+                    bytes += Decode(pack.AssetPath(i), asset, nullptr);
+                }
+            }
+            const std::string threads = p ? std::to_string(p->ThreadCount()) + " threads" : std::string("caller");
+            ReportThroughput("Cooked pack (" + threads + "), " + label, bytes, timer.Seconds());
+        }
+    }
+
+    // Everything has to decode to the same thing either way
+    for (size_t i = 0; i < lgp.EntryCount(); i++)
+    {
+        const std::string name = lgp.EntryName(i);
+        Stream entry = lgp.Open(i);
+        Stream asset(pack.Load(pack.Find(name), &pool));
+        std::vector<Uint8> native;
+        std::vector<Uint8> cooked;
+        Decode(name, entry, &native);
+        Decode(name, asset, &cooked);
+        if (native != cooked)
+        {
+            LOG_ERROR("Pack mismatch for " << name);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <cstdio>
+#include "bench/bench.hpp"
+#include "kernel/stream.hpp"
+
+static Uint32 ReadAllUInt32(Stream& stream)
+{
+    // Sum everything so the reads can't be optimised away
+    Uint32 sum = 0;
+    Uint32 value = 0;
+    const size_t count = stream.Size() / sizeof(Uint32);
+    for (size_t i = 0; i < count; i++)
+    {
+        stream.ReadUInt32(value);
+        sum += value;
+    }
+    return sum;
+}
+
+static Uint32 ReadAllReader(Stream& stream)
+{
+    StreamReader& reader = stream.Reader();
+    const size_t count = reader.Remaining() / sizeof(Uint32);
+
+    // One bounds check for the whole loop
+    Uint32 sum = 0;
+    if (reader.Has(count * sizeof(Uint32)))
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            sum += reader.U32();
+        }
+    }
+    return sum;
+}
+
+static Uint32 ReadAllChunks(Stream& stream, size_t chunkSize)
+{
+    Uint32 sum = 0;
+    while (stream.Size() - stream.Pos() >= chunkSize)
+    {
+        const Uint8* p = stream.ReadView(chunkSize);
+        sum += p[0] + p[chunkSize - 1];
+    }
+    return sum;
+}
+
+static void RunModes(const std::string& fileName, const std::string& label, Uint32(*func)(Stream&, size_t), size_t arg)
+{
+    const Stream::eMode modes[] = { Stream::eBuffered, Stream::eMapped };
+    Uint32 results[2] = {};
+    for (size_t i = 0; i < 2; i++)
+    {
+        BenchTimer timer;
+        Stream stream(fileName, modes[i]);
+        results[i] = func(stream, arg);
+        ReportThroughput(label + (modes[i] == Stream::eMapped ? " (mapped)" : " (buffered)"), stream.Size(), timer.Seconds());
+    }
+
+    if (results[0] != results[1])
+    {
+        printf("Mapped and buffered reads disagree!\n");
+    }
+}
+
+int StreamBench(const std::vector<std::string>& args)
+{
+    std::string fileName;
+    bool tempFile = false;
+    if (args.empty())
+    {
+        fileName = "stream_bench.tmp";
+        WriteTestFile(fileName, 128 * 1024 * 1024);
+        tempFile = true;
+    }
+    else
+    {
+        fileName = args[0];
+    }
+
+    RunModes(fileName, "ReadUInt32", [](Stream& s, size_t) { return ReadAllUInt32(s); }, 0);
+    RunModes(fileName, "StreamReader U32", [](Stream& s, size_t) { return ReadAllReader(s); }, 0);
+    RunModes(fileName, "ReadView 64KB", ReadAllChunks, 64 * 1024);
+
+    if (tempFile)
+    {
+        remove(fileName.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include "bench/bench.hpp"
+#include "kernel/lgp.hpp"
+#include "kernel/pixelconvert.hpp"
+#include "kernel/stream.hpp"
+#include "kernel/texfile.hpp"
+#include "kernel/texture.hpp"
+#include "kernel/texturededup.hpp"
+#include "logger.hpp"
+
+static void ReportMegapixels(const std::string& name, size_t pixels, double seconds)
+{
+    std::cout << std::left << std::setw(40) << name
+        << std::right << std::fixed << std::setprecision(2)
+        << std::setw(10) << pixels / 1e6 << " MP "
+        << std::setw(10) << seconds * 1000.0 << " ms "
+        << std::setw(10) << pixels / 1e6 / seconds << " MP/s" << std::endl;
+}
+
+std::vector<Uint8> MakeTestTex(Uint32 width, Uint32 height, Uint32 bits, Uint32 palettes, Uint32 seed)
+{
+    TexFile::Header header = {};
+    header.version = 1;
+    header.color_key_flag = 1;
+    header.image_data.width = width;
+    header.image_data.height = height;
+    header.image_data.bit_depth = bits;
+    header.image_data.pitch = width * (bits > 8 ? bits / 8 : 1);
+    header.pixel_format.bits_per_pixel = bits;
+    header.pixel_format.bytes_per_pixel = bits > 8 ? bits / 8 : 1;
+
+    const Uint32 colors = bits == 4 ? 16 : 256;
+    if (bits <= 8)
+    {
+        header.palette_count = palettes;
+        header.palette_total_color_count = palettes * colors;
+        header.palette_data.flag = 1;
+        header.palette_data.index_bits = bits;
+        header.palette_data.index_8bit = bits == 8;
+        header.palette_data.total_color_count = palettes * colors;
+        header.palette_data.colors_per_palette = colors;
+    }
+    else
+    {
+        // 5551 for 16 bit, BGR for 24 and BGRA for 32
+        if (bits == 16)
+        {
+            header.pixel_format.bit_count = TexFile::RGBAData{ 5, 5, 5, 1 };
+            header.pixel_format.bit_shift = TexFile::RGBAData{ 10, 5, 0, 15 };
+            header.pixel_format.bit_mask = TexFile::RGBAData{ 0x7C00, 0x3E0, 0x1F, 0x8000 };
+        }
+        else
+        {
+            const bool alpha = bits == 32;
+            header.pixel_format.bit_count = TexFile::RGBAData{ 8, 8, 8, alpha ? 8u : 0u };
+            header.pixel_format.bit_shift = TexFile::RGBAData{ 16, 8, 0, alpha ? 24u : 0u };
+            header.pixel_format.bit_mask = TexFile::RGBAData{ 0xFF0000, 0xFF00, 0xFF, alpha ? 0xFF000000u : 0u };
+        }
+    }
+
+    std::vector<Uint8> file(sizeof(header));
+    memcpy(file.data(), &header, sizeof(header));
+    for (Uint32 i = 0; bits <= 8 && i < palettes * colors; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        const Uint8 bgra[4] = { static_cast<Uint8>(seed >> 8), static_cast<Uint8>(seed >> 16), static_cast<Uint8>(seed >> 24), 0xFF };
+        file.insert(file.end(), bgra, bgra + 4);
+    }
+
+    const size_t pixelBytes = (static_cast<size_t>(width) * bits + 7) / 8 * height;
+    for (size_t i = 0; i < pixelBytes; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        file.push_back(static_cast<Uint8>(seed >> 16));
+    }
+    return file;
+}
+
+// Archives contribute every .tex entry, anything else is taken to be one
+static void AddInputs(const std::string& fileName, std::vector<std::unique_ptr<TexFile>>& inputs)
+{
+    auto add = [&](Stream& stream)
+    {
+        try
+        {
+            inputs.push_back(std::make_unique<TexFile>(stream));
+        }
+        catch (const std::exception& ex)
+        {
+            LOG_WARNING("Skipping " << stream.Name() << ": " << ex.what());
+        }
+    };
+
+    if (fileName.size() > 4 && Lgp::NormalizeName(fileName.substr(fileName.size() - 4)) == ".lgp")
+    {
+        Lgp lgp(fileName);
+        for (size_t i = 0; i < lgp.EntryCount(); i++)
+        {
+            const std::string name = lgp.EntryName(i);
+            if (name.size() > 4 && name.substr(name.size() - 4) == ".tex")
+            {
+                Stream entry = lgp.Open(i);
+                add(entry);
+            }
+        }
+        return;
+    }
+
+    Stream file(fileName);
+    add(file);
+}
+
+static PixelMasks Masks(const TexFile& tex)
+{
+    const TexFile::PixelFormat& format = tex.m_header.pixel_format;
+    return PixelMasks
+    {
+        format.bytes_per_pixel,
+        { format.bit_mask.red, format.bit_mask.green, format.bit_mask.blue, format.bit_mask.alpha },
+        { format.bit_shift.red, format.bit_shift.green, format.bit_shift.blue, format.bit_shift.alpha },
+        { format.bit_count.red, format.bit_count.green, format.bit_count.blue, format.bit_count.alpha }
+    };
+}
+
+// Direct color through the run time masks, then each layout's own loops, with the
+// color key and an alpha test on as they are for most FF7 textures
+static int DirectBench(const std::vector<std::unique_ptr<TexFile>>& inputs, int passes)
+{
+    const Uint8 kReferenceAlpha = 0x80;
+    for (int layout = eLayoutGeneric + 1; layout < eLayoutCount; layout++)
+    {
+        std::vector<const TexFile*> textures;
+        size_t pixels = 0;
+        for (const auto& tex : inputs)
+        {
+            if (!tex->IsPaletted() && tex->Layout() == layout)
+            {
+                textures.push_back(tex.get());
+                pixels += static_cast<size_t>(tex->Width()) * tex->Height();
+            }
+        }
+        if (textures.empty())
+        {
+            continue;
+        }
+
+        std::vector<Uint32> reference(pixels);
+        std::vector<Uint32> output(pixels);
+        const std::string name = PixelConvert::LayoutName(static_cast<ePixelLayout>(layout));
+        for (int path = -1; path < eCpuAvx2; path++)
+        {
+            // -1 is the generic loop
+            const bool generic = path < 0;
+            const eCpuPath cpuPath = generic ? eCpuScalar : static_cast<eCpuPath>(path);
+            if (!PixelConvert::Supported(cpuPath))
+            {
+                continue;
+            }
+
+            BenchTimer timer;
+            for (int pass = 0; pass < passes; pass++)
+            {
+                Uint32* dest = output.data();
+                for (const TexFile* tex : textures)
+                {
+                    const size_t count = static_cast<size_t>(tex->Width()) * tex->Height();
+                    PixelConvert::ConvertDirect(tex->Pixels().data(), count, Masks(*tex), generic ? eLayoutGeneric : tex->Layout(),
+                        true, kReferenceAlpha, dest, cpuPath);
+                    dest += count;
+                }
+            }
+            ReportMegapixels(name + (generic ? " (generic masks)" : std::string(" (") + PixelConvert::PathName(cpuPath) + ")"),
+                pixels * passes, timer.Seconds());
+
+            if (generic)
+            {
+                reference = output;
+            }
+            else if (reference != output)
+            {
+                LOG_ERROR(name << " " << PixelConvert::PathName(cpuPath) << " output differs from the generic loop");
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// What a palette switch costs each way: an indexed texture only hands the renderer
+// another row of its palette table, an RGBA one has to be expanded again
+static void PaletteSwitchBench(const std::vector<std::unique_ptr<TexFile>>& inputs)
+{
+    std::vector<Texture> indexed;
+    size_t rgbaBytes = 0;
+    size_t indexedBytes = 0;
+    size_t largest = 0;
+    for (const auto& tex : inputs)
+    {
+        if (!tex->IsPaletted())
+        {
+            continue;
+        }
+        TexFile copy = *tex;
+        indexed.emplace_back(std::move(copy), eTextureIndexed);
+        indexedBytes += indexed.back().ResidentBytes();
+        rgbaBytes += static_cast<size_t>(tex->Width()) * tex->Height() * sizeof(Uint32);
+        largest = std::max(largest, static_cast<size_t>(tex->Width()) * tex->Height());
+    }
+    if (indexed.empty())
+    {
+        return;
+    }
+    LOG("Resident: " << rgbaBytes << " bytes as RGBA, " << indexedBytes << " indexed ("
+        << static_cast<double>(rgbaBytes) / indexedBytes << "x smaller)");
+
+    const size_t kSwitches = 100;
+    std::vector<Uint32> lut(256);
+    std::vector<Uint32> pixels(largest);
+    {
+        BenchTimer timer;
+        for (size_t i = 0; i < kSwitches; i++)
+        {
+            for (const Texture& texture : indexed)
+            {
+                const size_t palette = i % texture.PaletteCount();
+                std::copy(texture.Palette(palette), texture.Palette(palette) + texture.PaletteSize(), lut.data());
+            }
+        }
+        const double seconds = timer.Seconds();
+        LOG("Palette switch, indexed: " << seconds * 1e9 / (kSwitches * indexed.size()) << " ns a texture");
+    }
+    {
+        BenchTimer timer;
+        for (size_t i = 0; i < kSwitches; i++)
+        {
+            for (const Texture& texture : indexed)
+            {
+                texture.ToRgba(pixels.data(), i % texture.PaletteCount());
+            }
+        }
+        const double seconds = timer.Seconds();
+        LOG("Palette switch, re-expanding RGBA: " << seconds * 1e9 / (kSwitches * indexed.size()) << " ns a texture");
+    }
+}
+
+// Two scenes loading every texture under a few names each, as battle models do with
+// their shared textures, through the dedup table and without it
+static void DedupBench(const std::vector<std::unique_ptr<TexFile>>& inputs)
+{
+    const size_t kNames = 3;
+    TextureDedup dedup;
+    std::vector<std::shared_ptr<const Texture>> loaded;
+    size_t unsharedBytes = 0;
+    BenchTimer timer;
+    for (const char* scene : { "battle 1", "battle 2" })
+    {
+        dedup.BeginScene(scene);
+        loaded.clear();
+        for (size_t name = 0; name < kNames; name++)
+        {
+            for (const auto& tex : inputs)
+            {
+                bool duplicate = false;
+                loaded.push_back(dedup.Load(TexFile(*tex), eTextureIndexed, duplicate));
+                unsharedBytes += loaded.back()->ResidentBytes();
+            }
+        }
+    }
+    const double seconds = timer.Seconds();
+    dedup.BeginScene("");
+
+    size_t residentBytes = 0;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        residentBytes += loaded[i]->ResidentBytes();
+    }
+    const TextureDedup::Stats stats = dedup.TotalStats();
+    LOG("Dedup: " << stats.loads << " loads, " << stats.duplicates << " shared, " << stats.bytesSaved << " bytes saved, "
+        << residentBytes << " bytes resident for the last scene instead of " << unsharedBytes / 2 << ", "
+        << seconds * 1e6 / stats.loads << " us a load");
+}
+
+int TexBench(const std::vector<std::string>& args)
+{
+    std::vector<std::unique_ptr<TexFile>> inputs;
+    for (const std::string& arg : args)
+    {
+        AddInputs(arg, inputs);
+    }
+
+    if (inputs.empty())
+    {
+        const Uint32 bits[] = { 4, 8, 8, 8, 16, 24, 32 };
+        for (Uint32 i = 0; i < 48; i++)
+        {
+            Stream stream(MakeTestTex(256, 256, bits[i % 7], 4, 0x7e + i));
+            inputs.push_back(std::make_unique<TexFile>(stream));
+        }
+    }
+
+    size_t pixels = 0;
+    size_t paletted = 0;
+    for (const auto& tex : inputs)
+    {
+        pixels += static_cast<size_t>(tex->Width()) * tex->Height();
+        paletted += tex->IsPaletted() ? 1 : 0;
+    }
+    LOG(inputs.size() << " textures, " << paletted << " paletted, " << pixels << " pixels");
+
+    std::vector<std::vector<Uint32>> reference;
+    for (const auto& tex : inputs)
+    {
+        reference.emplace_back(static_cast<size_t>(tex->Width()) * tex->Height());
+    }
+    std::vector<Uint32> output;
+
+    const int kPasses = 10;
+    for (int path = 0; path < eCpuPathCount; path++)
+    {
+        const eCpuPath cpuPath = static_cast<eCpuPath>(path);
+        if (!PixelConvert::Supported(cpuPath))
+        {
+            LOG(PixelConvert::PathName(cpuPath) << " not supported");
+            continue;
+        }
+
+        // Expand in to one buffer the size of the biggest texture so the output stays hot
+        size_t expanded = 0;
+        BenchTimer timer;
+        for (int pass = 0; pass < kPasses; pass++)
+        {
+            for (size_t i = 0; i < inputs.size(); i++)
+            {
+                const TexFile& tex = *inputs[i];
+                if (!tex.IsPaletted())
+                {
+                    continue;
+                }
+                const size_t count = static_cast<size_t>(tex.Width()) * tex.Height();
+                output.resize(std::max(output.size(), count));
+                if (tex.Pixels().size() == count)
+                {
+                    PixelConvert::Expand8(tex.Pixels().data(), count, tex.Palette(pass % tex.PaletteCount()), output.data(), cpuPath);
+                }
+                else
+                {
+                    PixelConvert::Expand4(tex.Pixels().data(), count, tex.Palette(pass % tex.PaletteCount()), output.data(), cpuPath);
+                }
+                expanded += count;
+            }
+        }
+        ReportMegapixels(std::string("Palette expand (") + PixelConvert::PathName(cpuPath) + ")", expanded, timer.Seconds());
+
+        // Every path has to match the scalar one
+        for (size_t i = 0; i < inputs.size(); i++)
+        {
+            const TexFile& tex = *inputs[i];
+            if (!tex.IsPaletted() || tex.Width() % 2 != 0)
+            {
+                continue;
+            }
+            const size_t count = reference[i].size();
+            output.resize(std::max(output.size(), count));
+            if (tex.Pixels().size() == count)
+            {
+                PixelConvert::Expand8(tex.Pixels().data(), count, tex.Palette(0), output.data(), cpuPath);
+            }
+            else
+            {
+                PixelConvert::Expand4(tex.Pixels().data(), count, tex.Palette(0), output.data(), cpuPath);
+            }
+            if (cpuPath == eCpuScalar)
+            {
+                memcpy(reference[i].data(), output.data(), count * sizeof(Uint32));
+            }
+            else if (memcmp(reference[i].data(), output.data(), count * sizeof(Uint32)) != 0)
+            {
+                LOG_ERROR(PixelConvert::PathName(cpuPath) << " output differs for texture " << i);
+                return 1;
+            }
+        }
+    }
+
+    if (DirectBench(inputs, kPasses) != 0)
+    {
+        return 1;
+    }
+    PaletteSwitchBench(inputs);
+    DedupBench(inputs);
+
+    {
+        BenchTimer timer;
+        for (int pass = 0; pass < kPasses; pass++)
+        {
+            for (const auto& tex : inputs)
+            {
+                output.resize(std::max(output.size(), static_cast<size_t>(tex->Width()) * tex->Height()));
+                tex->ToRgba(output.data());
+            }
+        }
+        ReportMegapixels(std::string("TexFile::ToRgba (") + PixelConvert::PathName(PixelConvert::Best()) + ")", pixels * kPasses, timer.Seconds());
+    }
+    return 0;
+}
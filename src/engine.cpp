@@ -38,9 +38,13 @@ void sdl_cleanup()
     SDL_Quit();
 }
 
-Engine::Engine()
+Engine::Engine(const std::string& accessLogFile)
 {
     mKernel = std::make_unique<Kernel>();
+    if (!accessLogFile.empty())
+    {
+        mKernel->RecordAccesses(accessLogFile);
+    }
     mMenu = std::make_unique<Menu>();
 
     // TODO: Come up with a sane mapping
@@ -191,6 +195,9 @@ void Engine::Update()
 
     HandleInput();
 
+    // Hand over whatever finished loading since last frame, never waits on the disk
+    mKernel->GetFileSystem().PollLoads();
+
     switch (mState)
     {
     case eMenu:
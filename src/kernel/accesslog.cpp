@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <fstream>
+#include "kernel/accesslog.hpp"
+#include "kernel/lgp.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+std::string AccessLog::ArchiveKey(const std::string& archive)
+{
+    const std::string name = Lgp::NormalizeName(archive);
+    const size_t slash = name.find_last_of('/');
+    return slash == std::string::npos ? name : name.substr(slash + 1);
+}
+
+void AccessLog::BeginScene(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mScenes.push_back(Scene());
+    mScenes.back().name = name;
+}
+
+void AccessLog::Record(const std::string& archive, const std::string& entry)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mScenes.empty())
+    {
+        mScenes.push_back(Scene());
+        mScenes.back().name = "startup";
+    }
+
+    Scene& scene = mScenes.back();
+    auto access = std::make_pair(ArchiveKey(archive), entry);
+    if (scene.seen.insert(access).second)
+    {
+        scene.accesses.emplace_back(std::move(access));
+    }
+}
+
+void AccessLog::Save(const std::string& fileName) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::ofstream out(fileName, std::ios::out | std::ios::trunc);
+    for (const Scene& scene : mScenes)
+    {
+        out << "> " << scene.name << "\n";
+        for (const auto& access : scene.accesses)
+        {
+            out << access.first << "\t" << access.second << "\n";
+        }
+    }
+
+    if (!out)
+    {
+        LOG_ERROR("Failed to write " << fileName);
+        throw Exception("Failed to write access log");
+    }
+}
+
+void AccessLog::Load(const std::string& fileName)
+{
+    std::ifstream in(fileName);
+    if (!in)
+    {
+        LOG_ERROR("File not found " << fileName);
+        throw Exception("File not found");
+    }
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.compare(0, 2, "> ") == 0)
+        {
+            BeginScene(line.substr(2));
+            continue;
+        }
+
+        const size_t tab = line.find('\t');
+        if (tab != std::string::npos)
+        {
+            Record(line.substr(0, tab), line.substr(tab + 1));
+        }
+    }
+}
+
+std::vector<std::vector<size_t>> AccessLog::Groups(const Lgp& lgp, const std::string& archive) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    const std::string key = ArchiveKey(archive);
+    std::vector<bool> placed(lgp.EntryCount(), false);
+
+    std::vector<std::vector<size_t>> groups;
+    for (const Scene& scene : mScenes)
+    {
+        std::vector<size_t> group;
+        for (const auto& access : scene.accesses)
+        {
+            const size_t index = access.first == key ? lgp.Find(access.second) : Lgp::kNotFound;
+            if (index != Lgp::kNotFound && !placed[index])
+            {
+                placed[index] = true;
+                group.push_back(index);
+            }
+        }
+
+        if (!group.empty())
+        {
+            groups.emplace_back(std::move(group));
+        }
+    }
+    return groups;
+}
+
+size_t AccessLog::CountReads(const Lgp& lgp, const std::string& archive, const Scene& scene, size_t gap) const
+{
+    const std::string key = ArchiveKey(archive);
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (const auto& access : scene.accesses)
+    {
+        const size_t index = access.first == key ? lgp.Find(access.second) : Lgp::kNotFound;
+        if (index != Lgp::kNotFound)
+        {
+            const size_t start = lgp.EntryOffset(index);
+            ranges.emplace_back(start, lgp.EntryDataOffset(index) + lgp.EntrySize(index));
+        }
+    }
+    std::sort(ranges.begin(), ranges.end());
+
+    size_t reads = 0;
+    size_t end = 0;
+    for (const auto& range : ranges)
+    {
+        if (reads == 0 || range.first > end + gap)
+        {
+            reads++;
+        }
+        end = std::max(end, range.second);
+    }
+    return reads;
+}
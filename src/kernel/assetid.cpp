@@ -0,0 +1,30 @@
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+#include "kernel/assetid.hpp"
+
+// Only filled in by debug builds, see AssetId(const std::string&)
+static std::mutex gNamesMutex;
+static std::unordered_map<AssetId, std::string> gNames;
+
+void AssetId::Register(AssetId id, const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(gNamesMutex);
+    gNames.emplace(id, path);
+}
+
+std::string AssetId::Name(AssetId id)
+{
+    {
+        std::lock_guard<std::mutex> lock(gNamesMutex);
+        auto it = gNames.find(id);
+        if (it != std::end(gNames))
+        {
+            return it->second;
+        }
+    }
+
+    char hex[20] = {};
+    snprintf(hex, sizeof(hex), "#%016llx", static_cast<unsigned long long>(id.Value()));
+    return hex;
+}
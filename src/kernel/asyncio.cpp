@@ -0,0 +1,419 @@
+#include "kernel/asyncio.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_LIBURING
+#include <atomic>
+#include <cerrno>
+#include <liburing.h>
+#endif
+
+// Positional reads so many requests can share one handle without seeking
+class NativeFile
+{
+public:
+    NativeFile() = default;
+    NativeFile(const NativeFile&) = delete;
+    NativeFile& operator = (const NativeFile&) = delete;
+
+#ifdef _WIN32
+    ~NativeFile()
+    {
+        if (mHandle != INVALID_HANDLE_VALUE)
+        {
+            ::CloseHandle(mHandle);
+        }
+    }
+
+    bool Open(const std::string& fileName)
+    {
+        mHandle = ::CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size = {};
+        if (mHandle == INVALID_HANDLE_VALUE || !::GetFileSizeEx(mHandle, &size))
+        {
+            return false;
+        }
+        mSize = static_cast<size_t>(size.QuadPart);
+        return true;
+    }
+
+    // Returns the number of bytes read, or -1 on error
+    long long ReadAt(Uint8* pDest, size_t size, size_t offset)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(static_cast<Uint64>(offset) & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(static_cast<Uint64>(offset) >> 32);
+        DWORD read = 0;
+        if (!::ReadFile(mHandle, pDest, static_cast<DWORD>(size), &read, &overlapped))
+        {
+            return ::GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+        }
+        return read;
+    }
+
+    HANDLE mHandle = INVALID_HANDLE_VALUE;
+#else
+    ~NativeFile()
+    {
+        if (mFd != -1)
+        {
+            ::close(mFd);
+        }
+    }
+
+    bool Open(const std::string& fileName)
+    {
+        mFd = ::open(fileName.c_str(), O_RDONLY);
+        struct stat info = {};
+        if (mFd == -1 || ::fstat(mFd, &info) != 0)
+        {
+            return false;
+        }
+        mSize = static_cast<size_t>(info.st_size);
+        return true;
+    }
+
+    long long ReadAt(Uint8* pDest, size_t size, size_t offset)
+    {
+        return ::pread(mFd, pDest, size, static_cast<off_t>(offset));
+    }
+
+    int mFd = -1;
+#endif
+
+    size_t mSize = 0;
+};
+
+struct AsyncIo::Request
+{
+    std::shared_ptr<NativeFile> file;
+    size_t offset = 0;
+    size_t done = 0;
+    std::vector<Uint8> data;
+    Callback callback;
+};
+
+#ifdef HAVE_LIBURING
+struct AsyncIo::Ring
+{
+    io_uring ring;
+
+    // Guards the submission queue, only the ring thread touches the completion queue
+    std::mutex mutex;
+    std::thread thread;
+    std::atomic<size_t> inFlight;
+    bool quit = false;
+};
+#else
+struct AsyncIo::Ring
+{
+
+};
+#endif
+
+AsyncIo::AsyncIo(size_t threadCount)
+    : mPool(threadCount)
+{
+#ifdef HAVE_LIBURING
+    auto ring = std::make_unique<Ring>();
+    ring->inFlight = 0;
+    if (io_uring_queue_init(256, &ring->ring, 0) == 0)
+    {
+        mRing = std::move(ring);
+        mRing->thread = std::thread(&AsyncIo::RingThread, this);
+    }
+    else
+    {
+        LOG_WARNING("io_uring is not available, using pread thread pool");
+    }
+#endif
+}
+
+AsyncIo::~AsyncIo()
+{
+#ifdef HAVE_LIBURING
+    if (mRing)
+    {
+        {
+            // A nop with no request tells the ring thread to finish up and exit
+            std::lock_guard<std::mutex> lock(mRing->mutex);
+            io_uring_sqe* sqe = io_uring_get_sqe(&mRing->ring);
+            while (!sqe)
+            {
+                io_uring_submit(&mRing->ring);
+                sqe = io_uring_get_sqe(&mRing->ring);
+            }
+            io_uring_prep_nop(sqe);
+            io_uring_sqe_set_data(sqe, nullptr);
+            io_uring_submit(&mRing->ring);
+        }
+        mRing->thread.join();
+        io_uring_queue_exit(&mRing->ring);
+    }
+#endif
+    mPool.Wait();
+}
+
+const char* AsyncIo::BackendName() const
+{
+#ifdef HAVE_LIBURING
+    if (mRing)
+    {
+        return "io_uring";
+    }
+#endif
+    return "pread thread pool";
+}
+
+const size_t AsyncIo::kMaxOpenFiles;
+
+std::shared_ptr<NativeFile> AsyncIo::OpenFile(const std::string& fileName)
+{
+    std::lock_guard<std::mutex> lock(mFilesMutex);
+    auto it = mFiles.find(fileName);
+    if (it != std::end(mFiles))
+    {
+        mFilesLru.splice(std::begin(mFilesLru), mFilesLru, it->second.lruPosition);
+        return it->second.file;
+    }
+
+    auto file = std::make_shared<NativeFile>();
+    if (!file->Open(fileName))
+    {
+        LOG_ERROR("Failed to open " << fileName);
+        return nullptr;
+    }
+
+    if (mFiles.size() >= kMaxOpenFiles)
+    {
+        mFiles.erase(mFilesLru.back());
+        mFilesLru.pop_back();
+    }
+    mFilesLru.push_front(fileName);
+    mFiles[fileName] = CachedFile{ file, std::begin(mFilesLru) };
+    return file;
+}
+
+void AsyncIo::CloseFiles()
+{
+    std::lock_guard<std::mutex> lock(mFilesMutex);
+    mFiles.clear();
+    mFilesLru.clear();
+}
+
+size_t AsyncIo::FileSize(const std::string& fileName)
+{
+    auto file = OpenFile(fileName);
+    if (!file)
+    {
+        throw Exception("File not found");
+    }
+    return file->mSize;
+}
+
+void AsyncIo::Read(const std::string& fileName, size_t offset, size_t size, Callback callback)
+{
+    auto request = std::make_unique<Request>();
+    request->file = OpenFile(fileName);
+    request->offset = offset;
+    request->callback = std::move(callback);
+    if (!request->file)
+    {
+        // Still completed on an IO thread, callers may hold a lock the callback takes
+        SubmitPool(std::move(request), false);
+        return;
+    }
+
+    const size_t fileSize = request->file->mSize;
+    const size_t available = offset < fileSize ? fileSize - offset : 0;
+    request->data.resize(size == 0 ? available : std::min(size, available));
+    if (request->data.empty())
+    {
+        SubmitPool(std::move(request));
+        return;
+    }
+
+#ifdef HAVE_LIBURING
+    if (mRing && SubmitRing(request))
+    {
+        return;
+    }
+#endif
+    SubmitPool(std::move(request));
+}
+
+std::future<std::vector<Uint8>> AsyncIo::Read(const std::string& fileName, size_t offset, size_t size)
+{
+    auto promise = std::make_shared<std::promise<std::vector<Uint8>>>();
+    auto future = promise->get_future();
+    Read(fileName, offset, size, [promise](std::vector<Uint8>&& data, bool ok)
+    {
+        if (ok)
+        {
+            promise->set_value(std::move(data));
+        }
+        else
+        {
+            promise->set_exception(std::make_exception_ptr(Exception("Async read failure")));
+        }
+    });
+    return future;
+}
+
+void AsyncIo::SubmitPool(std::unique_ptr<Request> request, bool ok)
+{
+    // std::function must be copyable so the request travels as a raw pointer
+    Request* raw = request.release();
+    mPool.Post([raw, ok]()
+    {
+        std::unique_ptr<Request> request(raw);
+        if (!ok)
+        {
+            Complete(std::move(request), false);
+            return;
+        }
+
+        while (request->done < request->data.size())
+        {
+            const long long read = request->file->ReadAt(request->data.data() + request->done,
+                request->data.size() - request->done, request->offset + request->done);
+            if (read < 0)
+            {
+                Complete(std::move(request), false);
+                return;
+            }
+
+            if (read == 0)
+            {
+                // File shrank under us
+                break;
+            }
+            request->done += static_cast<size_t>(read);
+        }
+        request->data.resize(request->done);
+        Complete(std::move(request), true);
+    });
+}
+
+void AsyncIo::Complete(std::unique_ptr<Request> request, bool ok)
+{
+    if (request->callback)
+    {
+        request->callback(std::move(request->data), ok);
+    }
+}
+
+#ifdef HAVE_LIBURING
+bool AsyncIo::SubmitRing(std::unique_ptr<Request>& request)
+{
+    std::lock_guard<std::mutex> lock(mRing->mutex);
+    io_uring_sqe* sqe = io_uring_get_sqe(&mRing->ring);
+    if (!sqe)
+    {
+        io_uring_submit(&mRing->ring);
+        sqe = io_uring_get_sqe(&mRing->ring);
+        if (!sqe)
+        {
+            return false;
+        }
+    }
+
+    Request* raw = request.release();
+    io_uring_prep_read(sqe, raw->file->mFd, raw->data.data() + raw->done,
+        static_cast<unsigned int>(raw->data.size() - raw->done), raw->offset + raw->done);
+    io_uring_sqe_set_data(sqe, raw);
+    mRing->inFlight++;
+    io_uring_submit(&mRing->ring);
+    return true;
+}
+
+void AsyncIo::RingThread()
+{
+    while (!mRing->quit || mRing->inFlight > 0)
+    {
+        io_uring_cqe* cqe = nullptr;
+        const int ret = io_uring_wait_cqe(&mRing->ring, &cqe);
+        if (ret == -EINTR)
+        {
+            continue;
+        }
+
+        if (ret < 0)
+        {
+            LOG_ERROR("io_uring_wait_cqe failed " << ret);
+            break;
+        }
+
+        std::unique_ptr<Request> request(static_cast<Request*>(io_uring_cqe_get_data(cqe)));
+        const int result = cqe->res;
+        io_uring_cqe_seen(&mRing->ring, cqe);
+
+        if (!request)
+        {
+            mRing->quit = true;
+            continue;
+        }
+        mRing->inFlight--;
+
+        if (result < 0)
+        {
+            Complete(std::move(request), false);
+            continue;
+        }
+
+        request->done += static_cast<size_t>(result);
+        if (result > 0 && request->done < request->data.size())
+        {
+            // Short read, queue the rest
+            if (!SubmitRing(request))
+            {
+                SubmitPool(std::move(request));
+            }
+            continue;
+        }
+        request->data.resize(request->done);
+        Complete(std::move(request), true);
+    }
+}
+#endif
+
+ReadAheadFile::ReadAheadFile(AsyncIo& io, const std::string& fileName, size_t chunkSize, size_t depth)
+    : mIo(io), mFileName(fileName), mChunkSize(chunkSize), mDepth(std::max<size_t>(depth, 1))
+{
+    mFileSize = mIo.FileSize(fileName);
+    Queue();
+}
+
+void ReadAheadFile::Queue()
+{
+    while (mInFlight.size() < mDepth && mNextOffset < mFileSize)
+    {
+        mInFlight.emplace_back(mIo.Read(mFileName, mNextOffset, mChunkSize));
+        mNextOffset += mChunkSize;
+    }
+}
+
+bool ReadAheadFile::Next(const Uint8*& data, size_t& size)
+{
+    if (mInFlight.empty())
+    {
+        return false;
+    }
+
+    mCurrent = mInFlight.front().get();
+    mInFlight.pop_front();
+    Queue();
+
+    data = mCurrent.data();
+    size = mCurrent.size();
+    return size > 0;
+}
@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+#include "kernel/cookedpack.hpp"
+#include "kernel/filesystem.hpp"
+#include "kernel/mappedfile.hpp"
+#include "kernel/threadpool.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static const size_t kPageSize = 4096;
+
+// Blocks are only kept compressed when that saves at least 1/kMinSaving of them
+static const size_t kMinSaving = 8;
+
+static size_t Align(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+CookedPack::CookedPack(const std::string& fileName)
+    : mStream(fileName)
+{
+    mStream.ReadStruct(mHeader);
+    if (mHeader.magic != kMagic || mHeader.version != kVersion)
+    {
+        LOG_ERROR(fileName << " is not a cooked pack");
+        throw Exception("Not a cooked pack");
+    }
+
+    mStream.Seek(mHeader.directoryOffset);
+    mAssets = mStream.ReadArray<PackAsset>(mHeader.assetCount);
+    mBlocks = mStream.ReadArray<PackBlock>(mHeader.blockCount);
+    mSlots = mStream.ReadArray<Uint32>(mHeader.slotCount);
+    mStream.CheckRemaining(mHeader.namesSize, 1);
+    mNames.resize(mHeader.namesSize);
+    mStream.ReadBytes(reinterpret_cast<Uint8*>(&mNames[0]), mNames.size());
+
+    // Find needs an empty slot to stop at and every filled one to name an asset
+    if ((mSlots.size() & (mSlots.size() - 1)) != 0 || mSlots.size() <= mAssets.size() || mHeader.blockSize == 0)
+    {
+        throw Exception("Corrupt cooked pack directory");
+    }
+    for (Uint32 slot : mSlots)
+    {
+        if (slot > mAssets.size())
+        {
+            throw Exception("Corrupt cooked pack directory");
+        }
+    }
+
+    for (const PackBlock& block : mBlocks)
+    {
+        if (block.offset + static_cast<Uint64>(block.compressedSize) > mStream.Size() || block.rawSize > mHeader.blockSize)
+        {
+            throw Exception("Corrupt cooked pack block table");
+        }
+    }
+
+    // LoadInto puts block i at i * blockSize, so every block but the last must be
+    // full and the last must end exactly at the asset's size
+    for (const PackAsset& asset : mAssets)
+    {
+        const Uint64 expectedBlocks = (static_cast<Uint64>(asset.size) + mHeader.blockSize - 1) / mHeader.blockSize;
+        if (asset.blockCount != expectedBlocks
+            || asset.firstBlock + static_cast<Uint64>(asset.blockCount) > mBlocks.size()
+            || asset.nameOffset + static_cast<Uint64>(asset.nameLength) > mNames.size())
+        {
+            throw Exception("Corrupt cooked pack directory");
+        }
+
+        for (Uint32 i = 0; i < asset.blockCount; i++)
+        {
+            const Uint32 expectedSize = i + 1 < asset.blockCount ? mHeader.blockSize : asset.size - i * mHeader.blockSize;
+            if (mBlocks[asset.firstBlock + i].rawSize != expectedSize)
+            {
+                throw Exception("Corrupt cooked pack directory");
+            }
+        }
+    }
+}
+
+bool CookedPack::IsCooked(Stream& stream, eCookedFormat format)
+{
+    if (stream.Size() - stream.Pos() < sizeof(CookedHeader))
+    {
+        return false;
+    }
+
+    const size_t pos = stream.Pos();
+    CookedHeader header = {};
+    stream.ReadStruct(header);
+    if (header.magic == kCookedMagic && header.format == static_cast<Uint32>(format))
+    {
+        return true;
+    }
+    stream.Seek(pos);
+    return false;
+}
+
+std::vector<Uint8> CookedPack::MakeCooked(eCookedFormat format, size_t size)
+{
+    CookedHeader header = { kCookedMagic, static_cast<Uint32>(format) };
+    BinaryLayoutToHost(&header, 1);
+    std::vector<Uint8> data(sizeof(header) + size);
+    memcpy(data.data(), &header, sizeof(header));
+    return data;
+}
+
+size_t CookedPack::Find(AssetId id) const
+{
+    // The cooker refuses to write two paths with the same id
+    const size_t mask = mSlots.size() - 1;
+    for (size_t slot = id.Value() & mask; mSlots[slot] != 0; slot = (slot + 1) & mask)
+    {
+        if (mAssets[mSlots[slot] - 1].Id() == id)
+        {
+            return mSlots[slot] - 1;
+        }
+    }
+    return kNotFound;
+}
+
+std::string CookedPack::AssetPath(size_t index) const
+{
+    const PackAsset& asset = mAssets.at(index);
+    return mNames.substr(asset.nameOffset, asset.nameLength);
+}
+
+bool CookedPack::IsStored(size_t index, size_t& offset) const
+{
+    const PackAsset& asset = mAssets.at(index);
+    for (Uint32 i = 0; i < asset.blockCount; i++)
+    {
+        const PackBlock& block = mBlocks[asset.firstBlock + i];
+        if (block.compressedSize != block.rawSize || (i > 0 && block.offset != mBlocks[asset.firstBlock + i - 1].offset + mHeader.blockSize))
+        {
+            return false;
+        }
+    }
+    offset = asset.blockCount > 0 ? mBlocks[asset.firstBlock].offset : 0;
+    return true;
+}
+
+void CookedPack::LoadBlock(const PackBlock& block, Uint8* dest) const
+{
+    // Slices have their own cursor so blocks can be read from any thread
+    Stream source = mStream.Slice(block.offset, block.compressedSize);
+    const Uint8* src = source.ReadView(block.compressedSize);
+    if (block.compressedSize == block.rawSize)
+    {
+        memcpy(dest, src, block.rawSize);
+        return;
+    }
+
+    uLongf destSize = block.rawSize;
+    if (uncompress(dest, &destSize, src, block.compressedSize) != Z_OK || destSize != block.rawSize)
+    {
+        throw Exception("Corrupt cooked pack block");
+    }
+}
+
+void CookedPack::LoadInto(size_t index, Uint8* dest, ThreadPool* pool) const
+{
+    const PackAsset& asset = mAssets.at(index);
+    auto load = [this, &asset, dest](size_t i)
+    {
+        LoadBlock(mBlocks[asset.firstBlock + i], dest + i * mHeader.blockSize);
+    };
+
+    if (pool && asset.blockCount > 1)
+    {
+        pool->ParallelFor(asset.blockCount, load);
+    }
+    else
+    {
+        for (size_t i = 0; i < asset.blockCount; i++)
+        {
+            load(i);
+        }
+    }
+}
+
+std::vector<Uint8> CookedPack::Load(size_t index, ThreadPool* pool) const
+{
+    std::vector<Uint8> data(AssetSize(index));
+    LoadInto(index, data.data(), pool);
+    return data;
+}
+
+void PackCooker::AddConverter(const std::string& suffix, Converter converter)
+{
+    mConverters.emplace_back(FileSystem::NormalizePath(suffix), std::move(converter));
+}
+
+void PackCooker::Add(const std::string& path, Stream&& data)
+{
+    Add(path, std::move(data), nullptr);
+}
+
+void PackCooker::Add(const std::string& path, Stream&& data, Converter converter)
+{
+    mAssets.push_back(Asset{ FileSystem::NormalizePath(path), std::move(data), std::vector<Uint8>(), std::move(converter) });
+}
+
+template<typename T>
+static void WriteArray(Uint8*& p, std::vector<T> items)
+{
+    BinaryLayoutToHost(items.data(), items.size());
+    memcpy(p, items.data(), items.size() * sizeof(T));
+    p += items.size() * sizeof(T);
+}
+
+size_t PackCooker::Write(const std::string& fileName, ThreadPool& pool, size_t blockSize)
+{
+    // Convert every asset in to its runtime form
+    pool.ParallelFor(mAssets.size(), [this](size_t i)
+    {
+        Asset& asset = mAssets[i];
+        if (asset.converter)
+        {
+            asset.input.Seek(0);
+            asset.data = asset.converter(asset.input);
+            return;
+        }
+
+        for (const auto& converter : mConverters)
+        {
+            const std::string& extension = converter.first;
+            if (asset.path.size() > extension.size() && asset.path.compare(asset.path.size() - extension.size(), extension.size(), extension) == 0)
+            {
+                asset.input.Seek(0);
+                asset.data = converter.second(asset.input);
+                return;
+            }
+        }
+
+        asset.data.resize(asset.input.Size());
+        asset.input.Seek(0);
+        asset.input.ReadBytes(asset.data.data(), asset.data.size());
+    });
+
+    // Split them in to blocks and compress them all
+    std::vector<PackAsset> assets(mAssets.size());
+    std::vector<PackBlock> blocks;
+    std::vector<std::pair<size_t, size_t>> blockSources;
+    for (size_t i = 0; i < mAssets.size(); i++)
+    {
+        const std::vector<Uint8>& data = mAssets[i].data;
+        if (data.size() > 0xFFFFFFFF)
+        {
+            throw Exception("Asset too big for a cooked pack");
+        }
+
+        assets[i].size = static_cast<Uint32>(data.size());
+        assets[i].firstBlock = static_cast<Uint32>(blocks.size());
+        assets[i].blockCount = static_cast<Uint32>((data.size() + blockSize - 1) / blockSize);
+        for (size_t offset = 0; offset < data.size(); offset += blockSize)
+        {
+            blocks.push_back(PackBlock{ 0, 0, static_cast<Uint32>(std::min(blockSize, data.size() - offset)), 0 });
+            blockSources.emplace_back(i, offset);
+        }
+    }
+
+    std::vector<std::vector<Uint8>> compressed(blocks.size());
+    pool.ParallelFor(blocks.size(), [&](size_t i)
+    {
+        const Uint8* src = mAssets[blockSources[i].first].data.data() + blockSources[i].second;
+        uLongf size = compressBound(blocks[i].rawSize);
+        compressed[i].resize(size);
+        if (compress2(compressed[i].data(), &size, src, blocks[i].rawSize, Z_BEST_SPEED) != Z_OK
+            || size > blocks[i].rawSize - blocks[i].rawSize / kMinSaving)
+        {
+            // Inflating costs more than reading the few bytes saved, store as is
+            compressed[i].assign(src, src + blocks[i].rawSize);
+        }
+        else
+        {
+            compressed[i].resize(size);
+        }
+        blocks[i].compressedSize = static_cast<Uint32>(compressed[i].size());
+    });
+
+    // Lay out the blocks, anything a page or bigger starts on a new page
+    size_t size = sizeof(PackHeader);
+    for (const PackAsset& asset : assets)
+    {
+        size_t assetSize = 0;
+        for (Uint32 i = 0; i < asset.blockCount; i++)
+        {
+            assetSize += blocks[asset.firstBlock + i].compressedSize;
+        }
+
+        if (assetSize >= kPageSize)
+        {
+            size = Align(size, kPageSize);
+        }
+
+        for (Uint32 i = 0; i < asset.blockCount; i++)
+        {
+            blocks[asset.firstBlock + i].offset = static_cast<Uint32>(size);
+            size += blocks[asset.firstBlock + i].compressedSize;
+        }
+    }
+
+    // Directory
+    std::string names;
+    size_t slotCount = 16;
+    while (slotCount < assets.size() * 2)
+    {
+        slotCount *= 2;
+    }
+    std::vector<Uint32> slots(slotCount, 0);
+    for (size_t i = 0; i < assets.size(); i++)
+    {
+        const std::string& path = mAssets[i].path;
+        const Uint64 hash = AssetId::Hash(path.data(), path.size());
+        assets[i].hashLow = static_cast<Uint32>(hash);
+        assets[i].hashHigh = static_cast<Uint32>(hash >> 32);
+        assets[i].nameOffset = static_cast<Uint32>(names.size());
+        assets[i].nameLength = static_cast<Uint32>(path.size());
+        names += path;
+
+        size_t slot = hash & (slotCount - 1);
+        for (; slots[slot] != 0; slot = (slot + 1) & (slotCount - 1))
+        {
+            const size_t other = slots[slot] - 1;
+            if (assets[other].hashLow == assets[i].hashLow && assets[other].hashHigh == assets[i].hashHigh)
+            {
+                LOG_ERROR("Asset " << path << " has the same id as " << mAssets[other].path);
+                throw Exception("Duplicate asset in cooked pack");
+            }
+        }
+        slots[slot] = static_cast<Uint32>(i + 1);
+    }
+
+    PackHeader header = {};
+    header.magic = CookedPack::kMagic;
+    header.version = CookedPack::kVersion;
+    header.blockSize = static_cast<Uint32>(blockSize);
+    header.assetCount = static_cast<Uint32>(assets.size());
+    header.blockCount = static_cast<Uint32>(blocks.size());
+    header.slotCount = static_cast<Uint32>(slots.size());
+    header.namesSize = static_cast<Uint32>(names.size());
+    header.directoryOffset = static_cast<Uint32>(Align(size, sizeof(Uint32)));
+
+    const size_t totalSize = header.directoryOffset + assets.size() * sizeof(PackAsset) + blocks.size() * sizeof(PackBlock)
+        + slots.size() * sizeof(Uint32) + names.size();
+    if (totalSize > 0xFFFFFFFF)
+    {
+        throw Exception("Cooked pack would be over 4GB");
+    }
+
+    MappedFile out;
+    if (!out.Create(fileName, totalSize))
+    {
+        LOG_ERROR("Failed to create " << fileName);
+        throw Exception("Failed to create cooked pack");
+    }
+    Uint8* base = out.MutableData();
+
+    pool.ParallelFor(blocks.size(), [&](size_t i)
+    {
+        memcpy(base + blocks[i].offset, compressed[i].data(), compressed[i].size());
+    });
+
+    Uint8* p = base;
+    WriteArray(p, std::vector<PackHeader>(1, header));
+    p = base + header.directoryOffset;
+    WriteArray(p, assets);
+    WriteArray(p, blocks);
+    WriteArray(p, slots);
+    memcpy(p, names.data(), names.size());
+    return totalSize;
+}
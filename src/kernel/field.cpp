@@ -0,0 +1,177 @@
+#include <cstring>
+#include "kernel/field.hpp"
+#include "kernel/accesslog.hpp"
+#include "kernel/filesystem.hpp"
+#include "kernel/lzss.hpp"
+#include "kernel/stream.hpp"
+#include "kernel/texturededup.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static const size_t kFieldNameSize = 32;
+
+static Uint32 ReadU32(const Uint8* p)
+{
+    Uint32 value = 0;
+    memcpy(&value, p, sizeof(value));
+    BinaryLayoutToHost(&value, 1);
+    return value;
+}
+
+FieldFile::FieldFile(std::vector<Uint8>&& data)
+    : mData(std::move(data))
+{
+    const size_t headerSize = sizeof(Uint16) + sizeof(Uint32) + eSectionCount * sizeof(Uint32);
+    if (mData.size() < headerSize || ReadU32(&mData[2]) != eSectionCount)
+    {
+        throw Exception("Not a field file");
+    }
+
+    for (size_t i = 0; i < eSectionCount; i++)
+    {
+        const size_t offset = ReadU32(&mData[6 + i * sizeof(Uint32)]);
+        if (offset > mData.size() - sizeof(Uint32) || ReadU32(&mData[offset]) > mData.size() - offset - sizeof(Uint32))
+        {
+            throw Exception("Field file section out of bounds");
+        }
+        mSectionOffsets[i] = offset + sizeof(Uint32);
+        mSectionSizes[i] = ReadU32(&mData[offset]);
+    }
+
+    size_t triggersSize = 0;
+    const Uint8* triggers = Section(eSectionTriggers, triggersSize);
+    if (triggersSize < kGatewaysOffset + kGatewayCount * sizeof(FieldGateway))
+    {
+        throw Exception("Field file triggers section too small");
+    }
+
+    FieldGateway gateways[kGatewayCount];
+    memcpy(gateways, triggers + kGatewaysOffset, sizeof(gateways));
+    BinaryLayoutToHost(gateways, kGatewayCount);
+    for (const FieldGateway& gateway : gateways)
+    {
+        if (gateway.fieldId != kUnusedGateway)
+        {
+            mGateways.push_back(gateway);
+        }
+    }
+}
+
+std::shared_ptr<const FieldFile> FieldFile::Load(Stream& stream)
+{
+    return std::make_shared<const FieldFile>(Lzss::Decompress(stream));
+}
+
+const Uint8* FieldFile::Section(eSection section, size_t& size) const
+{
+    size = mSectionSizes[section];
+    return mData.data() + mSectionOffsets[section];
+}
+
+FieldList::FieldList(Stream& stream)
+{
+    Uint16 count = 0;
+    stream.ReadUInt16(count);
+    if (stream.Size() - stream.Pos() < count * kFieldNameSize)
+    {
+        throw Exception("Truncated field list");
+    }
+
+    const char* names = reinterpret_cast<const char*>(stream.ReadView(count * kFieldNameSize));
+    mNames.reserve(count);
+    for (Uint16 i = 0; i < count; i++)
+    {
+        const char* name = names + i * kFieldNameSize;
+        mNames.emplace_back(name, strnlen(name, kFieldNameSize));
+        mIds.emplace(mNames.back(), i);
+    }
+}
+
+std::string FieldList::Name(Uint16 id) const
+{
+    return id < mNames.size() ? mNames[id] : std::string();
+}
+
+Uint16 FieldList::Find(const std::string& name) const
+{
+    auto it = mIds.find(name);
+    return it == std::end(mIds) ? kNotFound : it->second;
+}
+
+FieldLoader::FieldLoader(FileSystem& fileSystem, ResourceCache& cache, const std::string& archive, TextureDedup* textures)
+    : mFileSystem(fileSystem), mCache(cache), mTextures(textures), mArchive(archive)
+{
+    Stream maplist = mFileSystem.Open(mArchive + "/maplist");
+    mFields = std::make_unique<FieldList>(maplist);
+
+    mCache.SetLoader(eField, [](Stream& stream, size_t& residentBytes)
+    {
+        auto field = FieldFile::Load(stream);
+        residentBytes = field->Size();
+        return std::static_pointer_cast<const void>(field);
+    });
+}
+
+AssetId FieldLoader::FieldAsset(const std::string& name) const
+{
+    return AssetId(mArchive + "/" + name);
+}
+
+void FieldLoader::Enter(const std::string& name)
+{
+    if (mTextures)
+    {
+        mTextures->BeginScene(name);
+    }
+    if (AccessLog* log = mFileSystem.GetAccessLog())
+    {
+        log->BeginScene(name);
+    }
+
+    mCurrent = mCache.Acquire(FieldAsset(name), eField);
+    mCurrentName = name;
+
+    // Wherever the player can walk to next
+    for (const FieldGateway& gateway : Current()->Gateways())
+    {
+        const std::string destination = mFields->Name(gateway.fieldId);
+        if (destination.empty())
+        {
+            LOG_WARNING(name << " has a gateway to unknown field " << gateway.fieldId);
+            continue;
+        }
+
+        const AssetId id = FieldAsset(destination);
+        if (mFileSystem.Exists(id))
+        {
+            mCache.Prefetch(id, eField);
+        }
+    }
+}
+
+void FieldLoader::Enter(Uint16 fieldId)
+{
+    const std::string name = mFields->Name(fieldId);
+    if (name.empty())
+    {
+        LOG_ERROR("No field with id " << fieldId);
+        throw Exception("Unknown field id");
+    }
+    Enter(name);
+}
+
+void FieldLoader::Cross(size_t gateway)
+{
+    const std::vector<FieldGateway>& gateways = Current()->Gateways();
+    if (gateway >= gateways.size())
+    {
+        throw Exception("Gateway out of range");
+    }
+    Enter(gateways[gateway].fieldId);
+}
+
+double FieldLoader::PrefetchHitRate() const
+{
+    const ResourceCache::Stats stats = mCache.GetStats(eField);
+    return stats.prefetches > 0 ? static_cast<double>(stats.prefetchHits) / static_cast<double>(stats.prefetches) : 0.0;
+}
@@ -1,6 +1,603 @@
+#include <algorithm>
+#include <set>
+#include <utility>
 #include "kernel/filesystem.hpp"
+#include "kernel/lgp.hpp"
+#include "kernel/accesslog.hpp"
+#include "kernel/cookedpack.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+
+struct NativeFileInfo
+{
+    std::string path;
+    size_t size;
+};
+
+#ifdef _WIN32
+// Recursively lists every file under root, paths are relative to it. Junctions and
+// symlinked folders are skipped, they can point back up the tree.
+static void ListDirectory(const std::string& root, const std::string& relative, std::vector<NativeFileInfo>& files)
+{
+    WIN32_FIND_DATAA data = {};
+    HANDLE find = ::FindFirstFileA((root + "/" + relative + "*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    do
+    {
+        const std::string name = data.cFileName;
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+            {
+                continue;
+            }
+            ListDirectory(root, relative + name + "/", files);
+        }
+        else
+        {
+            const Uint64 size = (static_cast<Uint64>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+            files.push_back({ relative + name, static_cast<size_t>(size) });
+        }
+    } while (::FindNextFileA(find, &data));
+    ::FindClose(find);
+}
+#else
+typedef std::set<std::pair<dev_t, ino_t>> VisitedDirectories;
+
+// Recursively lists every file under root, paths are relative to it. Symlinked
+// folders are followed, each folder only once so a link back up the tree can't
+// loop forever.
+static void ListDirectory(const std::string& root, const std::string& relative, std::vector<NativeFileInfo>& files, VisitedDirectories& visited)
+{
+    struct stat self = {};
+    if (stat((root + "/" + relative).c_str(), &self) != 0 || !visited.insert(std::make_pair(self.st_dev, self.st_ino)).second)
+    {
+        return;
+    }
+
+    DIR* dir = opendir((root + "/" + relative).c_str());
+    if (!dir)
+    {
+        return;
+    }
+
+    while (dirent* entry = readdir(dir))
+    {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+
+        struct stat info = {};
+        if (stat((root + "/" + relative + name).c_str(), &info) != 0)
+        {
+            continue;
+        }
+
+        if (S_ISDIR(info.st_mode))
+        {
+            ListDirectory(root, relative + name + "/", files, visited);
+        }
+        else if (S_ISREG(info.st_mode))
+        {
+            files.push_back({ relative + name, static_cast<size_t>(info.st_size) });
+        }
+    }
+    closedir(dir);
+}
+
+static void ListDirectory(const std::string& root, const std::string& relative, std::vector<NativeFileInfo>& files)
+{
+    VisitedDirectories visited;
+    ListDirectory(root, relative, files, visited);
+}
+#endif
+
+// Loose files in a folder, typically a mod
+class DirectoryLayer : public FileSystemLayer
+{
+public:
+    explicit DirectoryLayer(const std::string& root)
+        : mRoot(root)
+    {
+
+    }
+
+    void Refresh() override
+    {
+        mFiles.clear();
+        mPaths.clear();
+        mLookup.clear();
+        ListDirectory(mRoot, "", mFiles);
+        for (size_t i = 0; i < mFiles.size(); i++)
+        {
+            mPaths.push_back(FileSystem::NormalizePath(mFiles[i].path));
+            mLookup[mPaths.back()] = i;
+        }
+    }
+
+    size_t FileCount() const override { return mFiles.size(); }
+    std::string FilePath(size_t index) const override { return mPaths[index]; }
+
+    size_t Find(const std::string& path) const override
+    {
+        auto it = mLookup.find(path);
+        return it == std::end(mLookup) ? kNotFound : it->second;
+    }
+
+    Stream Open(size_t index) const override
+    {
+        return Stream(mRoot + "/" + mFiles[index].path);
+    }
+
+    bool Locate(size_t index, std::string& fileName, size_t& offset, size_t& size) const override
+    {
+        fileName = mRoot + "/" + mFiles[index].path;
+        offset = 0;
+        size = mFiles[index].size;
+        return true;
+    }
+
+    std::string Name() const override { return mRoot; }
+private:
+    std::string mRoot;
+    std::vector<NativeFileInfo> mFiles;
+    std::vector<std::string> mPaths;
+    std::unordered_map<std::string, size_t> mLookup;
+};
+
+class LgpLayer : public FileSystemLayer
+{
+public:
+    explicit LgpLayer(const std::shared_ptr<Lgp>& lgp)
+        : mLgp(lgp)
+    {
+
+    }
+
+    void Refresh() override
+    {
+        // The archive's index is fixed once it has been opened
+    }
+
+    size_t FileCount() const override { return mLgp->EntryCount(); }
+    std::string FilePath(size_t index) const override { return mLgp->EntryName(index); }
+    size_t Find(const std::string& path) const override { return mLgp->Find(path); }
+    Stream Open(size_t index) const override { return mLgp->Open(index); }
+
+    bool Locate(size_t index, std::string& fileName, size_t& offset, size_t& size) const override
+    {
+        fileName = mLgp->Name();
+        offset = mLgp->EntryDataOffset(index);
+        size = mLgp->EntrySize(index);
+        return true;
+    }
+
+    std::string Name() const override { return mLgp->Name(); }
+private:
+    std::shared_ptr<Lgp> mLgp;
+};
+
+class PackLayer : public FileSystemLayer
+{
+public:
+    PackLayer(const std::shared_ptr<CookedPack>& pack, ThreadPool* pool)
+        : mPack(pack), mPool(pool)
+    {
+
+    }
+
+    void Refresh() override
+    {
+        // Packs are immutable once cooked
+    }
+
+    size_t FileCount() const override { return mPack->AssetCount(); }
+    std::string FilePath(size_t index) const override { return mPack->AssetPath(index); }
+    size_t Find(const std::string& path) const override { return mPack->Find(path); }
+    Stream Open(size_t index) const override { return Stream(mPack->Load(index, mPool)); }
+
+    bool Locate(size_t index, std::string& fileName, size_t& offset, size_t& size) const override
+    {
+        if (!mPack->IsStored(index, offset))
+        {
+            return false;
+        }
+        fileName = mPack->Name();
+        size = mPack->AssetSize(index);
+        return true;
+    }
+
+    std::string Name() const override { return mPack->Name(); }
+private:
+    std::shared_ptr<CookedPack> mPack;
+    ThreadPool* mPool;
+};
 
 FileSystem::FileSystem()
 {
 
-}
\ No newline at end of file
+}
+
+FileSystem::~FileSystem()
+{
+    // Both still resolve files, so they go before the index and layers do
+    mLoads.reset();
+    mIo.Wait();
+}
+
+std::string FileSystem::NormalizePath(const std::string& path)
+{
+    std::string ret = Lgp::NormalizeName(path);
+    const size_t begin = ret.find_first_not_of('/');
+    if (begin == std::string::npos)
+    {
+        return std::string();
+    }
+    const size_t end = ret.find_last_not_of('/');
+    return ret.substr(begin, end - begin + 1);
+}
+
+void FileSystem::ListDirectory(const std::string& directory, std::vector<std::string>& files)
+{
+    std::vector<NativeFileInfo> info;
+    ::ListDirectory(directory, "", info);
+    for (const NativeFileInfo& file : info)
+    {
+        files.push_back(file.path);
+    }
+}
+
+FileSystem::LayerId FileSystem::Mount(std::unique_ptr<FileSystemLayer> layer, const std::string& mountPoint, int priority)
+{
+    // Nothing else can see the layer yet, so its files are listed without the lock
+    layer->Refresh();
+    const std::string name = layer->Name();
+    const size_t fileCount = layer->FileCount();
+
+    std::unique_lock<std::shared_timed_mutex> lock(mIndexMutex);
+    const LayerId id = mNextId++;
+    Layer& mounted = mLayers[id];
+    mounted.files = std::move(layer);
+    mounted.mountPoint = NormalizePath(mountPoint);
+    mounted.priority = priority;
+    mounted.order = mMountCount++;
+    AddToIndex(id);
+    lock.unlock();
+
+    LOG_INFO("Mounted " << name << " at /" << NormalizePath(mountPoint) << " with " << fileCount << " files");
+    return id;
+}
+
+FileSystem::LayerId FileSystem::MountDirectory(const std::string& directory, const std::string& mountPoint, int priority)
+{
+    return Mount(std::make_unique<DirectoryLayer>(directory), mountPoint, priority);
+}
+
+FileSystem::LayerId FileSystem::MountLgp(const std::shared_ptr<Lgp>& lgp, const std::string& mountPoint, int priority)
+{
+    return Mount(std::make_unique<LgpLayer>(lgp), mountPoint, priority);
+}
+
+FileSystem::LayerId FileSystem::MountPack(const std::shared_ptr<CookedPack>& pack, const std::string& mountPoint, int priority, ThreadPool* pool)
+{
+    return Mount(std::make_unique<PackLayer>(pack, pool), mountPoint, priority);
+}
+
+void FileSystem::Unmount(LayerId id)
+{
+    {
+        std::unique_lock<std::shared_timed_mutex> lock(mIndexMutex);
+        if (mLayers.find(id) == std::end(mLayers))
+        {
+            return;
+        }
+        RemoveFromIndex(id);
+        mLayers.erase(id);
+    }
+    mIo.CloseFiles();
+}
+
+void FileSystem::Remount(LayerId id)
+{
+    {
+        std::unique_lock<std::shared_timed_mutex> lock(mIndexMutex);
+        auto it = mLayers.find(id);
+        if (it == std::end(mLayers))
+        {
+            return;
+        }
+        RemoveFromIndex(id);
+        it->second.files->Refresh();
+        AddToIndex(id);
+    }
+
+    // Rewritten files may have a new inode and size
+    mIo.CloseFiles();
+}
+
+bool FileSystem::Outranks(LayerId a, LayerId b) const
+{
+    const Layer& layerA = mLayers.at(a);
+    const Layer& layerB = mLayers.at(b);
+    if (layerA.priority != layerB.priority)
+    {
+        return layerA.priority > layerB.priority;
+    }
+    return layerA.order > layerB.order;
+}
+
+std::string FileSystem::FullPath(const Layer& layer, size_t index) const
+{
+    const std::string path = layer.files->FilePath(index);
+    return layer.mountPoint.empty() ? path : layer.mountPoint + "/" + path;
+}
+
+void FileSystem::AddToIndex(LayerId id)
+{
+    const Layer& layer = mLayers.at(id);
+    const size_t count = layer.files->FileCount();
+    mIndex.reserve(mIndex.size() + count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const std::string path = FullPath(layer, i);
+        auto inserted = mIndex.emplace(AssetId(path), Resolved{ id, i });
+        if (inserted.second)
+        {
+            continue;
+        }
+
+        const Resolved& existing = inserted.first->second;
+        const std::string existingPath = FullPath(mLayers.at(existing.layer), existing.index);
+        if (existingPath != path)
+        {
+            // Leave the first one reachable, renaming either file fixes it
+            LOG_ERROR("Asset id collision between " << path << " in " << layer.files->Name()
+                << " and " << existingPath << " in " << mLayers.at(existing.layer).files->Name());
+        }
+        else if (Outranks(id, existing.layer))
+        {
+            inserted.first->second = Resolved{ id, i };
+        }
+    }
+}
+
+void FileSystem::RemoveFromIndex(LayerId id)
+{
+    const Layer& layer = mLayers.at(id);
+
+    // Lower layers that could take over, best first
+    std::vector<LayerId> fallbacks;
+    for (const auto& other : mLayers)
+    {
+        if (other.first != id)
+        {
+            fallbacks.push_back(other.first);
+        }
+    }
+    std::sort(fallbacks.begin(), fallbacks.end(), [this](LayerId a, LayerId b) { return Outranks(a, b); });
+
+    const size_t count = layer.files->FileCount();
+    for (size_t i = 0; i < count; i++)
+    {
+        const std::string path = FullPath(layer, i);
+        auto it = mIndex.find(AssetId(path));
+        if (it == std::end(mIndex) || it->second.layer != id || it->second.index != i)
+        {
+            // Hidden by a higher layer, nothing to do
+            continue;
+        }
+
+        bool replaced = false;
+        for (const LayerId fallback : fallbacks)
+        {
+            const Layer& other = mLayers.at(fallback);
+            if (!other.mountPoint.empty() && path.compare(0, other.mountPoint.size() + 1, other.mountPoint + "/") != 0)
+            {
+                continue;
+            }
+
+            const size_t index = other.files->Find(other.mountPoint.empty() ? path : path.substr(other.mountPoint.size() + 1));
+            if (index != FileSystemLayer::kNotFound)
+            {
+                it->second = Resolved{ fallback, index };
+                replaced = true;
+                break;
+            }
+        }
+
+        if (!replaced)
+        {
+            mIndex.erase(it);
+        }
+    }
+}
+
+const FileSystem::Resolved* FileSystem::Resolve(AssetId id) const
+{
+    auto it = mIndex.find(id);
+    return it == std::end(mIndex) ? nullptr : &it->second;
+}
+
+void FileSystem::RecordAccess(const Resolved& resolved) const
+{
+    if (mAccessLog)
+    {
+        const FileSystemLayer& layer = *mLayers.at(resolved.layer).files;
+        mAccessLog->Record(layer.Name(), layer.FilePath(resolved.index));
+    }
+}
+
+// Records happen with the index shared, so taking it exclusively waits them out
+void FileSystem::SetAccessLog(AccessLog* log)
+{
+    std::unique_lock<std::shared_timed_mutex> lock(mIndexMutex);
+    mAccessLog = log;
+}
+
+AccessLog* FileSystem::GetAccessLog() const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mIndexMutex);
+    return mAccessLog;
+}
+
+size_t FileSystem::FileCount() const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mIndexMutex);
+    return mIndex.size();
+}
+
+bool FileSystem::Exists(AssetId id) const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mIndexMutex);
+    return Resolve(id) != nullptr;
+}
+
+Stream FileSystem::Open(AssetId id) const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mIndexMutex);
+    const Resolved* resolved = Resolve(id);
+    if (!resolved)
+    {
+        LOG_ERROR("File not found " << AssetId::Name(id));
+        throw Exception("File not found");
+    }
+    RecordAccess(*resolved);
+    return mLayers.at(resolved->layer).files->Open(resolved->index);
+}
+
+std::future<std::vector<Uint8>> FileSystem::ReadAsync(AssetId id)
+{
+    auto promise = std::make_shared<std::promise<std::vector<Uint8>>>();
+    auto future = promise->get_future();
+    ReadAsync(id, [promise](std::vector<Uint8>&& data, bool ok)
+    {
+        if (ok)
+        {
+            promise->set_value(std::move(data));
+        }
+        else
+        {
+            promise->set_exception(std::make_exception_ptr(Exception("Async read failure")));
+        }
+    });
+    return future;
+}
+
+void FileSystem::ReadAsync(AssetId id, AsyncIo::Callback callback)
+{
+    std::string fileName;
+    size_t offset = 0;
+    size_t size = 0;
+    bool stored = false;
+    if (!Locate(id, fileName, offset, size, stored))
+    {
+        LOG_ERROR("File not found " << AssetId::Name(id));
+        mIo.Run([callback]() { callback(std::vector<Uint8>(), false); });
+        return;
+    }
+
+    if (stored)
+    {
+        if (size == 0)
+        {
+            // A read of 0 bytes would read to the end of the archive
+            mIo.Run([callback]() { callback(std::vector<Uint8>(), true); });
+            return;
+        }
+        mIo.Read(fileName, offset, size, std::move(callback));
+        return;
+    }
+
+    // Layers that have to decode their files are read and decoded on an IO thread too
+    mIo.Run([this, id, callback]()
+    {
+        std::vector<Uint8> data;
+        bool ok = false;
+        try
+        {
+            Stream stream = Open(id);
+            data.resize(stream.Size());
+            stream.ReadBytes(data.data(), data.size());
+            ok = true;
+        }
+        catch (const std::exception& ex)
+        {
+            LOG_ERROR("Failed to open " << AssetId::Name(id) << ": " << ex.what());
+            data.clear();
+        }
+        callback(std::move(data), ok);
+    });
+}
+
+bool FileSystem::Locate(AssetId id, std::string& fileName, size_t& offset, size_t& size, bool& stored) const
+{
+    std::shared_lock<std::shared_timed_mutex> lock(mIndexMutex);
+    const Resolved* resolved = Resolve(id);
+    if (!resolved)
+    {
+        return false;
+    }
+
+    const FileSystemLayer& layer = *mLayers.at(resolved->layer).files;
+    stored = layer.Locate(resolved->index, fileName, offset, size);
+    if (stored)
+    {
+        // Open records its own access
+        RecordAccess(*resolved);
+    }
+    return true;
+}
+
+LoadQueue& FileSystem::Loads()
+{
+    std::lock_guard<std::mutex> lock(mLoadsMutex);
+    if (!mLoads)
+    {
+        mLoads = std::make_unique<LoadQueue>(*this);
+    }
+    return *mLoads;
+}
+
+LoadHandle FileSystem::LoadAsync(AssetId id, eLoadPriority priority, LoadQueue::Decoder decoder, LoadQueue::Completion completion, Uint32 tag)
+{
+    return Loads().Load(id, priority, std::move(decoder), std::move(completion), tag);
+}
+
+void FileSystem::CancelLoads(Uint32 tag)
+{
+    std::lock_guard<std::mutex> lock(mLoadsMutex);
+    if (mLoads)
+    {
+        mLoads->Cancel(tag);
+    }
+}
+
+size_t FileSystem::PollLoads(size_t max)
+{
+    // Not held while completions run, they may well queue more loads
+    LoadQueue* loads = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mLoadsMutex);
+        loads = mLoads.get();
+    }
+    return loads ? loads->Poll(max) : 0;
+}
@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "kernel/gamedatabase.hpp"
+#include "kernel/kernelbin.hpp"
+#include "logger.hpp"
+
+const Uint16 GameDatabase::kInventoryIdCount;
+const Uint32 GameDatabase::kNoName;
+
+static const Uint16 kInventoryBase[eInventoryKindCount + 1] = { 0, 128, 256, 288, GameDatabase::kInventoryIdCount };
+static const Uint16 kUnusedApLevel = 0xFFFF;
+
+// Hands out columns from one block. Run the layout once to measure and again once
+// Allocate has been called to get real pointers, the same calls in the same order.
+class ColumnArena
+{
+public:
+    template<typename T>
+    T* Carve(size_t count)
+    {
+        mSize = (mSize + alignof(T) - 1) / alignof(T) * alignof(T);
+        T* column = mBase ? reinterpret_cast<T*>(mBase + mSize) : nullptr;
+        mSize += count * sizeof(T);
+        return column;
+    }
+
+    bool Ready() const { return mBase != nullptr; }
+    size_t Size() const { return mSize; }
+
+    void Allocate(std::unique_ptr<Uint8[]>& storage)
+    {
+        storage.reset(new Uint8[std::max<size_t>(mSize, 1)]());
+        mBase = storage.get();
+        mSize = 0;
+    }
+private:
+    Uint8* mBase = nullptr;
+    size_t mSize = 0;
+};
+
+// Every name once, offset 0 being the empty string
+class NameInterner
+{
+public:
+    NameInterner()
+        : mPool(1, '\0')
+    {
+
+    }
+
+    std::vector<Uint32> Intern(const KernelText& text, size_t count)
+    {
+        std::vector<Uint32> names(count, GameDatabase::kNoName);
+        for (size_t i = 0; i < count && i < text.Count(); i++)
+        {
+            const std::string name = text.Decoded(i);
+            if (name.empty())
+            {
+                continue;
+            }
+
+            auto it = mOffsets.find(name);
+            if (it == std::end(mOffsets))
+            {
+                it = mOffsets.emplace(name, static_cast<Uint32>(mPool.size())).first;
+                mPool.insert(std::end(mPool), std::begin(name), std::end(name));
+                mPool.push_back('\0');
+            }
+            names[i] = it->second;
+        }
+        return names;
+    }
+
+    const std::vector<char>& Pool() const { return mPool; }
+    size_t Count() const { return mOffsets.size(); }
+private:
+    std::vector<char> mPool;
+    std::unordered_map<std::string, Uint32> mOffsets;
+};
+
+static Uint32* CarveNames(ColumnArena& arena, const std::vector<Uint32>& names)
+{
+    Uint32* column = arena.Carve<Uint32>(names.size());
+    if (column && !names.empty())
+    {
+        memcpy(column, names.data(), names.size() * sizeof(Uint32));
+    }
+    return column;
+}
+
+static void BuildItems(ColumnArena& arena, const KernelTable<KernelItem>& items, const std::vector<Uint32>& names, ItemColumns& columns)
+{
+    const size_t count = items.Count();
+    columns.count = count;
+    columns.names = CarveNames(arena, names);
+    Uint16* restrictions = arena.Carve<Uint16>(count);
+    Uint8* targetFlags = arena.Carve<Uint8>(count);
+    Uint8* attackPower = arena.Carve<Uint8>(count);
+    Uint16* elements = arena.Carve<Uint16>(count);
+    Uint32* statusMask = arena.Carve<Uint32>(count);
+    columns.restrictions = restrictions;
+    columns.targetFlags = targetFlags;
+    columns.attackPower = attackPower;
+    columns.elements = elements;
+    columns.statusMask = statusMask;
+    if (!arena.Ready())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const KernelItem& item = items[i];
+        restrictions[i] = item.restrictions;
+        targetFlags[i] = item.targetFlags;
+        attackPower[i] = item.attackPower;
+        elements[i] = item.elements;
+        statusMask[i] = item.statusMask;
+    }
+}
+
+static void BuildWeapons(ColumnArena& arena, const KernelTable<KernelWeapon>& weapons, const std::vector<Uint32>& names, WeaponColumns& columns)
+{
+    const size_t count = weapons.Count();
+    columns.count = count;
+    columns.names = CarveNames(arena, names);
+    Uint16* restrictions = arena.Carve<Uint16>(count);
+    Uint16* equipMask = arena.Carve<Uint16>(count);
+    Uint8* attackPower = arena.Carve<Uint8>(count);
+    Uint8* accuracy = arena.Carve<Uint8>(count);
+    Uint8* criticalRate = arena.Carve<Uint8>(count);
+    Uint16* elements = arena.Carve<Uint16>(count);
+    Uint8* materiaGrowth = arena.Carve<Uint8>(count);
+    Uint8* materiaSlots = arena.Carve<Uint8>(count * sizeof(KernelWeapon::materiaSlots));
+    columns.restrictions = restrictions;
+    columns.equipMask = equipMask;
+    columns.attackPower = attackPower;
+    columns.accuracy = accuracy;
+    columns.criticalRate = criticalRate;
+    columns.elements = elements;
+    columns.materiaGrowth = materiaGrowth;
+    columns.materiaSlots = materiaSlots;
+    if (!arena.Ready())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const KernelWeapon& weapon = weapons[i];
+        restrictions[i] = weapon.restrictions;
+        equipMask[i] = weapon.equipMask;
+        attackPower[i] = weapon.attackPower;
+        accuracy[i] = weapon.accuracy;
+        criticalRate[i] = weapon.criticalRate;
+        elements[i] = weapon.elements;
+        materiaGrowth[i] = weapon.materiaGrowth;
+        memcpy(materiaSlots + i * sizeof(weapon.materiaSlots), weapon.materiaSlots, sizeof(weapon.materiaSlots));
+    }
+}
+
+static void BuildArmor(ColumnArena& arena, const KernelTable<KernelArmor>& armor, const std::vector<Uint32>& names, ArmorColumns& columns)
+{
+    const size_t count = armor.Count();
+    columns.count = count;
+    columns.names = CarveNames(arena, names);
+    Uint16* restrictions = arena.Carve<Uint16>(count);
+    Uint16* equipMask = arena.Carve<Uint16>(count);
+    Uint8* defense = arena.Carve<Uint8>(count);
+    Uint8* magicDefense = arena.Carve<Uint8>(count);
+    Uint8* evade = arena.Carve<Uint8>(count);
+    Uint8* magicEvade = arena.Carve<Uint8>(count);
+    Uint16* elements = arena.Carve<Uint16>(count);
+    Uint8* materiaGrowth = arena.Carve<Uint8>(count);
+    Uint8* materiaSlots = arena.Carve<Uint8>(count * sizeof(KernelArmor::materiaSlots));
+    columns.restrictions = restrictions;
+    columns.equipMask = equipMask;
+    columns.defense = defense;
+    columns.magicDefense = magicDefense;
+    columns.evade = evade;
+    columns.magicEvade = magicEvade;
+    columns.elements = elements;
+    columns.materiaGrowth = materiaGrowth;
+    columns.materiaSlots = materiaSlots;
+    if (!arena.Ready())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const KernelArmor& record = armor[i];
+        restrictions[i] = record.restrictions;
+        equipMask[i] = record.equipMask;
+        defense[i] = record.defense;
+        magicDefense[i] = record.magicDefense;
+        evade[i] = record.evade;
+        magicEvade[i] = record.magicEvade;
+        elements[i] = record.elements;
+        materiaGrowth[i] = record.materiaGrowth;
+        memcpy(materiaSlots + i * sizeof(record.materiaSlots), record.materiaSlots, sizeof(record.materiaSlots));
+    }
+}
+
+static void BuildAccessories(ColumnArena& arena, const KernelTable<KernelAccessory>& accessories, const std::vector<Uint32>& names, AccessoryColumns& columns)
+{
+    const size_t count = accessories.Count();
+    columns.count = count;
+    columns.names = CarveNames(arena, names);
+    Uint16* restrictions = arena.Carve<Uint16>(count);
+    Uint16* equipMask = arena.Carve<Uint16>(count);
+    Uint16* elements = arena.Carve<Uint16>(count);
+    Uint32* statusMask = arena.Carve<Uint32>(count);
+    Uint8* specialEffect = arena.Carve<Uint8>(count);
+    columns.restrictions = restrictions;
+    columns.equipMask = equipMask;
+    columns.elements = elements;
+    columns.statusMask = statusMask;
+    columns.specialEffect = specialEffect;
+    if (!arena.Ready())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const KernelAccessory& accessory = accessories[i];
+        restrictions[i] = accessory.restrictions;
+        equipMask[i] = accessory.equipMask;
+        elements[i] = accessory.elements;
+        statusMask[i] = accessory.statusMask;
+        specialEffect[i] = accessory.specialEffect;
+    }
+}
+
+static void BuildMateria(ColumnArena& arena, const KernelTable<KernelMateria>& materia, const std::vector<Uint32>& names, MateriaColumns& columns)
+{
+    const size_t count = materia.Count();
+    columns.count = count;
+    columns.names = CarveNames(arena, names);
+    Uint8* type = arena.Carve<Uint8>(count);
+    Uint8* element = arena.Carve<Uint8>(count);
+    Uint32* apToMaster = arena.Carve<Uint32>(count);
+    columns.type = type;
+    columns.element = element;
+    columns.apToMaster = apToMaster;
+    if (!arena.Ready())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const KernelMateria& record = materia[i];
+        type[i] = record.type;
+        element[i] = record.element;
+
+        // The last level in use is mastery
+        Uint32 ap = 0;
+        for (Uint16 level : record.apLevels)
+        {
+            if (level != kUnusedApLevel)
+            {
+                ap = std::max<Uint32>(ap, level * 100u);
+            }
+        }
+        apToMaster[i] = ap;
+    }
+}
+
+static void BuildAttacks(ColumnArena& arena, const KernelTable<KernelAttack>& attacks, const std::vector<Uint32>& names, AttackColumns& columns)
+{
+    const size_t count = attacks.Count();
+    columns.count = count;
+    columns.names = CarveNames(arena, names);
+    Uint16* mpCost = arena.Carve<Uint16>(count);
+    Uint8* targetFlags = arena.Carve<Uint8>(count);
+    Uint8* damageCalculation = arena.Carve<Uint8>(count);
+    Uint8* attackPower = arena.Carve<Uint8>(count);
+    Uint16* elements = arena.Carve<Uint16>(count);
+    Uint32* statusMask = arena.Carve<Uint32>(count);
+    columns.mpCost = mpCost;
+    columns.targetFlags = targetFlags;
+    columns.damageCalculation = damageCalculation;
+    columns.attackPower = attackPower;
+    columns.elements = elements;
+    columns.statusMask = statusMask;
+    if (!arena.Ready())
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const KernelAttack& attack = attacks[i];
+        mpCost[i] = attack.mpCost;
+        targetFlags[i] = attack.targetFlags;
+        damageCalculation[i] = attack.damageCalculation;
+        attackPower[i] = attack.attackPower;
+        elements[i] = attack.elements;
+        statusMask[i] = attack.statusMask;
+    }
+}
+
+// Copies the columns a whole inventory scan wants out of each table, ids without a
+// record are left as eInventoryNone
+static void BuildInventory(ColumnArena& arena, const ItemColumns& items, const WeaponColumns& weapons,
+    const ArmorColumns& armor, const AccessoryColumns& accessories, InventoryColumns& columns)
+{
+    const size_t count = GameDatabase::kInventoryIdCount;
+    columns.count = count;
+    Uint8* kind = arena.Carve<Uint8>(count);
+    Uint16* row = arena.Carve<Uint16>(count);
+    Uint32* names = arena.Carve<Uint32>(count);
+    Uint16* restrictions = arena.Carve<Uint16>(count);
+    Uint16* equipMask = arena.Carve<Uint16>(count);
+    Uint8* power = arena.Carve<Uint8>(count);
+    columns.kind = kind;
+    columns.row = row;
+    columns.names = names;
+    columns.restrictions = restrictions;
+    columns.equipMask = equipMask;
+    columns.power = power;
+    if (!arena.Ready())
+    {
+        return;
+    }
+
+    memset(kind, eInventoryNone, count);
+    auto fill = [&](eInventoryKind which, size_t rows, const Uint32* tableNames, const Uint16* tableRestrictions,
+        const Uint16* tableEquipMask, const Uint8* tablePower)
+    {
+        rows = std::min<size_t>(rows, kInventoryBase[which + 1] - kInventoryBase[which]);
+        for (size_t i = 0; i < rows; i++)
+        {
+            const size_t id = kInventoryBase[which] + i;
+            kind[id] = static_cast<Uint8>(which);
+            row[id] = static_cast<Uint16>(i);
+            names[id] = tableNames[i];
+            restrictions[id] = tableRestrictions[i];
+            equipMask[id] = tableEquipMask ? tableEquipMask[i] : 0;
+            power[id] = tablePower ? tablePower[i] : 0;
+        }
+    };
+    fill(eInventoryItem, items.count, items.names, items.restrictions, nullptr, items.attackPower);
+    fill(eInventoryWeapon, weapons.count, weapons.names, weapons.restrictions, weapons.equipMask, weapons.attackPower);
+    fill(eInventoryArmor, armor.count, armor.names, armor.restrictions, armor.equipMask, armor.defense);
+    fill(eInventoryAccessory, accessories.count, accessories.names, accessories.restrictions, accessories.equipMask, nullptr);
+}
+
+GameDatabase::GameDatabase(const KernelBin& kernel)
+{
+    const auto items = kernel.Items();
+    const auto weapons = kernel.Weapons();
+    const auto armor = kernel.Armor();
+    const auto accessories = kernel.Accessories();
+    const auto materia = kernel.Materia();
+    const auto attacks = kernel.Attacks();
+
+    NameInterner interner;
+    const std::vector<Uint32> itemNames = interner.Intern(kernel.Text(KernelBin::eItemNames), items.Count());
+    const std::vector<Uint32> weaponNames = interner.Intern(kernel.Text(KernelBin::eWeaponNames), weapons.Count());
+    const std::vector<Uint32> armorNames = interner.Intern(kernel.Text(KernelBin::eArmorNames), armor.Count());
+    const std::vector<Uint32> accessoryNames = interner.Intern(kernel.Text(KernelBin::eAccessoryNames), accessories.Count());
+    const std::vector<Uint32> materiaNames = interner.Intern(kernel.Text(KernelBin::eMateriaNames), materia.Count());
+    const std::vector<Uint32> attackNames = interner.Intern(kernel.Text(KernelBin::eMagicNames), attacks.Count());
+    const std::vector<char>& pool = interner.Pool();
+
+    ColumnArena arena;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1)
+        {
+            arena.Allocate(mArena);
+        }
+
+        BuildItems(arena, items, itemNames, mItems);
+        BuildWeapons(arena, weapons, weaponNames, mWeapons);
+        BuildArmor(arena, armor, armorNames, mArmor);
+        BuildAccessories(arena, accessories, accessoryNames, mAccessories);
+        BuildMateria(arena, materia, materiaNames, mMateria);
+        BuildAttacks(arena, attacks, attackNames, mAttacks);
+        BuildInventory(arena, mItems, mWeapons, mArmor, mAccessories, mInventory);
+
+        // Names go last as nothing after them needs aligning
+        char* names = arena.Carve<char>(pool.size());
+        mNames = names;
+        if (names)
+        {
+            memcpy(names, pool.data(), pool.size());
+        }
+    }
+    mArenaSize = arena.Size();
+    mDistinctNames = interner.Count();
+
+    LOG_INFO("Game database: " << mItems.count << " items, " << mWeapons.count << " weapons, " << mArmor.count << " armor, "
+        << mAccessories.count << " accessories, " << mMateria.count << " materia, " << mAttacks.count << " attacks, "
+        << mDistinctNames << " names in " << mArenaSize << " bytes");
+}
+
+InventoryRef GameDatabase::Find(Uint16 inventoryId) const
+{
+    if (inventoryId >= kInventoryIdCount)
+    {
+        return InventoryRef{ eInventoryNone, 0 };
+    }
+    return InventoryRef{ mInventory.kind[inventoryId], mInventory.row[inventoryId] };
+}
+
+Uint16 GameDatabase::InventoryId(eInventoryKind kind, Uint16 row) const
+{
+    return static_cast<Uint16>(kInventoryBase[kind] + row);
+}
@@ -1,6 +1,132 @@
+#include <chrono>
 #include "kernel/kernel.hpp"
+#include "kernel/accesslog.hpp"
+#include "kernel/field.hpp"
+#include "kernel/gamedatabase.hpp"
+#include "kernel/kernelbin.hpp"
+#include "kernel/lgp.hpp"
+#include "kernel/lgpcache.hpp"
+#include "kernel/texture.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static const char* kArchives[] =
+{
+    "field/char.lgp",
+    "field/flevel.lgp",
+    "battle/battle.lgp",
+    "battle/magic.lgp",
+    "menu/menu_us.lgp",
+    "wm/world_us.lgp",
+};
 
 Kernel::Kernel()
+    : mResources(mFileSystem)
+{
+    // Fields and battles switch palettes, so keep paletted textures indexed
+    Texture::SetLoader(mResources, eTextureIndexed, &mTextureDedup);
+}
+
+Kernel::~Kernel()
+{
+    if (mAccessLog)
+    {
+        mFileSystem.SetAccessLog(nullptr);
+        try
+        {
+            mAccessLog->Save(mAccessLogFile);
+            LOG_INFO("Saved " << mAccessLog->Scenes().size() << " scenes of file accesses to " << mAccessLogFile);
+        }
+        catch (const Exception& ex)
+        {
+            LOG_WARNING("Access log not saved: " << ex.what());
+        }
+    }
+}
+
+void Kernel::RecordAccesses(const std::string& logFile)
+{
+    if (!mAccessLog)
+    {
+        mAccessLog = std::make_unique<AccessLog>();
+        mFileSystem.SetAccessLog(mAccessLog.get());
+    }
+    mAccessLogFile = logFile;
+    LOG_INFO("Recording file accesses to " << logFile);
+}
+
+void Kernel::MountArchives(const std::string& dataPath, const std::string& indexCacheFile)
 {
+    const auto start = std::chrono::steady_clock::now();
+
+    LgpIndexCache cache(indexCacheFile);
+    for (const char* archive : kArchives)
+    {
+        const std::string path = dataPath + "/" + archive;
+        try
+        {
+            const std::string name = Lgp::NormalizeName(path.substr(path.find_last_of('/') + 1));
+            auto lgp = cache.Open(path);
+            mArchives[name] = lgp;
 
+            // char.lgp's files appear under char/ and so on
+            mFileSystem.MountLgp(lgp, name.substr(0, name.find('.')), 0);
+        }
+        catch (const Exception& ex)
+        {
+            LOG_WARNING("Skipping " << path << ": " << ex.what());
+        }
+    }
+
+    if (mArchives.count("flevel.lgp") && !mFields)
+    {
+        try
+        {
+            mFields = std::make_unique<FieldLoader>(mFileSystem, mResources, "flevel", &mTextureDedup);
+        }
+        catch (const Exception& ex)
+        {
+            LOG_WARNING("Fields can't be loaded: " << ex.what());
+        }
+    }
+
+    const size_t hits = cache.Hits();
+    const size_t misses = cache.Misses();
+    cache.Save();
+
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Mounted " << mArchives.size() << " archives in " << ms << "ms, "
+        << hits << " from the index cache and " << misses << " parsed (" << (misses > 0 ? "cold" : "warm") << " start)");
+}
+
+void Kernel::LoadKernelData(const std::string& dataPath)
+{
+    const std::string path = dataPath + "/kernel/";
+    try
+    {
+        Stream kernel(path + "KERNEL.BIN");
+
+        std::unique_ptr<Stream> kernel2;
+        try
+        {
+            kernel2 = std::make_unique<Stream>(path + "kernel2.bin");
+        }
+        catch (const Exception&)
+        {
+            LOG_INFO("No kernel2.bin, using KERNEL.BIN's text");
+        }
+
+        mKernelBin = std::make_unique<KernelBin>(kernel, kernel2.get(), mPool);
+        mDatabase = std::make_unique<GameDatabase>(*mKernelBin);
+    }
+    catch (const Exception& ex)
+    {
+        LOG_WARNING("Kernel data can't be loaded from " << path << ": " << ex.what());
+    }
+}
+
+std::shared_ptr<Lgp> Kernel::Archive(const std::string& name) const
+{
+    auto it = mArchives.find(Lgp::NormalizeName(name));
+    return it == std::end(mArchives) ? nullptr : it->second;
 }
@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+#include "kernel/kernelbin.hpp"
+#include "kernel/cookedpack.hpp"
+#include "kernel/lzss.hpp"
+#include "kernel/stream.hpp"
+#include "kernel/threadpool.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static_assert(HOST_IS_LITTLE_ENDIAN, "KERNEL.BIN records are used in place and need a little endian host");
+
+static const size_t kSectionHeaderSize = 6;
+static const size_t kArenaAlignment = 8;
+
+static size_t Align(size_t value)
+{
+    return (value + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+}
+
+static bool Inflate(const Uint8* data, size_t size, Uint8* dest, size_t destSize)
+{
+    z_stream stream = {};
+    stream.next_in = const_cast<Bytef*>(data);
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = dest;
+    stream.avail_out = static_cast<uInt>(destSize);
+
+    // 16 + window bits reads a gzip header rather than a zlib one
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+    {
+        return false;
+    }
+    const int ret = inflate(&stream, Z_FINISH);
+    const bool ok = ret == Z_STREAM_END && stream.total_out == destSize;
+    inflateEnd(&stream);
+    return ok;
+}
+
+KernelText::KernelText(const Uint8* data, size_t size)
+    : mData(data), mSize(size), mCount(0)
+{
+    // The first offset says where the strings start and so how many offsets there are
+    if (size >= sizeof(Uint16))
+    {
+        Uint16 first = 0;
+        memcpy(&first, data, sizeof(first));
+        mCount = std::min<size_t>(first, size) / sizeof(Uint16);
+    }
+}
+
+void KernelText::String(size_t index, const Uint8*& data, size_t& size) const
+{
+    data = nullptr;
+    size = 0;
+    if (index >= mCount)
+    {
+        return;
+    }
+
+    Uint16 offset = 0;
+    memcpy(&offset, mData + index * sizeof(Uint16), sizeof(offset));
+    if (offset >= mSize)
+    {
+        return;
+    }
+
+    data = mData + offset;
+    const Uint8* end = static_cast<const Uint8*>(memchr(data, 0xFF, mSize - offset));
+    size = end ? end - data : mSize - offset;
+}
+
+std::string KernelText::Decoded(size_t index) const
+{
+    const Uint8* data = nullptr;
+    size_t size = 0;
+    String(index, data, size);
+
+    // FF7's characters are ASCII less 0x20 up to '~', from 0xE0 on are control codes
+    std::string text;
+    text.reserve(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        const Uint8 c = data[i];
+        if (c <= '~' - 0x20)
+        {
+            text += static_cast<char>(c + 0x20);
+        }
+        else if (c < 0xE0)
+        {
+            text += '?';
+        }
+    }
+    return text;
+}
+
+KernelBin::KernelBin(Stream& kernel, Stream* kernel2, ThreadPool& pool)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    struct Job
+    {
+        const Uint8* data;
+        size_t size;
+        size_t offset;
+        size_t decodedSize;
+        bool lzss;
+        bool stored;
+        double seconds;
+    };
+    std::vector<Job> jobs;
+
+    // One pass over the headers to find every section and how big it will be
+    kernel.Seek(0);
+    const bool cooked = CookedPack::IsCooked(kernel, eCookedKernelBin);
+    const size_t begin = kernel.Pos();
+    StreamReader& reader = kernel.Reader();
+    reader.Seek(begin);
+    size_t arenaSize = 0;
+    size_t section = 0;
+    while (reader.Remaining() >= kSectionHeaderSize && section < eSectionCount)
+    {
+        const Uint16 compressedSize = reader.U16();
+        const Uint16 size = reader.U16();
+        reader.U16();   // Section number
+
+        Job job = {};
+        if (reader.ReadView(job.data, compressedSize) != eReadOk)
+        {
+            LOG_ERROR("KERNEL.BIN section " << section << " is truncated in " << kernel.Name());
+            throw Exception("Truncated KERNEL.BIN section");
+        }
+        job.size = compressedSize;
+        job.offset = arenaSize;
+        job.decodedSize = size;
+        job.stored = cooked;
+        if (cooked && compressedSize != size)
+        {
+            throw Exception("Corrupt cooked KERNEL.BIN");
+        }
+        jobs.push_back(job);
+
+        mSections[section++] = SectionInfo{ arenaSize, size };
+        arenaSize = Align(arenaSize + size);
+    }
+
+    // KERNEL2.BIN is one LZSS stream, the scan for its size is quick next to decoding it
+    if (kernel2)
+    {
+        kernel2->Seek(0);
+        Job job = {};
+        if (CookedPack::IsCooked(*kernel2, eCookedDecompressed))
+        {
+            job.size = kernel2->Size() - kernel2->Pos();
+            job.data = kernel2->ReadView(job.size);
+            job.decodedSize = job.size;
+            job.stored = true;
+        }
+        else
+        {
+            StreamReader& reader2 = kernel2->Reader();
+            reader2.Seek(0);
+            Uint32 compressedSize = 0;
+            if (reader2.Read(compressedSize) != eReadOk || reader2.ReadView(job.data, compressedSize) != eReadOk)
+            {
+                LOG_ERROR(kernel2->Name() << " is truncated");
+                throw Exception("Truncated KERNEL2.BIN");
+            }
+            job.size = compressedSize;
+            job.decodedSize = Lzss::DecompressedSize(job.data, job.size);
+            job.lzss = true;
+        }
+        job.offset = arenaSize;
+        jobs.push_back(job);
+        arenaSize = Align(arenaSize + job.decodedSize);
+    }
+
+    mArena.reset(new Uint8[std::max<size_t>(arenaSize, 1)]);
+    mArenaSize = arenaSize;
+
+    pool.ParallelFor(jobs.size(), [this, &jobs](size_t i)
+    {
+        const auto jobStart = std::chrono::steady_clock::now();
+        Job& job = jobs[i];
+        Uint8* dest = mArena.get() + job.offset;
+        if (job.stored)
+        {
+            memcpy(dest, job.data, job.size);
+        }
+        else if (job.lzss)
+        {
+            if (Lzss::Decompress(job.data, job.size, dest, job.decodedSize) != job.decodedSize)
+            {
+                throw Exception("Corrupt KERNEL2.BIN");
+            }
+        }
+        else if (!Inflate(job.data, job.size, dest, job.decodedSize))
+        {
+            throw Exception("Corrupt KERNEL.BIN section");
+        }
+        job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count();
+    });
+
+    // KERNEL2.BIN's text sections are each behind a u32 size
+    if (kernel2)
+    {
+        const Job& job = jobs.back();
+        size_t pos = 0;
+        for (size_t text = eCommandHelp; text < eSectionCount && pos + sizeof(Uint32) <= job.decodedSize; text++)
+        {
+            Uint32 size = 0;
+            memcpy(&size, mArena.get() + job.offset + pos, sizeof(size));
+            pos += sizeof(Uint32);
+            if (size > job.decodedSize - pos)
+            {
+                throw Exception("Corrupt KERNEL2.BIN section table");
+            }
+            mSections[text] = SectionInfo{ job.offset + pos, size };
+            pos += size;
+        }
+    }
+
+    double longest = 0.0;
+    for (const Job& job : jobs)
+    {
+        longest = std::max(longest, job.seconds);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Decoded " << jobs.size() << " kernel sections, " << arenaSize << " bytes in " << seconds * 1000.0
+        << " ms, the longest section took " << longest * 1000.0 << " ms");
+}
+
+std::vector<Uint8> KernelBin::Cook(Stream& kernel)
+{
+    std::vector<Uint8> cooked = CookedPack::MakeCooked(eCookedKernelBin, 0);
+    StreamReader& reader = kernel.Reader();
+    reader.Seek(0);
+    while (reader.Remaining() >= kSectionHeaderSize)
+    {
+        const Uint16 compressedSize = reader.U16();
+        const Uint16 size = reader.U16();
+        const Uint16 number = reader.U16();
+        const Uint8* data = nullptr;
+        if (reader.ReadView(data, compressedSize) != eReadOk)
+        {
+            LOG_ERROR("KERNEL.BIN section is truncated in " << kernel.Name());
+            throw Exception("Truncated KERNEL.BIN section");
+        }
+
+        // The header as the game has it but with the stored size for both sizes
+        const Uint16 header[] = { size, size, number };
+        const size_t pos = cooked.size();
+        cooked.resize(pos + kSectionHeaderSize + size);
+        memcpy(&cooked[pos], header, kSectionHeaderSize);
+        if (!Inflate(data, compressedSize, cooked.data() + pos + kSectionHeaderSize, size))
+        {
+            throw Exception("Corrupt KERNEL.BIN section");
+        }
+    }
+    return cooked;
+}
+
+const Uint8* KernelBin::Section(eSection section, size_t& size) const
+{
+    size = mSections[section].size;
+    return mArena.get() + mSections[section].offset;
+}
+
+KernelText KernelBin::Text(eSection section) const
+{
+    size_t size = 0;
+    const Uint8* data = Section(section, size);
+    return KernelText(data, size);
+}
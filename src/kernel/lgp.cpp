@@ -1 +1,281 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include "kernel/lgp.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static const size_t kCreatorSize = 12;
+static const size_t kTocEntrySize = 27;
+static const size_t kTocNameSize = 20;
+static const size_t kConflictNameSize = 128;
+
+static std::string ReadName(StreamReader& reader, size_t size)
+{
+    const char* p = reinterpret_cast<const char*>(reader.Cur());
+    reader.Skip(size);
+    return std::string(p, strnlen(p, size));
+}
+
+Lgp::Lgp(const std::string& fileName)
+    : mStream(fileName)
+{
+    ReadToc();
+}
+
+Lgp::Lgp(Stream&& stream)
+    : mStream(std::move(stream))
+{
+    ReadToc();
+}
+
+Lgp::Lgp(Stream&& stream, const Index& index, const std::shared_ptr<const void>& owner)
+    : mStream(std::move(stream)), mIndex(index), mIndexOwner(owner)
+{
+
+}
+
+std::string Lgp::NormalizeName(const std::string& name)
+{
+    std::string ret = name;
+    for (char& c : ret)
+    {
+        c = c == '\\' ? '/' : static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    }
+    return ret;
+}
+
+static int LookupValue(char c)
+{
+    c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    if (c == '.')
+    {
+        return -1;
+    }
+
+    if (c >= '0' && c <= '9')
+    {
+        c = static_cast<char>(c - '0' + 'a');
+    }
+    else if (c == '_')
+    {
+        c = 'k';
+    }
+    else if (c == '-')
+    {
+        c = 'l';
+    }
+    return c - 'a';
+}
+
+int Lgp::LookupIndex(const std::string& name)
+{
+    // Conflicting names are filed under their plain name
+    const size_t slash = name.find_last_of("/\\");
+    const std::string file = slash == std::string::npos ? name : name.substr(slash + 1);
+    if (file.size() < 2)
+    {
+        return -1;
+    }
+
+    const int index = LookupValue(file[0]) * static_cast<int>(kLookupValueMax) + LookupValue(file[1]) + 1;
+    return index >= 0 && index < static_cast<int>(kLookupTableSize) ? index : -1;
+}
+
+void Lgp::ReadToc()
+{
+    StreamReader& reader = mStream.Reader();
+    reader.Seek(0);
+
+    Uint32 count = 0;
+    if (reader.Skip(kCreatorSize) != eReadOk || reader.Read(count) != eReadOk)
+    {
+        LOG_ERROR("Truncated LGP header in " << mStream.Name());
+        throw Exception("Truncated LGP header");
+    }
+
+    const size_t lookupSize = kLookupTableSize * sizeof(LookupEntry);
+    if (!reader.Has(count * kTocEntrySize + lookupSize + sizeof(Uint16)))
+    {
+        LOG_ERROR("Truncated LGP table of contents in " << mStream.Name());
+        throw Exception("Truncated LGP table of contents");
+    }
+
+    // The whole TOC and lookup table were checked above
+    std::vector<std::string> names(count);
+    mEntries.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        names[i] = NormalizeName(ReadName(reader, kTocNameSize));
+        mEntries[i].offset = reader.U32();
+        reader.U8();
+        mEntries[i].conflict = reader.U16();
+    }
+
+    std::vector<LookupEntry> lookupTable(kLookupTableSize);
+    for (LookupEntry& lookup : lookupTable)
+    {
+        lookup.tocIndex = reader.U16();
+        lookup.count = reader.U16();
+    }
+
+    // Files that share a name are told apart by their folder
+    const Uint16 conflictCount = reader.U16();
+    for (Uint16 i = 0; i < conflictCount; i++)
+    {
+        Uint16 pathCount = 0;
+        if (reader.Read(pathCount) != eReadOk || !reader.Has(pathCount * (kConflictNameSize + sizeof(Uint16))))
+        {
+            throw Exception("Truncated LGP conflict table");
+        }
+
+        for (Uint16 j = 0; j < pathCount; j++)
+        {
+            const std::string path = NormalizeName(ReadName(reader, kConflictNameSize));
+            const Uint16 tocIndex = reader.U16();
+            if (tocIndex < count && mEntries[tocIndex].conflict == i + 1u && !path.empty())
+            {
+                names[tocIndex] = path + "/" + names[tocIndex];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Uint64 hash = AssetId::Hash(names[i].data(), names[i].size());
+        mEntries[i].nameOffset = static_cast<Uint32>(mNames.size());
+        mEntries[i].nameLength = static_cast<Uint32>(names[i].size());
+        mEntries[i].hashLow = static_cast<Uint32>(hash);
+        mEntries[i].hashHigh = static_cast<Uint32>(hash >> 32);
+        mNames += names[i];
+    }
+
+    mIndex.entries = mEntries.data();
+    mIndex.entryCount = mEntries.size();
+    mIndex.names = mNames.data();
+    mIndex.namesSize = mNames.size();
+
+    // Walk the archive's own buckets so entries go in grouped the same way, then
+    // catch anything the table didn't cover
+    std::vector<Uint32> order;
+    order.reserve(count);
+    for (const LookupEntry& lookup : lookupTable)
+    {
+        for (size_t i = 0; lookup.tocIndex != 0 && i < lookup.count; i++)
+        {
+            order.push_back(static_cast<Uint32>(lookup.tocIndex - 1 + i));
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        order.push_back(static_cast<Uint32>(i));
+    }
+    BuildHash(order);
+}
+
+void Lgp::BuildHash(const std::vector<Uint32>& order)
+{
+    size_t capacity = 16;
+    while (capacity < mIndex.entryCount * 2)
+    {
+        capacity *= 2;
+    }
+    mSlots.assign(capacity, 0);
+
+    std::vector<bool> inserted(mIndex.entryCount, false);
+    for (const Uint32 index : order)
+    {
+        if (index >= mIndex.entryCount || inserted[index])
+        {
+            continue;
+        }
+        inserted[index] = true;
+
+        const TocEntry& entry = mIndex.entries[index];
+        const AssetId id = entry.Id();
+        size_t slot = id.Value() & (capacity - 1);
+        while (mSlots[slot] != 0 && mIndex.entries[mSlots[slot] - 1].Id() != id)
+        {
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        if (mSlots[slot] != 0)
+        {
+            const std::string name = EntryName(index);
+            if (NameEquals(mSlots[slot] - 1, name.data(), name.size()))
+            {
+                LOG_WARNING("Duplicate entry " << name << " in " << mStream.Name());
+            }
+            else
+            {
+                LOG_ERROR("Asset id collision between " << name << " and " << EntryName(mSlots[slot] - 1) << " in " << mStream.Name());
+            }
+            continue;
+        }
+        mSlots[slot] = index + 1;
+    }
+
+    mIndex.slots = mSlots.data();
+    mIndex.slotCount = mSlots.size();
+}
+
+std::string Lgp::EntryName(size_t index) const
+{
+    const TocEntry& entry = mIndex.entries[index];
+    return std::string(mIndex.names + entry.nameOffset, entry.nameLength);
+}
+
+bool Lgp::NameEquals(size_t index, const char* name, size_t length) const
+{
+    const TocEntry& entry = mIndex.entries[index];
+    return entry.nameLength == length && memcmp(mIndex.names + entry.nameOffset, name, length) == 0;
+}
+
+size_t Lgp::Find(AssetId id) const
+{
+    // Ids are unique within the archive, that was checked when the hash was built
+    const size_t mask = mIndex.slotCount - 1;
+    size_t slot = id.Value() & mask;
+    while (mIndex.slots[slot] != 0)
+    {
+        const size_t index = mIndex.slots[slot] - 1;
+        if (mIndex.entries[index].Id() == id)
+        {
+            return index;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return kNotFound;
+}
+
+Uint32 Lgp::EntrySize(size_t index) const
+{
+    if (index >= mIndex.entryCount)
+    {
+        throw Exception("LGP entry index out of range");
+    }
+
+    Stream header = mStream.Slice(mIndex.entries[index].offset, kDataHeaderSize);
+    Uint32 size = 0;
+    header.Seek(kTocNameSize);
+    header.ReadUInt32(size);
+    return size;
+}
+
+Stream Lgp::Open(size_t index) const
+{
+    const Uint32 size = EntrySize(index);
+    return mStream.Slice(EntryDataOffset(index), size);
+}
+
+Stream Lgp::Open(AssetId id) const
+{
+    const size_t index = Find(id);
+    if (index == kNotFound)
+    {
+        LOG_ERROR("No entry " << AssetId::Name(id) << " in " << mStream.Name());
+        throw Exception("LGP entry not found");
+    }
+    return Open(index);
+}
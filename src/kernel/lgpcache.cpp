@@ -0,0 +1,266 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+#include "kernel/lgpcache.hpp"
+#include "kernel/lgp.hpp"
+#include "kernel/mappedfile.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static const Uint32 kMagic = 0x58494737; // "7GIX"
+static const Uint32 kByteOrderMark = 0x01020304;
+static const Uint32 kVersion = 3;
+
+struct CacheHeader
+{
+    Uint32 magic;
+    Uint32 byteOrder;
+    Uint32 version;
+    Uint32 recordCount;
+};
+
+// Followed by the path, TocEntry array, slot array and names, each padded to 8 bytes
+struct RecordHeader
+{
+    Uint32 recordSize;
+    Uint32 pathLength;
+    Uint32 entryCount;
+    Uint32 slotCount;
+    Uint32 namesSize;
+    Uint32 reserved;
+    Uint64 archiveSize;
+    Uint64 modifiedTime; // Nanoseconds, whole seconds would miss a rewrite within the same second
+};
+
+static size_t Pad(size_t size)
+{
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+static bool StatFile(const std::string& fileName, Uint64& size, Uint64& modifiedTime)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info = {};
+    if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &info))
+    {
+        return false;
+    }
+    size = static_cast<Uint64>(info.nFileSizeHigh) << 32 | info.nFileSizeLow;
+    const Uint64 ticks = static_cast<Uint64>(info.ftLastWriteTime.dwHighDateTime) << 32 | info.ftLastWriteTime.dwLowDateTime;
+    modifiedTime = ticks * 100;
+#else
+    struct stat info = {};
+    if (stat(fileName.c_str(), &info) != 0)
+    {
+        return false;
+    }
+    size = static_cast<Uint64>(info.st_size);
+#ifdef __APPLE__
+    const timespec& modified = info.st_mtimespec;
+#else
+    const timespec& modified = info.st_mtim;
+#endif
+    modifiedTime = static_cast<Uint64>(modified.tv_sec) * 1000000000 + static_cast<Uint64>(modified.tv_nsec);
+#endif
+    return true;
+}
+
+// The cache file may be damaged, nothing in it is used before it has been checked
+static bool ValidIndex(const Lgp::Index& index, Uint64 archiveSize)
+{
+    if (index.slotCount == 0 || (index.slotCount & (index.slotCount - 1)) != 0 || index.slotCount < index.entryCount + 1)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < index.slotCount; i++)
+    {
+        if (index.slots[i] > index.entryCount)
+        {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < index.entryCount; i++)
+    {
+        const Lgp::TocEntry& entry = index.entries[i];
+        if (static_cast<Uint64>(entry.nameOffset) + entry.nameLength > index.namesSize || entry.offset >= archiveSize)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+LgpIndexCache::LgpIndexCache(const std::string& fileName)
+    : mFileName(fileName)
+{
+    Load();
+}
+
+LgpIndexCache::~LgpIndexCache()
+{
+
+}
+
+void LgpIndexCache::Load()
+{
+    auto mapping = std::make_shared<MappedFile>();
+    if (!mapping->Open(mFileName))
+    {
+        // First run
+        return;
+    }
+
+    CacheHeader header = {};
+    if (mapping->Size() < sizeof(header))
+    {
+        return;
+    }
+    memcpy(&header, mapping->Data(), sizeof(header));
+    if (header.magic != kMagic || header.byteOrder != kByteOrderMark || header.version != kVersion)
+    {
+        LOG_WARNING("Ignoring stale LGP index cache " << mFileName);
+        return;
+    }
+
+    size_t pos = sizeof(header);
+    for (Uint32 i = 0; i < header.recordCount; i++)
+    {
+        RecordHeader record = {};
+        if (mapping->Size() - pos < sizeof(record))
+        {
+            break;
+        }
+        memcpy(&record, mapping->Data() + pos, sizeof(record));
+
+        const size_t expected = sizeof(record) + Pad(record.pathLength) + Pad(record.entryCount * sizeof(Lgp::TocEntry))
+            + Pad(record.slotCount * sizeof(Uint32)) + Pad(record.namesSize);
+        if (record.recordSize != expected || mapping->Size() - pos < expected)
+        {
+            LOG_WARNING("Truncated LGP index cache " << mFileName);
+            break;
+        }
+
+        const char* path = reinterpret_cast<const char*>(mapping->Data() + pos + sizeof(record));
+        mRecords[std::string(path, record.pathLength)] = mapping->Data() + pos;
+        pos += expected;
+    }
+    mMapping = std::move(mapping);
+}
+
+std::shared_ptr<Lgp> LgpIndexCache::Open(const std::string& archivePath)
+{
+    Opened opened;
+    opened.path = archivePath;
+    if (!StatFile(archivePath, opened.size, opened.modifiedTime))
+    {
+        LOG_ERROR("File not found " << archivePath);
+        throw Exception("File not found");
+    }
+
+    auto it = mRecords.find(archivePath);
+    if (it != std::end(mRecords))
+    {
+        RecordHeader record = {};
+        memcpy(&record, it->second, sizeof(record));
+        if (record.archiveSize == opened.size && record.modifiedTime == opened.modifiedTime)
+        {
+            const Uint8* p = it->second + sizeof(record) + Pad(record.pathLength);
+            Lgp::Index index = {};
+            index.entries = reinterpret_cast<const Lgp::TocEntry*>(p);
+            index.entryCount = record.entryCount;
+            p += Pad(record.entryCount * sizeof(Lgp::TocEntry));
+            index.slots = reinterpret_cast<const Uint32*>(p);
+            index.slotCount = record.slotCount;
+            p += Pad(record.slotCount * sizeof(Uint32));
+            index.names = reinterpret_cast<const char*>(p);
+            index.namesSize = record.namesSize;
+
+            if (ValidIndex(index, opened.size))
+            {
+                opened.archive = std::make_shared<Lgp>(Stream(archivePath), index, mMapping);
+                mOpened.push_back(opened);
+                mHits++;
+                return opened.archive;
+            }
+            LOG_WARNING("Corrupt LGP index cache record for " << archivePath << ", parsing the archive");
+        }
+    }
+
+    opened.archive = std::make_shared<Lgp>(archivePath);
+    mOpened.push_back(opened);
+    mMisses++;
+    return opened.archive;
+}
+
+static void WritePadded(std::ofstream& out, const void* data, size_t size)
+{
+    static const char kZeros[8] = {};
+    out.write(static_cast<const char*>(data), size);
+    out.write(kZeros, Pad(size) - size);
+}
+
+void LgpIndexCache::Save()
+{
+    if (mMisses == 0)
+    {
+        return;
+    }
+
+    const std::string tempName = mFileName + ".tmp";
+    {
+        std::ofstream out(tempName, std::ios::out | std::ios::binary | std::ios::trunc);
+        CacheHeader header = { kMagic, kByteOrderMark, kVersion, static_cast<Uint32>(mOpened.size()) };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (const Opened& opened : mOpened)
+        {
+            const Lgp::Index& index = opened.archive->GetIndex();
+            RecordHeader record = {};
+            record.pathLength = static_cast<Uint32>(opened.path.size());
+            record.entryCount = static_cast<Uint32>(index.entryCount);
+            record.slotCount = static_cast<Uint32>(index.slotCount);
+            record.namesSize = static_cast<Uint32>(index.namesSize);
+            record.archiveSize = opened.size;
+            record.modifiedTime = opened.modifiedTime;
+            record.recordSize = static_cast<Uint32>(sizeof(record) + Pad(record.pathLength) + Pad(record.entryCount * sizeof(Lgp::TocEntry))
+                + Pad(record.slotCount * sizeof(Uint32)) + Pad(record.namesSize));
+
+            out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+            WritePadded(out, opened.path.data(), opened.path.size());
+            WritePadded(out, index.entries, index.entryCount * sizeof(Lgp::TocEntry));
+            WritePadded(out, index.slots, index.slotCount * sizeof(Uint32));
+            WritePadded(out, index.names, index.namesSize);
+        }
+
+        if (!out)
+        {
+            LOG_WARNING("Failed to write LGP index cache " << tempName);
+            return;
+        }
+    }
+
+    // Archives opened from the old cache keep their own reference to its mapping
+    mMapping.reset();
+    mRecords.clear();
+
+    // Replaced in one step, a crash part way leaves the old cache or the new one
+#ifdef _WIN32
+    if (!MoveFileExA(tempName.c_str(), mFileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+    if (rename(tempName.c_str(), mFileName.c_str()) != 0)
+#endif
+    {
+        LOG_WARNING("Failed to replace LGP index cache " << mFileName);
+        return;
+    }
+    mMisses = 0;
+}
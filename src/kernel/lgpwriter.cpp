@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include "kernel/lgpwriter.hpp"
+#include "kernel/lgp.hpp"
+#include "kernel/mappedfile.hpp"
+#include "kernel/threadpool.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static const size_t kTocEntrySize = 27;
+static const size_t kTocNameSize = 20;
+static const size_t kConflictNameSize = 128;
+static const char kCreator[12] = { 0, 0, 'S', 'Q', 'U', 'A', 'R', 'E', 'S', 'O', 'F', 'T' };
+static const char kTerminator[] = "FINAL FANTASY7";
+
+template<typename T>
+static Uint8* Put(Uint8* p, T value)
+{
+    BinaryLayoutToHost(&value, 1);
+    memcpy(p, &value, sizeof(T));
+    return p + sizeof(T);
+}
+
+static Uint8* PutName(Uint8* p, const std::string& name, size_t size)
+{
+    memset(p, 0, size);
+    name.copy(reinterpret_cast<char*>(p), size);
+    return p + size;
+}
+
+void LgpWriter::Add(const std::string& name, Stream&& data)
+{
+    const std::string normalized = Lgp::NormalizeName(name);
+    const size_t slash = normalized.find_last_of('/');
+
+    Entry entry = { normalized.substr(slash == std::string::npos ? 0 : slash + 1),
+                    slash == std::string::npos ? std::string() : normalized.substr(0, slash),
+                    std::move(data), 0, 0 };
+    if (entry.name.size() > kTocNameSize || entry.path.size() > kConflictNameSize)
+    {
+        LOG_ERROR("Name too long for an LGP " << name);
+        throw Exception("LGP entry name too long");
+    }
+
+    if (entry.data.Size() > 0xFFFFFFFF)
+    {
+        throw Exception("LGP entry too big");
+    }
+    mEntries.emplace_back(std::move(entry));
+}
+
+size_t LgpWriter::Write(const std::string& fileName, ThreadPool& pool)
+{
+    if (mEntries.size() > 0xFFFF)
+    {
+        throw Exception("Too many entries for an LGP");
+    }
+
+    // The lookup table needs entries grouped by bucket, names that don't hash go last
+    std::vector<size_t> toc(mEntries.size());
+    for (size_t i = 0; i < toc.size(); i++)
+    {
+        toc[i] = i;
+    }
+
+    auto bucket = [this](size_t i)
+    {
+        const int index = Lgp::LookupIndex(mEntries[i].name);
+        return index < 0 ? static_cast<int>(Lgp::kLookupTableSize) : index;
+    };
+    std::sort(toc.begin(), toc.end(), [this, &bucket](size_t a, size_t b)
+    {
+        const int bucketA = bucket(a);
+        const int bucketB = bucket(b);
+        if (bucketA != bucketB)
+        {
+            return bucketA < bucketB;
+        }
+        return mEntries[a].name != mEntries[b].name ? mEntries[a].name < mEntries[b].name : mEntries[a].path < mEntries[b].path;
+    });
+
+    // Files sharing a name, or kept in a folder, go in the conflict table
+    std::map<std::string, std::vector<size_t>> byName;
+    for (size_t tocIndex = 0; tocIndex < toc.size(); tocIndex++)
+    {
+        byName[mEntries[toc[tocIndex]].name].push_back(tocIndex);
+    }
+
+    std::vector<std::vector<size_t>> conflicts;
+    for (auto& group : byName)
+    {
+        const bool hasPath = std::any_of(group.second.begin(), group.second.end(), [this, &toc](size_t t) { return !mEntries[toc[t]].path.empty(); });
+        if (group.second.size() > 1 || hasPath)
+        {
+            for (const size_t tocIndex : group.second)
+            {
+                mEntries[toc[tocIndex]].conflict = static_cast<Uint16>(conflicts.size() + 1);
+            }
+            conflicts.push_back(group.second);
+        }
+    }
+
+    if (conflicts.size() > 0xFFFF)
+    {
+        throw Exception("Too many LGP conflicts");
+    }
+
+    size_t size = sizeof(kCreator) + sizeof(Uint32) + mEntries.size() * kTocEntrySize + Lgp::kLookupTableSize * 2 * sizeof(Uint16) + sizeof(Uint16);
+    for (const auto& conflict : conflicts)
+    {
+        size += sizeof(Uint16) + conflict.size() * (kConflictNameSize + sizeof(Uint16));
+    }
+
+    const size_t alignment = std::max<size_t>(mAlignment, 1);
+    std::vector<bool> placed(mEntries.size(), false);
+    auto place = [this, &size, &placed](size_t index)
+    {
+        if (index >= mEntries.size() || placed[index])
+        {
+            throw Exception("LGP data groups must name each entry at most once");
+        }
+        placed[index] = true;
+        mEntries[index].offset = size;
+        size += Lgp::kDataHeaderSize + mEntries[index].data.Size();
+    };
+
+    for (const std::vector<size_t>& group : mGroups)
+    {
+        size = (size + alignment - 1) / alignment * alignment;
+        for (const size_t index : group)
+        {
+            place(index);
+        }
+    }
+
+    if (!mGroups.empty())
+    {
+        size = (size + alignment - 1) / alignment * alignment;
+    }
+
+    for (const size_t index : toc)
+    {
+        if (!placed[index])
+        {
+            place(index);
+        }
+    }
+    size += sizeof(kTerminator) - 1;
+
+    if (size > 0xFFFFFFFF)
+    {
+        throw Exception("LGP archive would be over 4GB");
+    }
+
+    MappedFile out;
+    if (!out.Create(fileName, size))
+    {
+        LOG_ERROR("Failed to create " << fileName);
+        throw Exception("Failed to create LGP");
+    }
+    Uint8* base = out.MutableData();
+
+    // Entry data first, each job owns its entry's source stream and output range
+    pool.ParallelFor(mEntries.size(), [this, base](size_t i)
+    {
+        Entry& entry = mEntries[i];
+        Uint8* p = PutName(base + entry.offset, entry.name, kTocNameSize);
+        const size_t dataSize = entry.data.Size();
+        p = Put(p, static_cast<Uint32>(dataSize));
+
+        entry.data.Seek(0);
+        if (dataSize > 0)
+        {
+            memcpy(p, entry.data.ReadView(dataSize), dataSize);
+        }
+    });
+
+    // Then the tables for the final layout
+    Uint8* p = base;
+    memcpy(p, kCreator, sizeof(kCreator));
+    p = Put(p + sizeof(kCreator), static_cast<Uint32>(mEntries.size()));
+
+    std::vector<Uint16> lookup(Lgp::kLookupTableSize * 2, 0);
+    for (size_t tocIndex = 0; tocIndex < toc.size(); tocIndex++)
+    {
+        const Entry& entry = mEntries[toc[tocIndex]];
+        p = PutName(p, entry.name, kTocNameSize);
+        p = Put(p, static_cast<Uint32>(entry.offset));
+        p = Put(p, static_cast<Uint8>(14));
+        p = Put(p, entry.conflict);
+
+        const int index = Lgp::LookupIndex(entry.name);
+        if (index >= 0)
+        {
+            if (lookup[index * 2] == 0)
+            {
+                lookup[index * 2] = static_cast<Uint16>(tocIndex + 1);
+            }
+            lookup[index * 2 + 1]++;
+        }
+    }
+
+    for (const Uint16 value : lookup)
+    {
+        p = Put(p, value);
+    }
+
+    p = Put(p, static_cast<Uint16>(conflicts.size()));
+    for (const auto& conflict : conflicts)
+    {
+        p = Put(p, static_cast<Uint16>(conflict.size()));
+        for (const size_t tocIndex : conflict)
+        {
+            p = PutName(p, mEntries[toc[tocIndex]].path, kConflictNameSize);
+            p = Put(p, static_cast<Uint16>(tocIndex));
+        }
+    }
+
+    memcpy(base + size - (sizeof(kTerminator) - 1), kTerminator, sizeof(kTerminator) - 1);
+    return size;
+}
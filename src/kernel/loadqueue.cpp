@@ -0,0 +1,341 @@
+#include <algorithm>
+#include "kernel/loadqueue.hpp"
+#include "kernel/filesystem.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+struct LoadJob
+{
+    AssetId id;
+    eLoadPriority priority;
+    Uint32 tag;
+    LoadQueue::Decoder decoder;
+    LoadQueue::Completion completion;
+    std::atomic<int> state;
+    std::atomic<bool> cancelled;
+
+    // Handed from stage to stage, only one stage touches them at a time
+    std::vector<Uint8> data;
+    std::shared_ptr<const void> result;
+};
+
+eLoadState LoadHandle::State() const
+{
+    if (!mJob)
+    {
+        return eLoadFailed;
+    }
+    return mJob->cancelled ? eLoadCancelled : static_cast<eLoadState>(mJob->state.load());
+}
+
+bool LoadHandle::IsDone() const
+{
+    const eLoadState state = State();
+    return state == eLoadReady || state == eLoadFailed || state == eLoadCancelled;
+}
+
+AssetId LoadHandle::Id() const
+{
+    return mJob ? mJob->id : AssetId();
+}
+
+void LoadHandle::Cancel()
+{
+    if (mJob)
+    {
+        mJob->cancelled = true;
+    }
+}
+
+std::shared_ptr<const void> LoadHandle::Result() const
+{
+    // result is written before state is published as ready
+    return State() == eLoadReady ? mJob->result : nullptr;
+}
+
+LoadQueue::LoadQueue(FileSystem& fileSystem, size_t maxReads, size_t threadCount)
+    : mFileSystem(fileSystem), mMaxReads(std::max<size_t>(maxReads, 1)), mPool(threadCount)
+{
+
+}
+
+LoadQueue::~LoadQueue()
+{
+    CancelAll();
+    IssueReads();
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mFinished.wait(lock, [this]() { return mActive.empty(); });
+}
+
+LoadHandle LoadQueue::Load(AssetId id, eLoadPriority priority, Decoder decoder, Completion completion, Uint32 tag)
+{
+    auto job = std::make_shared<LoadJob>();
+    job->id = id;
+    job->priority = priority < eLoadPriorityCount ? priority : eLoadPrefetch;
+    job->tag = tag;
+    job->decoder = std::move(decoder);
+    job->completion = std::move(completion);
+    job->state = eLoadQueued;
+    job->cancelled = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWaiting[job->priority].push_back(job);
+        mActive.push_back(job);
+    }
+    IssueReads();
+    return LoadHandle(job);
+}
+
+void LoadQueue::Cancel(Uint32 tag)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& job : mActive)
+    {
+        if (job->tag == tag)
+        {
+            job->cancelled = true;
+        }
+    }
+
+    // Finished but not polled yet
+    for (const auto& job : mCompleted)
+    {
+        if (job->tag == tag)
+        {
+            job->cancelled = true;
+        }
+    }
+}
+
+void LoadQueue::CancelAll()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& job : mActive)
+    {
+        job->cancelled = true;
+    }
+    for (const auto& job : mCompleted)
+    {
+        job->cancelled = true;
+    }
+}
+
+std::shared_ptr<LoadJob> LoadQueue::PopBest(std::deque<std::shared_ptr<LoadJob>>* queues)
+{
+    for (int i = 0; i < eLoadPriorityCount; i++)
+    {
+        if (!queues[i].empty())
+        {
+            auto job = queues[i].front();
+            queues[i].pop_front();
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void LoadQueue::IssueReads()
+{
+    std::vector<std::shared_ptr<LoadJob>> toStart;
+    std::vector<std::shared_ptr<LoadJob>> toDrop;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        while (mReadsInFlight < mMaxReads)
+        {
+            auto job = PopBest(mWaiting);
+            if (!job)
+            {
+                break;
+            }
+
+            if (job->cancelled)
+            {
+                toDrop.push_back(job);
+                continue;
+            }
+            mReadsInFlight++;
+            toStart.push_back(job);
+        }
+    }
+
+    for (const auto& job : toDrop)
+    {
+        Finish(job, eLoadCancelled);
+    }
+
+    for (const auto& job : toStart)
+    {
+        StartRead(job);
+    }
+}
+
+void LoadQueue::StartRead(const std::shared_ptr<LoadJob>& job)
+{
+    job->state = eLoadReading;
+
+    std::string fileName;
+    size_t offset = 0;
+    size_t size = 0;
+    bool stored = false;
+    if (!mFileSystem.Locate(job->id, fileName, offset, size, stored))
+    {
+        LOG_ERROR("File not found " << AssetId::Name(job->id));
+        OnRead(job, std::vector<Uint8>(), false);
+        return;
+    }
+
+    if (!stored)
+    {
+        // The layer has to decompress it, do that on a worker instead of the IO thread
+        mPool.Post([this, job]()
+        {
+            try
+            {
+                Stream stream = mFileSystem.Open(job->id);
+                std::vector<Uint8> data(stream.Size());
+                stream.ReadBytes(data.data(), data.size());
+                OnRead(job, std::move(data), true);
+            }
+            catch (const std::exception& ex)
+            {
+                LOG_ERROR("Failed to open " << AssetId::Name(job->id) << ": " << ex.what());
+                OnRead(job, std::vector<Uint8>(), false);
+            }
+        });
+        return;
+    }
+
+    if (size == 0)
+    {
+        OnRead(job, std::vector<Uint8>(), true);
+        return;
+    }
+
+    mFileSystem.Io().Read(fileName, offset, size, [this, job](std::vector<Uint8>&& data, bool ok)
+    {
+        OnRead(job, std::move(data), ok);
+    });
+}
+
+void LoadQueue::OnRead(const std::shared_ptr<LoadJob>& job, std::vector<Uint8>&& data, bool ok)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mReadsInFlight--;
+    }
+
+    // Done while this job is still active so the queue can't be destroyed under us
+    IssueReads();
+
+    if (!ok)
+    {
+        Finish(job, eLoadFailed);
+        return;
+    }
+
+    job->data = std::move(data);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDecodeReady[job->priority].push_back(job);
+
+    // Each post decodes whichever ready job matters most at the time it runs
+    mPool.Post([this]() { DecodeNext(); });
+}
+
+void LoadQueue::DecodeNext()
+{
+    std::shared_ptr<LoadJob> job;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        job = PopBest(mDecodeReady);
+    }
+
+    if (!job)
+    {
+        return;
+    }
+
+    if (job->cancelled)
+    {
+        Finish(job, eLoadCancelled);
+        return;
+    }
+
+    job->state = eLoadDecoding;
+    try
+    {
+        if (job->decoder)
+        {
+            job->result = job->decoder(std::move(job->data));
+        }
+        else
+        {
+            job->result = std::make_shared<std::vector<Uint8>>(std::move(job->data));
+        }
+        Finish(job, job->result ? eLoadReady : eLoadFailed);
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR("Failed to decode " << AssetId::Name(job->id) << ": " << ex.what());
+        Finish(job, eLoadFailed);
+    }
+}
+
+void LoadQueue::Finish(const std::shared_ptr<LoadJob>& job, eLoadState state)
+{
+    job->data.clear();
+    job->data.shrink_to_fit();
+    job->state = state;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (state != eLoadCancelled && !job->cancelled)
+    {
+        mCompleted.push_back(job);
+    }
+    mActive.erase(std::find(mActive.begin(), mActive.end(), job));
+    mFinished.notify_all();
+}
+
+size_t LoadQueue::Poll(size_t max)
+{
+    std::vector<std::shared_ptr<LoadJob>> completed;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const size_t count = std::min(max, mCompleted.size());
+        completed.assign(mCompleted.begin(), mCompleted.begin() + count);
+        mCompleted.erase(mCompleted.begin(), mCompleted.begin() + count);
+    }
+
+    size_t ran = 0;
+    for (const auto& job : completed)
+    {
+        // Cancelled after it finished but before the poll
+        if (job->cancelled)
+        {
+            continue;
+        }
+
+        if (job->completion)
+        {
+            job->completion(LoadHandle(job));
+        }
+        ran++;
+    }
+    return ran;
+}
+
+size_t LoadQueue::Pending() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    size_t pending = 0;
+    for (const auto& job : mCompleted)
+    {
+        pending += job->cancelled ? 0 : 1;
+    }
+    for (const auto& job : mActive)
+    {
+        pending += job->cancelled ? 0 : 1;
+    }
+    return pending;
+}
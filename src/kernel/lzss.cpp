@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <cstring>
+#include "kernel/lzss.hpp"
+#include "kernel/binarylayout.hpp"
+#include "kernel/cookedpack.hpp"
+#include "kernel/stream.hpp"
+#include "kernel/threadpool.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static const size_t kWindowSize = 4096;
+static const size_t kWindowStart = 0xFEE;
+static const size_t kMinMatch = 3;
+static const size_t kMaxMatch = 18;
+
+// Longest a match can reach back, a whole window would overwrite itself
+static const size_t kMaxDistance = kWindowSize - 1;
+
+// Compressor tuning, more chain steps find longer matches but take longer
+static const size_t kChunkSize = 64 * 1024;
+static const size_t kHashBits = 14;
+static const size_t kMaxChainSteps = 48;
+
+// The most one control byte's items can read and write
+static const size_t kMaxGroupInput = 1 + 8 * 2;
+static const size_t kMaxGroupOutput = 8 * kMaxMatch;
+
+// How far back from the write position a window offset is, a whole window when
+// they are the same
+static inline size_t MatchDistance(size_t written, size_t offset)
+{
+    const size_t distance = (written + kWindowStart - offset) & (kWindowSize - 1);
+    return distance == 0 ? kWindowSize : distance;
+}
+
+// Matches that start before the output, or overlap what they write, go a byte at a time
+static void CopyMatchSlow(Uint8* out, size_t written, size_t distance, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        out[i] = written + i >= distance ? out[static_cast<ptrdiff_t>(i) - static_cast<ptrdiff_t>(distance)] : 0;
+    }
+}
+
+size_t Lzss::DecompressedSize(const Uint8* data, size_t size)
+{
+    size_t total = 0;
+    size_t pos = 0;
+    while (pos < size)
+    {
+        const Uint8 control = data[pos++];
+        for (int bit = 0; bit < 8 && pos < size; bit++)
+        {
+            if (control & (1 << bit))
+            {
+                total++;
+                pos++;
+                continue;
+            }
+
+            if (pos + 1 >= size)
+            {
+                throw Exception("Truncated LZSS reference");
+            }
+            total += (data[pos + 1] & 0x0F) + kMinMatch;
+            pos += 2;
+        }
+    }
+    return total;
+}
+
+size_t Lzss::Decompress(const Uint8* data, size_t size, Uint8* dest, size_t destSize)
+{
+    const Uint8* in = data;
+    const Uint8* const inEnd = data + size;
+    Uint8* out = dest;
+    Uint8* const outEnd = dest + destSize;
+
+    // While a whole control byte's worth of items can't run off either buffer there
+    // is no need to check them one by one. Matches also copy a fixed kMaxMatch bytes,
+    // the extra is overwritten by what follows.
+    while (static_cast<size_t>(inEnd - in) >= kMaxGroupInput && static_cast<size_t>(outEnd - out) >= kMaxGroupOutput)
+    {
+        unsigned int control = *in++;
+        if (control == 0xFF)
+        {
+            memcpy(out, in, 8);
+            in += 8;
+            out += 8;
+            continue;
+        }
+
+        for (int bit = 0; bit < 8; bit++, control >>= 1)
+        {
+            if (control & 1)
+            {
+                *out++ = *in++;
+                continue;
+            }
+
+            const size_t offset = in[0] | ((in[1] & 0xF0) << 4);
+            const size_t length = (in[1] & 0x0F) + kMinMatch;
+            in += 2;
+
+            const size_t written = out - dest;
+            const size_t distance = MatchDistance(written, offset);
+            if (distance >= kMaxMatch && distance <= written)
+            {
+                memcpy(out, out - distance, kMaxMatch);
+            }
+            else
+            {
+                CopyMatchSlow(out, written, distance, length);
+            }
+            out += length;
+        }
+    }
+
+    // The last few groups, checked as they go
+    while (in < inEnd)
+    {
+        const Uint8 control = *in++;
+        for (int bit = 0; bit < 8 && in < inEnd; bit++)
+        {
+            if (control & (1 << bit))
+            {
+                if (out == outEnd)
+                {
+                    throw Exception("LZSS output buffer too small");
+                }
+                *out++ = *in++;
+                continue;
+            }
+
+            if (inEnd - in < 2)
+            {
+                throw Exception("Truncated LZSS reference");
+            }
+
+            const size_t offset = in[0] | ((in[1] & 0xF0) << 4);
+            const size_t length = (in[1] & 0x0F) + kMinMatch;
+            in += 2;
+            if (static_cast<size_t>(outEnd - out) < length)
+            {
+                throw Exception("LZSS output buffer too small");
+            }
+
+            const size_t written = out - dest;
+            CopyMatchSlow(out, written, MatchDistance(written, offset), length);
+            out += length;
+        }
+    }
+    return out - dest;
+}
+
+std::vector<Uint8> Lzss::Decompress(const Uint8* data, size_t size)
+{
+    std::vector<Uint8> out(DecompressedSize(data, size));
+    Decompress(data, size, out.data(), out.size());
+    return out;
+}
+
+std::vector<Uint8> Lzss::Decompress(Stream& stream)
+{
+    if (CookedPack::IsCooked(stream, eCookedDecompressed))
+    {
+        std::vector<Uint8> data(stream.Size() - stream.Pos());
+        stream.ReadBytes(data.data(), data.size());
+        return data;
+    }
+
+    Uint32 compressedSize = 0;
+    stream.ReadUInt32(compressedSize);
+    if (compressedSize > stream.Size() - stream.Pos())
+    {
+        LOG_ERROR(stream.Name() << " claims " << compressedSize << " compressed bytes but has " << stream.Size() - stream.Pos());
+        throw Exception("Truncated LZSS data");
+    }
+    return Decompress(stream.ReadView(compressedSize), compressedSize);
+}
+
+Stream Lzss::Open(Stream& stream)
+{
+    return Stream(Decompress(stream));
+}
+
+std::vector<Uint8> Lzss::Cook(Stream& stream)
+{
+    const std::vector<Uint8> data = Decompress(stream);
+    std::vector<Uint8> cooked = CookedPack::MakeCooked(eCookedDecompressed, data.size());
+    std::copy(data.begin(), data.end(), cooked.end() - data.size());
+    return cooked;
+}
+
+namespace
+{
+    // One chunk's output before it is packed in to control byte groups, which can't
+    // be done until the chunks before it are known
+    struct LzssTokens
+    {
+        std::vector<Uint8> literal; // 1 for a literal, 0 for a match
+        std::vector<Uint8> bytes;
+    };
+
+    class MatchFinder
+    {
+    public:
+        MatchFinder(const Uint8* data, size_t size, size_t base, size_t end)
+            : mData(data), mSize(size), mBase(base), mHead(1 << kHashBits, -1), mPrev(end - base, -1)
+        {
+
+        }
+
+        void Insert(size_t pos)
+        {
+            if (pos + kMinMatch <= mSize)
+            {
+                const size_t hash = Hash(pos);
+                mPrev[pos - mBase] = mHead[hash];
+                mHead[hash] = static_cast<Sint32>(pos);
+            }
+        }
+
+        // Longest match for pos no longer than maxLength, length 0 for none
+        void Find(size_t pos, size_t maxLength, size_t& length, size_t& distance) const
+        {
+            length = 0;
+            distance = 0;
+            if (pos + kMinMatch > mSize || maxLength < kMinMatch)
+            {
+                return;
+            }
+
+            Sint32 candidate = mHead[Hash(pos)];
+            for (size_t step = 0; candidate >= 0 && step < kMaxChainSteps; step++)
+            {
+                const size_t from = static_cast<size_t>(candidate);
+                if (pos - from > kMaxDistance)
+                {
+                    break;
+                }
+
+                // Only worth comparing if it could beat what we have
+                if (mData[from + length] == mData[pos + length])
+                {
+                    size_t matched = 0;
+                    while (matched < maxLength && mData[from + matched] == mData[pos + matched])
+                    {
+                        matched++;
+                    }
+
+                    if (matched > length)
+                    {
+                        length = matched;
+                        distance = pos - from;
+                        if (length == maxLength)
+                        {
+                            break;
+                        }
+                    }
+                }
+                candidate = mPrev[from - mBase];
+            }
+
+            if (length < kMinMatch)
+            {
+                length = 0;
+            }
+        }
+    private:
+        size_t Hash(size_t pos) const
+        {
+            const Uint32 value = mData[pos] | (mData[pos + 1] << 8) | (mData[pos + 2] << 16);
+            return (value * 2654435761u) >> (32 - kHashBits);
+        }
+
+        const Uint8* mData;
+        size_t mSize;
+        size_t mBase;
+        std::vector<Sint32> mHead;
+        std::vector<Sint32> mPrev;
+    };
+}
+
+// Compresses data[begin, end), matches may start as far back as the window allows
+static void CompressChunk(const Uint8* data, size_t size, size_t begin, size_t end, LzssTokens& tokens)
+{
+    const size_t base = begin > kMaxDistance ? begin - kMaxDistance : 0;
+    MatchFinder finder(data, size, base, end);
+    for (size_t pos = base; pos < begin; pos++)
+    {
+        finder.Insert(pos);
+    }
+
+    tokens.literal.reserve((end - begin) / 2);
+    tokens.bytes.reserve(end - begin);
+
+    size_t pos = begin;
+    while (pos < end)
+    {
+        size_t length = 0;
+        size_t distance = 0;
+        finder.Find(pos, std::min(kMaxMatch, end - pos), length, distance);
+
+        // One step lazy, a literal then a longer match is usually smaller
+        if (length > 0 && length < kMaxMatch && pos + 1 < end)
+        {
+            finder.Insert(pos);
+            size_t nextLength = 0;
+            size_t nextDistance = 0;
+            finder.Find(pos + 1, std::min(kMaxMatch, end - pos - 1), nextLength, nextDistance);
+            if (nextLength > length)
+            {
+                tokens.literal.push_back(1);
+                tokens.bytes.push_back(data[pos]);
+                pos++;
+                continue;
+            }
+        }
+        else
+        {
+            finder.Insert(pos);
+        }
+
+        if (length == 0)
+        {
+            tokens.literal.push_back(1);
+            tokens.bytes.push_back(data[pos]);
+            pos++;
+            continue;
+        }
+
+        // The decoder wants the window position, which started at kWindowStart
+        const size_t offset = (pos - distance + kWindowStart) & (kWindowSize - 1);
+        tokens.literal.push_back(0);
+        tokens.bytes.push_back(static_cast<Uint8>(offset));
+        tokens.bytes.push_back(static_cast<Uint8>(((offset >> 4) & 0xF0) | (length - kMinMatch)));
+        for (size_t i = 1; i < length; i++)
+        {
+            finder.Insert(pos + i);
+        }
+        pos += length;
+    }
+}
+
+std::vector<Uint8> Lzss::Compress(const Uint8* data, size_t size, ThreadPool* pool)
+{
+    const size_t chunkCount = (size + kChunkSize - 1) / kChunkSize;
+    std::vector<LzssTokens> chunks(chunkCount);
+    auto compress = [&](size_t i)
+    {
+        CompressChunk(data, size, i * kChunkSize, std::min(size, (i + 1) * kChunkSize), chunks[i]);
+    };
+
+    if (pool && chunkCount > 1)
+    {
+        pool->ParallelFor(chunkCount, compress);
+    }
+    else
+    {
+        for (size_t i = 0; i < chunkCount; i++)
+        {
+            compress(i);
+        }
+    }
+
+    // Pack the items in to groups of eight behind their control byte
+    size_t itemCount = 0;
+    size_t byteCount = 0;
+    for (const LzssTokens& chunk : chunks)
+    {
+        itemCount += chunk.literal.size();
+        byteCount += chunk.bytes.size();
+    }
+
+    std::vector<Uint8> out;
+    out.reserve(byteCount + (itemCount + 7) / 8);
+    size_t controlPos = 0;
+    int bit = 8;
+    for (const LzssTokens& chunk : chunks)
+    {
+        const Uint8* bytes = chunk.bytes.data();
+        for (const Uint8 literal : chunk.literal)
+        {
+            if (bit == 8)
+            {
+                controlPos = out.size();
+                out.push_back(0);
+                bit = 0;
+            }
+
+            if (literal)
+            {
+                out[controlPos] |= 1 << bit;
+                out.push_back(*bytes++);
+            }
+            else
+            {
+                out.push_back(bytes[0]);
+                out.push_back(bytes[1]);
+                bytes += 2;
+            }
+            bit++;
+        }
+    }
+    return out;
+}
+
+std::vector<Uint8> Lzss::CompressFile(const Uint8* data, size_t size, ThreadPool* pool)
+{
+    std::vector<Uint8> compressed = Compress(data, size, pool);
+    if (compressed.size() > 0xFFFFFFFF)
+    {
+        throw Exception("LZSS output too big for its header");
+    }
+
+    Uint32 header = static_cast<Uint32>(compressed.size());
+    BinaryLayoutToHost(&header, 1);
+    std::vector<Uint8> file(sizeof(header) + compressed.size());
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + sizeof(header), compressed.data(), compressed.size());
+    return file;
+}
@@ -0,0 +1,207 @@
+#include "kernel/mappedfile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& fileName)
+{
+    Close();
+
+    mFile = ::CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE)
+    {
+        mFile = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER size = {};
+    if (!::GetFileSizeEx(mFile, &size))
+    {
+        Close();
+        return false;
+    }
+
+    mSize = static_cast<size_t>(size.QuadPart);
+    if (mSize == 0)
+    {
+        // Can't map an empty file, but an empty view is still valid
+        return true;
+    }
+
+    mMapping = ::CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mMapping)
+    {
+        Close();
+        return false;
+    }
+
+    mData = static_cast<const Uint8*>(::MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    if (!mData)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedFile::Create(const std::string& fileName, size_t size)
+{
+    Close();
+
+    mFile = ::CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE)
+    {
+        mFile = nullptr;
+        return false;
+    }
+
+    mSize = size;
+    mWritable = true;
+    if (mSize == 0)
+    {
+        return true;
+    }
+
+    const Uint64 size64 = static_cast<Uint64>(size);
+    mMapping = ::CreateFileMappingA(mFile, nullptr, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64 & 0xFFFFFFFF), nullptr);
+    if (!mMapping)
+    {
+        Close();
+        return false;
+    }
+
+    mData = static_cast<const Uint8*>(::MapViewOfFile(mMapping, FILE_MAP_WRITE, 0, 0, 0));
+    if (!mData)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mData)
+    {
+        if (mWritable)
+        {
+            ::FlushViewOfFile(mData, 0);
+        }
+        ::UnmapViewOfFile(mData);
+    }
+
+    if (mMapping)
+    {
+        ::CloseHandle(mMapping);
+    }
+
+    if (mFile)
+    {
+        ::CloseHandle(mFile);
+    }
+
+    mData = nullptr;
+    mMapping = nullptr;
+    mFile = nullptr;
+    mSize = 0;
+    mWritable = false;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& fileName)
+{
+    Close();
+
+    const int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    struct stat info = {};
+    if (::fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    mSize = static_cast<size_t>(info.st_size);
+    if (mSize > 0)
+    {
+        void* p = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(fd);
+            mSize = 0;
+            return false;
+        }
+        mData = static_cast<const Uint8*>(p);
+    }
+
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    return true;
+}
+
+bool MappedFile::Create(const std::string& fileName, size_t size)
+{
+    Close();
+
+    const int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    mSize = size;
+    mWritable = true;
+    if (mSize > 0)
+    {
+        void* p = ::mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(fd);
+            mSize = 0;
+            mWritable = false;
+            return false;
+        }
+        mData = static_cast<const Uint8*>(p);
+    }
+
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mData)
+    {
+        ::munmap(const_cast<Uint8*>(mData), mSize);
+    }
+    mData = nullptr;
+    mSize = 0;
+    mWritable = false;
+}
+
+#endif
@@ -0,0 +1,658 @@
+#include <cstring>
+#include "kernel/pixelconvert.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXELCONVERT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE2
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#else
+// Lets the SIMD loops be built without turning the instruction sets on for the whole
+// file, they are only called once the CPU has been checked
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define PIXELCONVERT_X86 0
+#endif
+
+static void Expand8Scalar(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        dest[i] = palette[indices[i]];
+    }
+}
+
+static void Expand4Scalar(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest, size_t start = 0)
+{
+    for (size_t i = start; i < count; i++)
+    {
+        const Uint8 packed = indices[i / 2];
+        dest[i] = palette[(i & 1) ? packed >> 4 : packed & 0x0F];
+    }
+}
+
+static Uint8 Expand5(Uint32 value)
+{
+    return static_cast<Uint8>((value << 3) | (value >> 2));
+}
+
+// Each layout knows how to decode one pixel and, on x86, four at a time in to an
+// SSE2 register, with Decode4Ssse3 for the SSSE3 loop. The loops below are
+// instantiated for each one so the channel positions are constants.
+template<int RedShift, int BlueShift>
+struct Format5551
+{
+    static const size_t kBytes = 2;
+
+    static Uint32 Decode(const Uint8* p)
+    {
+        const Uint32 v = p[0] | (p[1] << 8);
+        return PixelConvert::Rgba(Expand5((v >> RedShift) & 0x1F), Expand5((v >> 5) & 0x1F), Expand5((v >> BlueShift) & 0x1F), (v & 0x8000) ? 0xFF : 0);
+    }
+
+#if PIXELCONVERT_X86
+    TARGET_SSE2 static __m128i Decode4(const Uint8* p)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i five = _mm_set1_epi32(0x1F);
+        const __m128i v = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero);
+        __m128i r = _mm_and_si128(_mm_srli_epi32(v, RedShift), five);
+        __m128i g = _mm_and_si128(_mm_srli_epi32(v, 5), five);
+        __m128i b = _mm_and_si128(_mm_srli_epi32(v, BlueShift), five);
+        r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+        g = _mm_or_si128(_mm_slli_epi32(g, 3), _mm_srli_epi32(g, 2));
+        b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+
+        // 0 - the alpha bit is all ones when it is set
+        const __m128i a = _mm_slli_epi32(_mm_sub_epi32(zero, _mm_srli_epi32(v, 15)), 24);
+        return _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), a));
+    }
+
+    // Nothing here for a byte shuffle to do
+    TARGET_SSSE3 static __m128i Decode4Ssse3(const Uint8* p)
+    {
+        return Decode4(p);
+    }
+#endif
+};
+
+struct FormatBgr24
+{
+    static const size_t kBytes = 3;
+
+    static Uint32 Decode(const Uint8* p)
+    {
+        return PixelConvert::Rgba(p[2], p[1], p[0], 0xFF);
+    }
+
+#if PIXELCONVERT_X86
+    // SSE2 can't move bytes between pixels, so this one is scalar
+    TARGET_SSE2 static __m128i Decode4(const Uint8* p)
+    {
+        return _mm_setr_epi32(Decode(p), Decode(p + 3), Decode(p + 6), Decode(p + 9));
+    }
+
+    // One shuffle spreads the 12 bytes to 16, swapping blue and red on the way. Loaded
+    // as 8 + 4 bytes so the last pixels don't read past the end of the image.
+    TARGET_SSSE3 static __m128i Decode4Ssse3(const Uint8* p)
+    {
+        Uint32 last = 0;
+        memcpy(&last, p + 8, sizeof(last));
+        const __m128i v = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_cvtsi32_si128(static_cast<int>(last)));
+        const __m128i order = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+        return _mm_or_si128(_mm_shuffle_epi8(v, order), _mm_set1_epi32(static_cast<int>(0xFF000000)));
+    }
+#endif
+};
+
+struct FormatBgra32
+{
+    static const size_t kBytes = 4;
+
+    static Uint32 Decode(const Uint8* p)
+    {
+        return PixelConvert::Rgba(p[2], p[1], p[0], p[3]);
+    }
+
+#if PIXELCONVERT_X86
+    // Only blue and red swap places
+    TARGET_SSE2 static __m128i Decode4(const Uint8* p)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i greenAlpha = _mm_and_si128(v, _mm_set1_epi32(0xFF00FF00));
+        const __m128i blueRed = _mm_and_si128(v, _mm_set1_epi32(0x00FF00FF));
+        return _mm_or_si128(greenAlpha, _mm_or_si128(_mm_slli_epi32(blueRed, 16), _mm_srli_epi32(blueRed, 16)));
+    }
+
+    TARGET_SSSE3 static __m128i Decode4Ssse3(const Uint8* p)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        return _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15));
+    }
+#endif
+};
+
+static Uint8 Alpha(Uint32 pixel)
+{
+    return reinterpret_cast<const Uint8*>(&pixel)[3];
+}
+
+template<bool ColorKey, bool AlphaTest>
+static Uint32 Finish(Uint32 pixel, Uint8 referenceAlpha)
+{
+    static const Uint32 kAlpha = PixelConvert::Rgba(0, 0, 0, 0xFF);
+    if (ColorKey && (pixel & ~kAlpha) == 0)
+    {
+        return 0;
+    }
+    if (AlphaTest && Alpha(pixel) < referenceAlpha)
+    {
+        return 0;
+    }
+    return pixel;
+}
+
+typedef void(*DirectLoop)(const Uint8* src, size_t count, const PixelMasks& masks, Uint8 referenceAlpha, Uint32* dest);
+
+template<typename Format, bool ColorKey, bool AlphaTest>
+static void ConvertScalar(const Uint8* src, size_t count, const PixelMasks&, Uint8 referenceAlpha, Uint32* dest)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        dest[i] = Finish<ColorKey, AlphaTest>(Format::Decode(src + i * Format::kBytes), referenceAlpha);
+    }
+}
+
+// Narrow channels are widened by repeating their bits, as the fixed layouts do
+static Uint8 Channel(Uint32 pixel, const PixelMasks& masks, size_t channel, Uint8 missing)
+{
+    const int bits = static_cast<int>(masks.bits[channel]);
+    if (bits <= 0 || bits > 32)
+    {
+        return missing;
+    }
+
+    const Uint32 value = (pixel & masks.mask[channel]) >> (masks.shift[channel] & 31);
+    if (bits >= 8)
+    {
+        return static_cast<Uint8>(value >> (bits - 8));
+    }
+
+    Uint32 wide = 0;
+    for (int shift = 8 - bits; shift > -bits; shift -= bits)
+    {
+        wide |= shift >= 0 ? value << shift : value >> -shift;
+    }
+    return static_cast<Uint8>(wide);
+}
+
+template<bool ColorKey, bool AlphaTest>
+static void ConvertGeneric(const Uint8* src, size_t count, const PixelMasks& masks, Uint8 referenceAlpha, Uint32* dest)
+{
+    const size_t bytes = masks.bytesPerPixel;
+    for (size_t i = 0; i < count; i++)
+    {
+        Uint32 pixel = 0;
+        for (size_t b = 0; b < bytes; b++)
+        {
+            pixel |= static_cast<Uint32>(src[i * bytes + b]) << (b * 8);
+        }
+        const Uint32 rgba = PixelConvert::Rgba(Channel(pixel, masks, 0, 0), Channel(pixel, masks, 1, 0),
+            Channel(pixel, masks, 2, 0), Channel(pixel, masks, 3, 0xFF));
+        dest[i] = Finish<ColorKey, AlphaTest>(rgba, referenceAlpha);
+    }
+}
+
+#if PIXELCONVERT_X86
+
+// SSE2 has no gather or byte shuffle, so the lookups stay scalar and the win is in
+// writing 16 bytes at a time
+TARGET_SSE2 static void Expand8Sse2(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const Uint8* p = indices + i;
+        __m128i* out = reinterpret_cast<__m128i*>(dest + i);
+        _mm_storeu_si128(out + 0, _mm_setr_epi32(palette[p[0]], palette[p[1]], palette[p[2]], palette[p[3]]));
+        _mm_storeu_si128(out + 1, _mm_setr_epi32(palette[p[4]], palette[p[5]], palette[p[6]], palette[p[7]]));
+        _mm_storeu_si128(out + 2, _mm_setr_epi32(palette[p[8]], palette[p[9]], palette[p[10]], palette[p[11]]));
+        _mm_storeu_si128(out + 3, _mm_setr_epi32(palette[p[12]], palette[p[13]], palette[p[14]], palette[p[15]]));
+    }
+    Expand8Scalar(indices + i, count - i, palette, dest + i);
+}
+
+// Each byte of indices becomes two pixels, so one lookup in a table of every byte's
+// pixel pair does both
+TARGET_SSE2 static void Expand4Sse2(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest)
+{
+    Uint64 pairs[256];
+    for (size_t b = 0; b < 256; b++)
+    {
+        const Uint32 pair[2] = { palette[b & 0x0F], palette[b >> 4] };
+        memcpy(&pairs[b], pair, sizeof(pair));
+    }
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const Uint8* p = indices + i / 2;
+        __m128i* out = reinterpret_cast<__m128i*>(dest + i);
+        _mm_storeu_si128(out + 0, _mm_set_epi64x(pairs[p[1]], pairs[p[0]]));
+        _mm_storeu_si128(out + 1, _mm_set_epi64x(pairs[p[3]], pairs[p[2]]));
+    }
+    Expand4Scalar(indices, count, palette, dest, i);
+}
+
+TARGET_AVX2 static void Expand8Avx2(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest)
+{
+    const int* table = reinterpret_cast<const int*>(palette);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i));
+        const __m256i low = _mm256_cvtepu8_epi32(packed);
+        const __m256i high = _mm256_cvtepu8_epi32(_mm_srli_si128(packed, 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), _mm256_i32gather_epi32(table, low, 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i + 8), _mm256_i32gather_epi32(table, high, 4));
+    }
+    Expand8Scalar(indices + i, count - i, palette, dest + i);
+}
+
+// 16 colors fit in a 128 bit lane per channel, so with the table in both lanes the
+// lookup is one byte shuffle per channel for 32 pixels. The channels are then
+// interleaved back in to pixels, which leaves each lane holding half of the output.
+TARGET_AVX2 static void Expand4Avx2(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest)
+{
+    Uint8 channels[4][16];
+    const Uint8* colors = reinterpret_cast<const Uint8*>(palette);
+    for (size_t i = 0; i < 16; i++)
+    {
+        for (size_t c = 0; c < 4; c++)
+        {
+            channels[c][i] = colors[i * 4 + c];
+        }
+    }
+    const __m256i red = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(channels[0])));
+    const __m256i green = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(channels[1])));
+    const __m256i blue = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(channels[2])));
+    const __m256i alpha = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(channels[3])));
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        // Pixels 0-15 in the low lane and 16-31 in the high one
+        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i / 2));
+        const __m128i low = _mm_and_si128(packed, nibble);
+        const __m128i high = _mm_and_si128(_mm_srli_epi16(packed, 4), nibble);
+        const __m256i index = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(low, high)), _mm_unpackhi_epi8(low, high), 1);
+
+        const __m256i r = _mm256_shuffle_epi8(red, index);
+        const __m256i g = _mm256_shuffle_epi8(green, index);
+        const __m256i b = _mm256_shuffle_epi8(blue, index);
+        const __m256i a = _mm256_shuffle_epi8(alpha, index);
+        const __m256i rg0 = _mm256_unpacklo_epi8(r, g);
+        const __m256i rg1 = _mm256_unpackhi_epi8(r, g);
+        const __m256i ba0 = _mm256_unpacklo_epi8(b, a);
+        const __m256i ba1 = _mm256_unpackhi_epi8(b, a);
+
+        // Pixels 0-3 | 16-19, 4-7 | 20-23, 8-11 | 24-27 and 12-15 | 28-31
+        const __m256i p0 = _mm256_unpacklo_epi16(rg0, ba0);
+        const __m256i p1 = _mm256_unpackhi_epi16(rg0, ba0);
+        const __m256i p2 = _mm256_unpacklo_epi16(rg1, ba1);
+        const __m256i p3 = _mm256_unpackhi_epi16(rg1, ba1);
+
+        __m256i* out = reinterpret_cast<__m256i*>(dest + i);
+        _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+    Expand4Scalar(indices, count, palette, dest, i);
+}
+
+template<bool ColorKey, bool AlphaTest>
+TARGET_SSE2 static __m128i Finish4(__m128i pixels, __m128i referenceAlpha)
+{
+    if (ColorKey)
+    {
+        const __m128i black = _mm_cmpeq_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0x00FFFFFF)), _mm_setzero_si128());
+        pixels = _mm_andnot_si128(black, pixels);
+    }
+    if (AlphaTest)
+    {
+        // Alpha is at most 255 so the signed compare is fine
+        const __m128i below = _mm_cmplt_epi32(_mm_srli_epi32(pixels, 24), referenceAlpha);
+        pixels = _mm_andnot_si128(below, pixels);
+    }
+    return pixels;
+}
+
+template<typename Format, bool ColorKey, bool AlphaTest>
+TARGET_SSE2 static void ConvertSse2(const Uint8* src, size_t count, const PixelMasks& masks, Uint8 referenceAlpha, Uint32* dest)
+{
+    const __m128i reference = _mm_set1_epi32(referenceAlpha);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i pixels = Format::Decode4(src + i * Format::kBytes);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), Finish4<ColorKey, AlphaTest>(pixels, reference));
+    }
+    ConvertScalar<Format, ColorKey, AlphaTest>(src + i * Format::kBytes, count - i, masks, referenceAlpha, dest + i);
+}
+
+template<typename Format, bool ColorKey, bool AlphaTest>
+TARGET_SSSE3 static void ConvertSsse3(const Uint8* src, size_t count, const PixelMasks& masks, Uint8 referenceAlpha, Uint32* dest)
+{
+    const __m128i reference = _mm_set1_epi32(referenceAlpha);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i pixels = Format::Decode4Ssse3(src + i * Format::kBytes);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), Finish4<ColorKey, AlphaTest>(pixels, reference));
+    }
+    ConvertScalar<Format, ColorKey, AlphaTest>(src + i * Format::kBytes, count - i, masks, referenceAlpha, dest + i);
+}
+
+struct CpuFeatures
+{
+    bool sse2;
+    bool ssse3;
+    bool avx2;
+};
+
+static CpuFeatures DetectCpu()
+{
+    CpuFeatures features = {};
+#ifdef _MSC_VER
+    int info[4] = {};
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    features.sse2 = (info[3] & (1 << 26)) != 0;
+    features.ssse3 = (info[2] & (1 << 9)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+
+    // The OS has to save the YMM registers too
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+    {
+        __cpuidex(info, 7, 0);
+        features.avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports("sse2") != 0;
+    features.ssse3 = __builtin_cpu_supports("ssse3") != 0;
+    features.avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+    return features;
+}
+
+#endif
+
+template<typename Format, bool ColorKey, bool AlphaTest>
+static DirectLoop Pick(eCpuPath path)
+{
+#if PIXELCONVERT_X86
+    if (path >= eCpuSsse3)
+    {
+        return ConvertSsse3<Format, ColorKey, AlphaTest>;
+    }
+    if (path == eCpuSse2)
+    {
+        return ConvertSse2<Format, ColorKey, AlphaTest>;
+    }
+#else
+    (void)path;
+#endif
+    return ConvertScalar<Format, ColorKey, AlphaTest>;
+}
+
+template<typename Format>
+static DirectLoop Pick(bool colorKey, bool alphaTest, eCpuPath path)
+{
+    if (colorKey)
+    {
+        return alphaTest ? Pick<Format, true, true>(path) : Pick<Format, true, false>(path);
+    }
+    return alphaTest ? Pick<Format, false, true>(path) : Pick<Format, false, false>(path);
+}
+
+bool PixelConvert::Supported(eCpuPath path)
+{
+#if PIXELCONVERT_X86
+    static const CpuFeatures features = DetectCpu();
+    switch (path)
+    {
+    case eCpuScalar:
+        return true;
+    case eCpuSse2:
+        return features.sse2;
+    case eCpuSsse3:
+        return features.ssse3;
+    case eCpuAvx2:
+        return features.avx2;
+    default:
+        return false;
+    }
+#else
+    return path == eCpuScalar;
+#endif
+}
+
+eCpuPath PixelConvert::Best()
+{
+    static const eCpuPath best = Supported(eCpuAvx2) ? eCpuAvx2 : Supported(eCpuSsse3) ? eCpuSsse3
+        : Supported(eCpuSse2) ? eCpuSse2 : eCpuScalar;
+    return best;
+}
+
+const char* PixelConvert::PathName(eCpuPath path)
+{
+    switch (path)
+    {
+    case eCpuScalar:
+        return "scalar";
+    case eCpuSse2:
+        return "SSE2";
+    case eCpuSsse3:
+        return "SSSE3";
+    case eCpuAvx2:
+        return "AVX2";
+    default:
+        return "unknown";
+    }
+}
+
+void PixelConvert::Expand8(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest)
+{
+    Expand8(indices, count, palette, dest, Best());
+}
+
+void PixelConvert::Expand8(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest, eCpuPath path)
+{
+    if (!Supported(path))
+    {
+        path = Best();
+    }
+
+    switch (path)
+    {
+#if PIXELCONVERT_X86
+    case eCpuAvx2:
+        Expand8Avx2(indices, count, palette, dest);
+        break;
+    case eCpuSse2:
+    case eCpuSsse3:
+        Expand8Sse2(indices, count, palette, dest);
+        break;
+#endif
+    default:
+        Expand8Scalar(indices, count, palette, dest);
+        break;
+    }
+}
+
+void PixelConvert::Expand4(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest)
+{
+    Expand4(indices, count, palette, dest, Best());
+}
+
+void PixelConvert::Expand4(const Uint8* indices, size_t count, const Uint32* palette, Uint32* dest, eCpuPath path)
+{
+    if (!Supported(path))
+    {
+        path = Best();
+    }
+
+    switch (path)
+    {
+#if PIXELCONVERT_X86
+    case eCpuAvx2:
+        Expand4Avx2(indices, count, palette, dest);
+        break;
+    case eCpuSse2:
+    case eCpuSsse3:
+        Expand4Sse2(indices, count, palette, dest);
+        break;
+#endif
+    default:
+        Expand4Scalar(indices, count, palette, dest);
+        break;
+    }
+}
+
+Uint32 PixelConvert::Rgba(Uint8 r, Uint8 g, Uint8 b, Uint8 a)
+{
+    const Uint8 bytes[4] = { r, g, b, a };
+    Uint32 pixel = 0;
+    memcpy(&pixel, bytes, sizeof(pixel));
+    return pixel;
+}
+
+void PixelConvert::ExpandImage(const Uint8* indices, Uint32 bits, Uint32 width, Uint32 height, size_t rowBytes,
+    const Uint32* palette, Uint32* dest)
+{
+    const size_t count = static_cast<size_t>(width) * height;
+    if (bits == 8 && rowBytes == width)
+    {
+        Expand8(indices, count, palette, dest);
+        return;
+    }
+
+    // 4 bit rows of an odd width end on half a byte
+    if (bits == 4 && rowBytes * 2 == width)
+    {
+        Expand4(indices, count, palette, dest);
+        return;
+    }
+
+    for (Uint32 y = 0; y < height; y++)
+    {
+        if (bits == 8)
+        {
+            Expand8(indices + y * rowBytes, width, palette, dest + static_cast<size_t>(y) * width);
+        }
+        else
+        {
+            Expand4(indices + y * rowBytes, width, palette, dest + static_cast<size_t>(y) * width);
+        }
+    }
+}
+
+ePixelLayout PixelConvert::Recognise(const PixelMasks& masks)
+{
+    auto is = [&masks](Uint32 bytes, const Uint32(&mask)[4], const Uint32(&shift)[4])
+    {
+        return masks.bytesPerPixel == bytes && memcmp(masks.mask, mask, sizeof(mask)) == 0 && memcmp(masks.shift, shift, sizeof(shift)) == 0;
+    };
+
+    if (is(2, { 0x7C00, 0x03E0, 0x001F, 0x8000 }, { 10, 5, 0, 15 }))
+    {
+        return eLayoutRgb5551;
+    }
+    if (is(2, { 0x001F, 0x03E0, 0x7C00, 0x8000 }, { 0, 5, 10, 15 }))
+    {
+        return eLayoutBgr5551;
+    }
+    if (is(3, { 0xFF0000, 0xFF00, 0xFF, 0 }, { 16, 8, 0, 0 }))
+    {
+        return eLayoutBgr24;
+    }
+    if (is(4, { 0xFF0000, 0xFF00, 0xFF, 0xFF000000 }, { 16, 8, 0, 24 }))
+    {
+        return eLayoutBgra32;
+    }
+    return eLayoutGeneric;
+}
+
+const char* PixelConvert::LayoutName(ePixelLayout layout)
+{
+    switch (layout)
+    {
+    case eLayoutGeneric:
+        return "generic";
+    case eLayoutRgb5551:
+        return "RGB5551";
+    case eLayoutBgr5551:
+        return "BGR5551";
+    case eLayoutBgr24:
+        return "BGR24";
+    case eLayoutBgra32:
+        return "BGRA32";
+    default:
+        return "unknown";
+    }
+}
+
+void PixelConvert::ConvertDirect(const Uint8* src, size_t count, const PixelMasks& masks, ePixelLayout layout,
+    bool colorKey, Uint8 referenceAlpha, Uint32* dest)
+{
+    ConvertDirect(src, count, masks, layout, colorKey, referenceAlpha, dest, Best());
+}
+
+void PixelConvert::ConvertDirect(const Uint8* src, size_t count, const PixelMasks& masks, ePixelLayout layout,
+    bool colorKey, Uint8 referenceAlpha, Uint32* dest, eCpuPath path)
+{
+    if (!Supported(path))
+    {
+        path = Best();
+    }
+
+    const bool alphaTest = referenceAlpha != 0;
+    DirectLoop loop = nullptr;
+    switch (layout)
+    {
+    case eLayoutRgb5551:
+        loop = Pick<Format5551<10, 0>>(colorKey, alphaTest, path);
+        break;
+    case eLayoutBgr5551:
+        loop = Pick<Format5551<0, 10>>(colorKey, alphaTest, path);
+        break;
+    case eLayoutBgr24:
+        loop = Pick<FormatBgr24>(colorKey, alphaTest, path);
+        break;
+    case eLayoutBgra32:
+        loop = Pick<FormatBgra32>(colorKey, alphaTest, path);
+        break;
+    default:
+        if (colorKey)
+        {
+            loop = alphaTest ? ConvertGeneric<true, true> : ConvertGeneric<true, false>;
+        }
+        else
+        {
+            loop = alphaTest ? ConvertGeneric<false, true> : ConvertGeneric<false, false>;
+        }
+        break;
+    }
+    loop(src, count, masks, referenceAlpha, dest);
+}
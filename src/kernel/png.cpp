@@ -0,0 +1,118 @@
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+#include "kernel/png.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static const Uint8 kSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+static const size_t kBytesPerPixel = 4;
+
+enum eFilter
+{
+    eFilterNone = 0,
+    eFilterSub = 1,
+    eFilterUp = 2
+};
+
+static void PutU32(std::vector<Uint8>& out, Uint32 value)
+{
+    out.push_back(static_cast<Uint8>(value >> 24));
+    out.push_back(static_cast<Uint8>(value >> 16));
+    out.push_back(static_cast<Uint8>(value >> 8));
+    out.push_back(static_cast<Uint8>(value));
+}
+
+// Length, type, data then a CRC of the type and data
+static void PutChunk(std::vector<Uint8>& out, const char* type, const Uint8* data, size_t size)
+{
+    PutU32(out, static_cast<Uint32>(size));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    const uLong crc = crc32(0L, out.data() + start, static_cast<uInt>(size + 4));
+    PutU32(out, static_cast<Uint32>(crc));
+}
+
+// Sum of the filtered bytes as signed values, smaller usually deflates better
+static size_t Cost(const Uint8* row, size_t size)
+{
+    size_t cost = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        cost += static_cast<size_t>(std::abs(static_cast<Sint8>(row[i])));
+    }
+    return cost;
+}
+
+static void FilterRow(const Uint8* row, const Uint8* above, size_t size, Uint8* dest)
+{
+    Uint8* sub = dest + 1 + size;
+    Uint8* up = sub + size;
+    for (size_t i = 0; i < size; i++)
+    {
+        sub[i] = static_cast<Uint8>(row[i] - (i >= kBytesPerPixel ? row[i - kBytesPerPixel] : 0));
+        up[i] = static_cast<Uint8>(row[i] - (above ? above[i] : 0));
+    }
+
+    const size_t none = Cost(row, size);
+    const size_t subCost = Cost(sub, size);
+    const size_t upCost = Cost(up, size);
+    if (subCost <= upCost && subCost < none)
+    {
+        dest[0] = eFilterSub;
+        std::memmove(dest + 1, sub, size);
+    }
+    else if (upCost < none)
+    {
+        dest[0] = eFilterUp;
+        std::memmove(dest + 1, up, size);
+    }
+    else
+    {
+        dest[0] = eFilterNone;
+        std::memcpy(dest + 1, row, size);
+    }
+}
+
+std::vector<Uint8> Png::Encode(const Uint32* pixels, Uint32 width, Uint32 height, int level)
+{
+    if (width == 0 || height == 0)
+    {
+        throw Exception("Can't write an empty PNG");
+    }
+
+    // Every row is a filter byte then the filtered pixels, with room after the last
+    // row for the two candidate filters
+    const size_t rowBytes = static_cast<size_t>(width) * kBytesPerPixel;
+    const size_t filteredSize = (rowBytes + 1) * height;
+    std::vector<Uint8> filtered(filteredSize + 2 * rowBytes);
+    const Uint8* src = reinterpret_cast<const Uint8*>(pixels);
+    for (size_t y = 0; y < height; y++)
+    {
+        FilterRow(src + y * rowBytes, y > 0 ? src + (y - 1) * rowBytes : nullptr, rowBytes, filtered.data() + y * (rowBytes + 1));
+    }
+
+    uLongf compressedSize = compressBound(static_cast<uLong>(filteredSize));
+    std::vector<Uint8> compressed(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, filtered.data(), static_cast<uLong>(filteredSize), level) != Z_OK)
+    {
+        LOG_ERROR("Failed to deflate a " << width << "x" << height << " PNG");
+        throw Exception("PNG compression failed");
+    }
+
+    std::vector<Uint8> out(kSignature, kSignature + sizeof(kSignature));
+    out.reserve(out.size() + compressedSize + 64);
+
+    // 8 bits a channel, color type 6 (RGBA), default compression and filtering, no interlace
+    std::vector<Uint8> header;
+    PutU32(header, width);
+    PutU32(header, height);
+    const Uint8 format[] = { 8, 6, 0, 0, 0 };
+    header.insert(header.end(), format, format + sizeof(format));
+
+    PutChunk(out, "IHDR", header.data(), header.size());
+    PutChunk(out, "IDAT", compressed.data(), compressedSize);
+    PutChunk(out, "IEND", nullptr, 0);
+    return out;
+}
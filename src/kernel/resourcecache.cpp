@@ -0,0 +1,383 @@
+#include "kernel/resourcecache.hpp"
+#include "kernel/filesystem.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static const size_t kMegabyte = 1024 * 1024;
+
+// Roughly what a field scene needs, tuned down for low memory machines with SetBudget
+static const size_t kDefaultBudgets[eResourceClassCount] =
+{
+    64 * kMegabyte, // eTexture
+    32 * kMegabyte, // eModel
+    32 * kMegabyte, // eAudio
+    4 * kMegabyte,  // eScript
+    8 * kMegabyte,  // eField
+};
+
+// Lets the cache cancel its own prefetches when it goes away
+static const Uint32 kPrefetchTag = 0x50524546; // "PREF"
+
+
+// Keeps the file's bytes as they are
+static std::shared_ptr<const void> LoadBytes(Stream& data, size_t& residentBytes)
+{
+    auto bytes = std::make_shared<std::vector<Uint8>>(data.Size());
+    data.ReadBytes(bytes->data(), bytes->size());
+    residentBytes = bytes->size();
+    return bytes;
+}
+
+ResourceHandle::ResourceHandle(ResourceCache* cache, Uint32 index, Uint32 generation, const void* data)
+    : mCache(cache), mIndex(index), mGeneration(generation), mData(data)
+{
+
+}
+
+ResourceHandle::ResourceHandle(const ResourceHandle& other)
+    : mCache(other.mCache), mIndex(other.mIndex), mGeneration(other.mGeneration), mData(other.mData)
+{
+    if (mCache)
+    {
+        mCache->AddRef(mIndex);
+    }
+}
+
+ResourceHandle::ResourceHandle(ResourceHandle&& other)
+    : mCache(other.mCache), mIndex(other.mIndex), mGeneration(other.mGeneration), mData(other.mData)
+{
+    other.mCache = nullptr;
+    other.mData = nullptr;
+}
+
+ResourceHandle& ResourceHandle::operator = (ResourceHandle other)
+{
+    std::swap(mCache, other.mCache);
+    std::swap(mIndex, other.mIndex);
+    std::swap(mGeneration, other.mGeneration);
+    std::swap(mData, other.mData);
+    return *this;
+}
+
+ResourceHandle::~ResourceHandle()
+{
+    if (mCache)
+    {
+        mCache->Release(mIndex);
+    }
+}
+
+ResourceCache::ResourceCache(FileSystem& fileSystem)
+    : mFileSystem(fileSystem)
+{
+    for (int i = 0; i < eResourceClassCount; i++)
+    {
+        mClasses[i].loader = LoadBytes;
+        mClasses[i].stats = Stats{};
+        mClasses[i].stats.budget = kDefaultBudgets[i];
+    }
+}
+
+ResourceCache::~ResourceCache()
+{
+    // Their completions point back at us
+    mFileSystem.CancelLoads(kPrefetchTag);
+
+    for (const Entry& entry : mEntries)
+    {
+        if (entry.refCount > 0)
+        {
+            LOG_ERROR(AssetId::Name(entry.id) << " still has " << entry.refCount << " handles as the resource cache goes away");
+        }
+    }
+}
+
+const char* ResourceCache::ClassName(eResourceClass resourceClass)
+{
+    static const char* kNames[eResourceClassCount] = { "textures", "models", "audio", "scripts", "fields" };
+    return resourceClass < eResourceClassCount ? kNames[resourceClass] : "unknown";
+}
+
+void ResourceCache::SetBudget(eResourceClass resourceClass, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mClasses[resourceClass].stats.budget = bytes;
+    EvictOverBudget(resourceClass);
+}
+
+void ResourceCache::SetLoader(eResourceClass resourceClass, Loader loader)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mClasses[resourceClass].loader = std::move(loader);
+}
+
+ResourceHandle ResourceCache::Acquire(AssetId id, eResourceClass resourceClass)
+{
+    Loader loader;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mLookup.find(id);
+        if (it != std::end(mLookup))
+        {
+            if (mEntries[it->second].resourceClass != resourceClass)
+            {
+                LOG_ERROR(AssetId::Name(id) << " is already cached as " << ClassName(mEntries[it->second].resourceClass));
+                throw Exception("Resource cached as a different class");
+            }
+            Entry& entry = mEntries[it->second];
+            mClasses[resourceClass].stats.hits++;
+            if (entry.prefetched)
+            {
+                mClasses[resourceClass].stats.prefetchHits++;
+                entry.prefetched = false;
+            }
+            return Reference(it->second);
+        }
+        mClasses[resourceClass].stats.misses++;
+        loader = mClasses[resourceClass].loader;
+    }
+
+    // Loaded without the lock so other resources can be handed out meanwhile
+    Stream stream = mFileSystem.Open(id);
+    size_t bytes = 0;
+    std::shared_ptr<const void> data = loader(stream, bytes);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mLookup.find(id);
+    if (it != std::end(mLookup))
+    {
+        // Another thread got there first, use theirs
+        return Reference(it->second);
+    }
+
+    ResourceHandle handle = Reference(Insert(id, resourceClass, std::move(data), bytes));
+    EvictOverBudget(resourceClass);
+    return handle;
+}
+
+Uint32 ResourceCache::Insert(AssetId id, eResourceClass resourceClass, std::shared_ptr<const void> data, size_t bytes)
+{
+    Uint32 index = 0;
+    if (mFreeEntries.empty())
+    {
+        index = static_cast<Uint32>(mEntries.size());
+        mEntries.emplace_back();
+        mEntries[index].generation = 0;
+    }
+    else
+    {
+        index = mFreeEntries.back();
+        mFreeEntries.pop_back();
+    }
+
+    Entry& entry = mEntries[index];
+    entry.id = id;
+    entry.resourceClass = resourceClass;
+    entry.refCount = 0;
+    entry.prefetched = false;
+    entry.bytes = bytes;
+    entry.data = std::move(data);
+    entry.lruPosition = std::end(mClasses[resourceClass].lru);
+    mLookup[id] = index;
+
+    Stats& stats = mClasses[resourceClass].stats;
+    if (mHolders[entry.data.get()]++ == 0)
+    {
+        stats.residentBytes += bytes;
+    }
+    else
+    {
+        stats.sharedBytes += bytes;
+    }
+    stats.resources++;
+    return index;
+}
+
+void ResourceCache::Prefetch(AssetId id, eResourceClass resourceClass)
+{
+    Loader loader;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mLookup.find(id) != std::end(mLookup) || !mPrefetching.emplace(id, resourceClass).second)
+        {
+            return;
+        }
+        loader = mClasses[resourceClass].loader;
+    }
+
+    // The decoder only holds the loader so it can finish after we are gone
+    mFileSystem.LoadAsync(id, eLoadPrefetch, [loader](std::vector<Uint8>&& data)
+    {
+        auto prefetched = std::make_shared<Prefetched>();
+        Stream stream(std::move(data));
+        prefetched->data = loader(stream, prefetched->bytes);
+        return std::static_pointer_cast<const void>(prefetched);
+    },
+    [this, id, resourceClass](const LoadHandle& handle)
+    {
+        OnPrefetched(id, resourceClass, handle.Get<Prefetched>().get());
+    }, kPrefetchTag);
+}
+
+void ResourceCache::OnPrefetched(AssetId id, eResourceClass resourceClass, const Prefetched* prefetched)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPrefetching.erase(id);
+    if (!prefetched || mLookup.find(id) != std::end(mLookup))
+    {
+        // Failed, or acquired while it was on its way
+        return;
+    }
+
+    // Only room made by evicting older unreferenced resources counts
+    ClassState& state = mClasses[resourceClass];
+    size_t unreferenced = 0;
+    for (const Uint32 index : state.lru)
+    {
+        const Entry& entry = mEntries[index];
+        unreferenced += mHolders.at(entry.data.get()) == 1 ? entry.bytes : 0;
+    }
+
+    // Something already holding the same object means it costs nothing more
+    const size_t bytes = mHolders.count(prefetched->data.get()) ? 0 : prefetched->bytes;
+    if (state.stats.residentBytes - unreferenced + bytes > state.stats.budget)
+    {
+        state.stats.prefetchesDropped++;
+        return;
+    }
+
+    const Uint32 index = Insert(id, resourceClass, prefetched->data, prefetched->bytes);
+    mEntries[index].prefetched = true;
+    mEntries[index].lruPosition = state.lru.insert(std::end(state.lru), index);
+    state.stats.prefetches++;
+    EvictOverBudget(resourceClass);
+}
+
+ResourceHandle ResourceCache::Lock(const WeakResource& weak)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (weak.index >= mEntries.size() || mEntries[weak.index].generation != weak.generation || !mEntries[weak.index].data)
+    {
+        return ResourceHandle();
+    }
+    mClasses[mEntries[weak.index].resourceClass].stats.hits++;
+    return Reference(weak.index);
+}
+
+ResourceHandle ResourceCache::Reference(Uint32 index)
+{
+    Entry& entry = mEntries[index];
+    if (entry.refCount++ == 0 && entry.lruPosition != std::end(mClasses[entry.resourceClass].lru))
+    {
+        mClasses[entry.resourceClass].lru.erase(entry.lruPosition);
+        entry.lruPosition = std::end(mClasses[entry.resourceClass].lru);
+    }
+    return ResourceHandle(this, index, entry.generation, entry.data.get());
+}
+
+void ResourceCache::AddRef(Uint32 index)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries[index].refCount++;
+}
+
+void ResourceCache::Release(Uint32 index)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Entry& entry = mEntries[index];
+    if (--entry.refCount == 0)
+    {
+        ClassState& state = mClasses[entry.resourceClass];
+        entry.lruPosition = state.lru.insert(std::end(state.lru), index);
+        EvictOverBudget(entry.resourceClass);
+    }
+}
+
+void ResourceCache::EvictOverBudget(eResourceClass resourceClass)
+{
+    ClassState& state = mClasses[resourceClass];
+    while (state.stats.residentBytes > state.stats.budget && !state.lru.empty())
+    {
+        Evict(state.lru.front());
+    }
+}
+
+void ResourceCache::Evict(Uint32 index)
+{
+    Entry& entry = mEntries[index];
+    ClassState& state = mClasses[entry.resourceClass];
+    state.lru.erase(entry.lruPosition);
+
+    // Shared objects stay charged until the last entry holding them goes
+    auto holders = mHolders.find(entry.data.get());
+    if (--holders->second == 0)
+    {
+        mHolders.erase(holders);
+        state.stats.residentBytes -= entry.bytes;
+    }
+    else
+    {
+        state.stats.sharedBytes -= entry.bytes;
+    }
+    state.stats.resources--;
+    state.stats.evictions++;
+
+    mLookup.erase(entry.id);
+    entry.data.reset();
+    entry.lruPosition = std::end(state.lru);
+
+    // Weak references to the old resource no longer match
+    entry.generation++;
+    mFreeEntries.push_back(index);
+}
+
+void ResourceCache::Trim()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (ClassState& state : mClasses)
+    {
+        while (!state.lru.empty())
+        {
+            Evict(state.lru.front());
+        }
+    }
+}
+
+ResourceCache::Stats ResourceCache::GetStats(eResourceClass resourceClass) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mClasses[resourceClass].stats;
+}
+
+ResourceCache::Stats ResourceCache::GetTotalStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Stats total = {};
+    for (const ClassState& state : mClasses)
+    {
+        total.hits += state.stats.hits;
+        total.misses += state.stats.misses;
+        total.evictions += state.stats.evictions;
+        total.residentBytes += state.stats.residentBytes;
+        total.budget += state.stats.budget;
+        total.sharedBytes += state.stats.sharedBytes;
+        total.resources += state.stats.resources;
+        total.prefetches += state.stats.prefetches;
+        total.prefetchHits += state.stats.prefetchHits;
+        total.prefetchesDropped += state.stats.prefetchesDropped;
+    }
+    return total;
+}
+
+void ResourceCache::LogStats() const
+{
+    for (int i = 0; i < eResourceClassCount; i++)
+    {
+        const eResourceClass resourceClass = static_cast<eResourceClass>(i);
+        const Stats stats = GetStats(resourceClass);
+        LOG_INFO(ClassName(resourceClass) << ": " << stats.resources << " resident using "
+            << stats.residentBytes / 1024 << "/" << stats.budget / 1024 << " KB (" << stats.sharedBytes / 1024 << " KB more shared), "
+            << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions, "
+            << stats.prefetchHits << "/" << stats.prefetches << " prefetches used, " << stats.prefetchesDropped << " dropped");
+    }
+}
@@ -1,23 +1,51 @@
 #include <sstream>
 #include <algorithm>
 #include <fstream>
-#include <iterator>
 #include "logger.hpp"
 #include "exceptions.hpp"
 #include "kernel/stream.hpp"
+#include "kernel/mappedfile.hpp"
 
 Stream::Stream(std::vector<Uint8>&& data)
 {
-    mSize = data.size();
-    auto s = std::make_unique<std::stringstream>();
-    std::copy(data.begin(), data.end(), std::ostream_iterator<unsigned char>(*s));
-    mStream = std::move(s);
-    Seek(0);
+    auto buffer = std::make_shared<std::vector<Uint8>>(std::move(data));
+    mReader = StreamReader(buffer->data(), buffer->size());
+    mSize = buffer->size();
+    mOwner = std::move(buffer);
     mName = "Memory buffer (" + std::to_string(mSize) + ") bytes";
 }
 
-Stream::Stream(const std::string& fileName)
+Stream::Stream(const Uint8* data, size_t size)
+    : mReader(data, size), mSize(size)
+{
+    mName = "Memory view (" + std::to_string(mSize) + ") bytes";
+}
+
+Stream::Stream(const std::shared_ptr<const void>& owner, const Uint8* data, size_t size, const std::string& name)
+    : mOwner(owner), mReader(data, size), mSize(size), mName(name)
+{
+
+}
+
+Stream::Stream(const std::string& fileName, eMode mode)
     : mName(fileName)
+{
+    if (mode == eMapped)
+    {
+        auto mapping = std::make_shared<MappedFile>();
+        if (mapping->Open(fileName))
+        {
+            mReader = StreamReader(mapping->Data(), mapping->Size());
+            mSize = mapping->Size();
+            mOwner = std::move(mapping);
+            return;
+        }
+        LOG_WARNING("Failed to map " << fileName << " falling back to buffered reads");
+    }
+    OpenBuffered(fileName);
+}
+
+void Stream::OpenBuffered(const std::string& fileName)
 {
     auto s = std::make_unique<std::ifstream>();
     s->open(fileName, std::ios::in | std::ios::binary | std::ios::ate);
@@ -34,9 +62,17 @@ Stream::Stream(const std::string& fileName)
 }
 
 template<typename T>
-void DoRead(std::unique_ptr<std::istream>& stream, T& output)
+void DoRead(std::unique_ptr<std::istream>& stream, StreamReader& reader, T& output)
 {
-    if (!stream->read(reinterpret_cast<char*>(&output), sizeof(output)))
+    if (stream)
+    {
+        if (!stream->read(reinterpret_cast<char*>(&output), sizeof(output)))
+        {
+            throw Exception("Read failure");
+        }
+        BinaryLayoutToHost(&output, 1);
+    }
+    else if (reader.Read(output) != eReadOk)
     {
         throw Exception("Read failure");
     }
@@ -44,42 +80,132 @@ void DoRead(std::unique_ptr<std::istream>& stream, T& output)
 
 void Stream::ReadUInt8(Uint8& output)
 {
-    DoRead<decltype(output)>(mStream, output);
+    DoRead(mStream, mReader, output);
 }
 
 void Stream::ReadUInt32(Uint32& output)
 {
-    DoRead<decltype(output)>(mStream, output);
+    DoRead(mStream, mReader, output);
 }
 
 void Stream::ReadUInt16(Uint16& output)
 {
-    DoRead<decltype(output)>(mStream, output);
+    DoRead(mStream, mReader, output);
 }
 
 void Stream::ReadSInt16(Sint16& output)
 {
-    DoRead<decltype(output)>(mStream, output);
+    DoRead(mStream, mReader, output);
 }
 
 void Stream::ReadBytes(Sint8* pDest, size_t destSize)
 {
+    ReadBytes(reinterpret_cast<Uint8*>(pDest), destSize);
+}
+
+void Stream::ReadBytes(Uint8* pDest, size_t destSize)
+{
+    if (!IsBuffered())
+    {
+        if (mReader.ReadBytes(pDest, destSize) != eReadOk)
+        {
+            throw Exception("ReadBytes failure");
+        }
+        return;
+    }
+
     if (!mStream->read(reinterpret_cast<char*>(pDest), destSize))
     {
         throw Exception("ReadBytes failure");
     }
 }
 
-void Stream::ReadBytes(Uint8* pDest, size_t destSize)
+void Stream::CheckRemaining(size_t count, size_t itemSize) const
 {
-    if (!mStream->read(reinterpret_cast<char*>(pDest), destSize))
+    const size_t pos = Pos();
+    const size_t remaining = pos < mSize ? mSize - pos : 0;
+    if (itemSize != 0 && count > remaining / itemSize)
     {
-        throw Exception("ReadBytes failure");
+        throw Exception("Read past the end of the stream");
     }
 }
 
+const Uint8* Stream::ReadView(size_t size)
+{
+    if (!IsBuffered())
+    {
+        const Uint8* p = nullptr;
+        if (mReader.ReadView(p, size) != eReadOk)
+        {
+            throw Exception("ReadView failure");
+        }
+        return p;
+    }
+
+    mScratch.resize(size);
+    ReadBytes(mScratch.data(), size);
+    return mScratch.data();
+}
+
+StreamReader& Stream::Reader()
+{
+    if (IsBuffered())
+    {
+        const size_t pos = Pos();
+        auto buffer = std::make_shared<std::vector<Uint8>>(mSize);
+        if (!mStream->seekg(0) || !mStream->read(reinterpret_cast<char*>(buffer->data()), buffer->size()))
+        {
+            throw Exception("Read failure");
+        }
+        mStream.reset();
+
+        mReader = StreamReader(buffer->data(), buffer->size());
+        mReader.Seek(pos);
+        mOwner = std::move(buffer);
+    }
+    return mReader;
+}
+
+Stream Stream::Slice(size_t offset, size_t length) const
+{
+    if (offset > mSize || mSize - offset < length)
+    {
+        LOG_ERROR("Slice " << offset << "+" << length << " is out of range of " << mName);
+        throw Exception("Slice out of range");
+    }
+
+    const std::string name = mName + " [" + std::to_string(offset) + "+" + std::to_string(length) + "]";
+    if (!IsBuffered())
+    {
+        return Stream(mOwner, mReader.Data() + offset, length, name);
+    }
+
+    std::vector<Uint8> data(length);
+    const auto oldPos = mStream->tellg();
+    if (!mStream->seekg(offset) || !mStream->read(reinterpret_cast<char*>(data.data()), length))
+    {
+        mStream->clear();
+        mStream->seekg(oldPos);
+        throw Exception("Slice read failure");
+    }
+    mStream->seekg(oldPos);
+
+    Stream slice(std::move(data));
+    slice.mName = name;
+    return slice;
+}
+
 void Stream::Seek(size_t pos)
 {
+    if (!IsBuffered())
+    {
+        if (mReader.Seek(pos) != eReadOk)
+        {
+            throw Exception("Seek failure");
+        }
+        return;
+    }
+
     if (!mStream->seekg(pos))
     {
         throw Exception("Seek failure");
@@ -88,12 +214,22 @@ void Stream::Seek(size_t pos)
 
 bool Stream::AtEnd() const
 {
+    if (!IsBuffered())
+    {
+        return mReader.AtEnd();
+    }
+
     const int c = mStream->peek();
     return (c == EOF);
 }
 
 size_t Stream::Pos() const
 {
+    if (!IsBuffered())
+    {
+        return mReader.Pos();
+    }
+
     const size_t pos = static_cast<size_t>(mStream->tellg());
     return pos;
 }
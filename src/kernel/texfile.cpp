@@ -1 +1,327 @@
+#include <cstring>
 #include "kernel/texfile.hpp"
+#include "kernel/cookedpack.hpp"
+#include "kernel/pixelconvert.hpp"
+#include "kernel/stream.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static const Uint32 kMaxDimension = 4096;
+static const size_t kBgraSize = 4;
+
+static size_t Remaining(const Stream& stream)
+{
+    return stream.Size() - stream.Pos();
+}
+
+// Direct color in cooked textures, B G R A in memory
+static const PixelMasks kCookedMasks =
+{
+    4,
+    { 0xFF0000, 0xFF00, 0xFF, 0xFF000000 },
+    { 16, 8, 0, 24 },
+    { 8, 8, 8, 8 }
+};
+
+TexFile::TexFile(Stream& stream)
+{
+    if (CookedPack::IsCooked(stream, eCookedTexture))
+    {
+        LoadCooked(stream);
+        return;
+    }
+
+    if (Remaining(stream) < sizeof(Header))
+    {
+        LOG_ERROR(stream.Name() << " is too small to be a TEX file");
+        throw Exception("TEX file too small");
+    }
+    stream.ReadStruct(m_header);
+
+    const Uint32 width = m_header.image_data.width;
+    const Uint32 height = m_header.image_data.height;
+    mBitDepth = m_header.pixel_format.bits_per_pixel;
+    if (width == 0 || height == 0 || width > kMaxDimension || height > kMaxDimension)
+    {
+        LOG_ERROR(stream.Name() << " has a bad size " << width << "x" << height);
+        throw Exception("Bad TEX file size");
+    }
+
+    if (m_header.palette_data.flag)
+    {
+        mBitDepth = m_header.image_data.bit_depth;
+        if (mBitDepth != 4 && mBitDepth != 8)
+        {
+            LOG_ERROR(stream.Name() << " has " << mBitDepth << " bit palette indices");
+            throw Exception("Unsupported TEX palette index size");
+        }
+        LoadPalettes(stream);
+    }
+    else if (mBitDepth == 0 || mBitDepth > 32 || mBitDepth % 8 != 0)
+    {
+        LOG_ERROR(stream.Name() << " has " << mBitDepth << " bits per pixel");
+        throw Exception("Unsupported TEX pixel size");
+    }
+
+    mRowBytes = (static_cast<size_t>(width) * mBitDepth + 7) / 8;
+    const size_t pixelBytes = mRowBytes * height;
+    if (Remaining(stream) < pixelBytes)
+    {
+        LOG_ERROR(stream.Name() << " is truncated, " << pixelBytes << " bytes of pixels expected");
+        throw Exception("Truncated TEX file");
+    }
+    mPixels.resize(pixelBytes);
+    stream.ReadBytes(mPixels.data(), pixelBytes);
+
+    if (IsPaletted())
+    {
+        ApplyAlpha(stream);
+    }
+    else
+    {
+        const PixelFormat& format = m_header.pixel_format;
+        mMasks.bytesPerPixel = mBitDepth / 8;
+        const RGBAData* fields[] = { &format.bit_mask, &format.bit_shift, &format.bit_count };
+        Uint32* columns[] = { mMasks.mask, mMasks.shift, mMasks.bits };
+        for (size_t i = 0; i < 3; i++)
+        {
+            columns[i][0] = fields[i]->red;
+            columns[i][1] = fields[i]->green;
+            columns[i][2] = fields[i]->blue;
+            columns[i][3] = fields[i]->alpha;
+        }
+        mLayout = PixelConvert::Recognise(mMasks);
+    }
+    mContentHash = HashContent();
+}
+
+// MurmurHash64A, 8 bytes a step so hashing costs little next to reading the file
+static Uint64 HashBytes(Uint64 hash, const void* data, size_t size)
+{
+    const Uint64 kMultiply = 0xc6a4a7935bd1e995ULL;
+    const int kShift = 47;
+    const Uint8* bytes = static_cast<const Uint8*>(data);
+
+    hash ^= size * kMultiply;
+    const size_t words = size / 8;
+    for (size_t i = 0; i < words; i++)
+    {
+        Uint64 word;
+        std::memcpy(&word, bytes + i * 8, sizeof(word));
+        word *= kMultiply;
+        word ^= word >> kShift;
+        word *= kMultiply;
+        hash ^= word;
+        hash *= kMultiply;
+    }
+
+    const Uint8* tail = bytes + words * 8;
+    const size_t tailSize = size & 7;
+    if (tailSize > 0)
+    {
+        Uint64 word = 0;
+        for (size_t i = 0; i < tailSize; i++)
+        {
+            word |= static_cast<Uint64>(tail[i]) << (i * 8);
+        }
+        hash ^= word;
+        hash *= kMultiply;
+    }
+
+    hash ^= hash >> kShift;
+    hash *= kMultiply;
+    hash ^= hash >> kShift;
+    return hash;
+}
+
+Uint64 TexFile::HashContent() const
+{
+    // The header fields the conversion reads, the rest of it is runtime pointers and
+    // values that don't change the image
+    const Uint32 format[] =
+    {
+        Width(), Height(), mBitDepth, static_cast<Uint32>(mPaletteSize),
+        m_header.color_key_flag, m_header.reference_alpha, mMasks.bytesPerPixel,
+        mMasks.mask[0], mMasks.mask[1], mMasks.mask[2], mMasks.mask[3],
+        mMasks.shift[0], mMasks.shift[1], mMasks.shift[2], mMasks.shift[3],
+        mMasks.bits[0], mMasks.bits[1], mMasks.bits[2], mMasks.bits[3]
+    };
+    Uint64 hash = HashBytes(0, format, sizeof(format));
+    hash = HashBytes(hash, mPalettes.data(), mPalettes.size() * sizeof(Uint32));
+    return HashBytes(hash, mPixels.data(), mPixels.size());
+}
+
+// Palettes take the color key and reference alpha once so expanding through them
+// needs nothing more. Black is see through in keyed palettes, the optional array
+// after the pixels says which palettes are keyed.
+void TexFile::ApplyAlpha(Stream& stream)
+{
+    const size_t count = PaletteCount();
+    std::vector<Uint8> keyed(count, m_header.color_key_flag ? 1 : 0);
+    if (m_header.color_key_flag && m_header.color_key_array_flag && Remaining(stream) >= count)
+    {
+        stream.ReadBytes(keyed.data(), count);
+    }
+
+    const Uint32 alpha = PixelConvert::Rgba(0, 0, 0, 0xFF);
+    const Uint8 referenceAlpha = static_cast<Uint8>(m_header.reference_alpha);
+    for (size_t p = 0; p < count; p++)
+    {
+        Uint32* palette = mPalettes.data() + p * mPaletteSize;
+        for (size_t i = 0; i < mPaletteSize; i++)
+        {
+            const Uint8 colorAlpha = reinterpret_cast<const Uint8*>(&palette[i])[3];
+            if ((keyed[p] && (palette[i] & ~alpha) == 0) || colorAlpha < referenceAlpha)
+            {
+                palette[i] = 0;
+            }
+        }
+    }
+}
+
+void TexFile::LoadCooked(Stream& stream)
+{
+    CookedTex cooked = {};
+    if (Remaining(stream) < sizeof(cooked))
+    {
+        throw Exception("Truncated cooked TEX");
+    }
+    stream.ReadStruct(cooked);
+
+    const bool paletted = cooked.bitDepth == 4 || cooked.bitDepth == 8;
+    const size_t paletteColors = static_cast<size_t>(cooked.paletteSize) * cooked.paletteCount;
+    if (cooked.width == 0 || cooked.height == 0 || cooked.width > kMaxDimension || cooked.height > kMaxDimension
+        || (paletted ? (cooked.paletteSize != (cooked.bitDepth == 4 ? 16u : 256u) || cooked.paletteCount == 0) : (cooked.bitDepth != 32 || paletteColors != 0))
+        || cooked.rowBytes != (static_cast<size_t>(cooked.width) * cooked.bitDepth + 7) / 8
+        || Remaining(stream) < paletteColors * sizeof(Uint32) + static_cast<size_t>(cooked.rowBytes) * cooked.height)
+    {
+        LOG_ERROR(stream.Name() << " is a bad cooked TEX");
+        throw Exception("Bad cooked TEX");
+    }
+
+    m_header = Header{};
+    m_header.image_data.width = cooked.width;
+    m_header.image_data.height = cooked.height;
+    m_header.image_data.bit_depth = cooked.bitDepth;
+    m_header.pixel_format.bits_per_pixel = cooked.bitDepth;
+    m_header.palette_data.flag = paletted ? 1 : 0;
+    mBitDepth = cooked.bitDepth;
+    mRowBytes = cooked.rowBytes;
+    mPaletteSize = paletted ? cooked.paletteSize : 0;
+    mContentHash = static_cast<Uint64>(cooked.hashHigh) << 32 | cooked.hashLow;
+
+    mPalettes.resize(paletteColors);
+    stream.ReadBytes(reinterpret_cast<Uint8*>(mPalettes.data()), paletteColors * sizeof(Uint32));
+    mPixels.resize(static_cast<size_t>(mRowBytes) * cooked.height);
+    stream.ReadBytes(mPixels.data(), mPixels.size());
+
+    if (!paletted)
+    {
+        mMasks = kCookedMasks;
+        mLayout = PixelConvert::Recognise(mMasks);
+    }
+}
+
+std::vector<Uint8> TexFile::Cook(Stream& stream)
+{
+    TexFile tex(stream);
+    const Uint32 width = tex.Width();
+    const Uint32 height = tex.Height();
+    std::vector<Uint8> pixels;
+    size_t rowBytes = tex.mRowBytes;
+    if (tex.IsPaletted())
+    {
+        pixels = std::move(tex.mPixels);
+    }
+    else
+    {
+        // RGBA with the color key and reference alpha applied, then swapped to BGRA
+        // for the fastest of the direct color loops
+        const std::vector<Uint32> rgba = tex.ToRgba(size_t(0));
+        rowBytes = static_cast<size_t>(width) * 4;
+        pixels.resize(rowBytes * height);
+        const Uint8* src = reinterpret_cast<const Uint8*>(rgba.data());
+        for (size_t i = 0; i < pixels.size(); i += 4)
+        {
+            pixels[i] = src[i + 2];
+            pixels[i + 1] = src[i + 1];
+            pixels[i + 2] = src[i];
+            pixels[i + 3] = src[i + 3];
+        }
+    }
+
+    CookedTex cooked = {};
+    cooked.width = width;
+    cooked.height = height;
+    cooked.bitDepth = tex.IsPaletted() ? tex.mBitDepth : 32;
+    cooked.paletteSize = static_cast<Uint32>(tex.mPaletteSize);
+    cooked.paletteCount = static_cast<Uint32>(tex.PaletteCount());
+    cooked.rowBytes = static_cast<Uint32>(rowBytes);
+    cooked.hashLow = static_cast<Uint32>(tex.mContentHash);
+    cooked.hashHigh = static_cast<Uint32>(tex.mContentHash >> 32);
+    BinaryLayoutToHost(&cooked, 1);
+
+    const size_t paletteBytes = tex.mPalettes.size() * sizeof(Uint32);
+    std::vector<Uint8> out = CookedPack::MakeCooked(eCookedTexture, sizeof(cooked) + paletteBytes + pixels.size());
+    Uint8* p = out.data() + sizeof(CookedHeader);
+    memcpy(p, &cooked, sizeof(cooked));
+    p += sizeof(cooked);
+    memcpy(p, tex.mPalettes.data(), paletteBytes);
+    p += paletteBytes;
+    memcpy(p, pixels.data(), pixels.size());
+    return out;
+}
+
+void TexFile::LoadPalettes(Stream& stream)
+{
+    const size_t total = m_header.palette_data.total_color_count;
+    size_t perPalette = m_header.palette_data.colors_per_palette;
+    size_t count = m_header.palette_count;
+    if (count == 0 || perPalette == 0)
+    {
+        count = 1;
+        perPalette = total;
+    }
+
+    mPaletteSize = mBitDepth == 4 ? 16 : 256;
+    if (perPalette > mPaletteSize || perPalette * count > total || Remaining(stream) < total * kBgraSize)
+    {
+        LOG_ERROR(stream.Name() << " has " << count << " palettes of " << perPalette << " colors but " << total << " colors");
+        throw Exception("Bad TEX palette");
+    }
+
+    const Uint8* colors = stream.ReadView(total * kBgraSize);
+    mPalettes.assign(count * mPaletteSize, 0);
+    for (size_t p = 0; p < count; p++)
+    {
+        for (size_t i = 0; i < perPalette; i++)
+        {
+            const Uint8* bgra = colors + (p * perPalette + i) * kBgraSize;
+            mPalettes[p * mPaletteSize + i] = PixelConvert::Rgba(bgra[2], bgra[1], bgra[0], bgra[3]);
+        }
+    }
+}
+
+void TexFile::ToRgba(Uint32* dest, size_t palette) const
+{
+    if (!IsPaletted())
+    {
+        PixelConvert::ConvertDirect(mPixels.data(), static_cast<size_t>(Width()) * Height(), mMasks, mLayout,
+            m_header.color_key_flag != 0, static_cast<Uint8>(m_header.reference_alpha), dest);
+        return;
+    }
+
+    if (palette >= PaletteCount())
+    {
+        palette = 0;
+    }
+
+    PixelConvert::ExpandImage(mPixels.data(), mBitDepth, Width(), Height(), mRowBytes, Palette(palette), dest);
+}
+
+std::vector<Uint32> TexFile::ToRgba(size_t palette) const
+{
+    std::vector<Uint32> pixels(static_cast<size_t>(Width()) * Height());
+    ToRgba(pixels.data(), palette);
+    return pixels;
+}
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include "kernel/texture.hpp"
+#include "kernel/pixelconvert.hpp"
+#include "kernel/resourcecache.hpp"
+#include "kernel/texfile.hpp"
+#include "kernel/texturededup.hpp"
+
+Texture::Texture(TexFile&& tex, eTextureStorage storage)
+    : mWidth(tex.Width()), mHeight(tex.Height())
+{
+    if (storage == eTextureIndexed && tex.IsPaletted())
+    {
+        mIndexBits = tex.mBitDepth;
+        mRowBytes = tex.mRowBytes;
+        mIndices = std::move(tex.mPixels);
+        mPalettes = std::move(tex.mPalettes);
+        mPaletteSize = tex.mPaletteSize;
+        return;
+    }
+
+    mRgba.resize(static_cast<size_t>(mWidth) * mHeight);
+    tex.ToRgba(mRgba.data());
+}
+
+void Texture::ToRgba(Uint32* dest, size_t palette) const
+{
+    if (!IsIndexed())
+    {
+        std::copy(std::begin(mRgba), std::end(mRgba), dest);
+        return;
+    }
+
+    if (palette >= PaletteCount())
+    {
+        palette = 0;
+    }
+    PixelConvert::ExpandImage(mIndices.data(), mIndexBits, mWidth, mHeight, mRowBytes, Palette(palette), dest);
+}
+
+std::vector<Uint32> Texture::ToRgba(size_t palette) const
+{
+    std::vector<Uint32> pixels(static_cast<size_t>(mWidth) * mHeight);
+    ToRgba(pixels.data(), palette);
+    return pixels;
+}
+
+size_t Texture::ResidentBytes() const
+{
+    return mIndices.size() + mPalettes.size() * sizeof(Uint32) + mRgba.size() * sizeof(Uint32);
+}
+
+bool Texture::SameContent(const Texture& other) const
+{
+    return mWidth == other.mWidth && mHeight == other.mHeight && mIndexBits == other.mIndexBits
+        && mRowBytes == other.mRowBytes && mPaletteSize == other.mPaletteSize
+        && mIndices == other.mIndices && mPalettes == other.mPalettes && mRgba == other.mRgba;
+}
+
+void Texture::SetLoader(ResourceCache& cache, eTextureStorage storage, TextureDedup* dedup)
+{
+    cache.SetLoader(eTexture, [storage, dedup](Stream& stream, size_t& residentBytes)
+    {
+        // The cache charges a texture shared between entries only once
+        bool duplicate = false;
+        auto texture = dedup ? dedup->Load(TexFile(stream), storage, duplicate)
+            : std::make_shared<const Texture>(TexFile(stream), storage);
+        residentBytes = texture->ResidentBytes();
+        return std::static_pointer_cast<const void>(texture);
+    });
+}
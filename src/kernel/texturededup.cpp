@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <iterator>
+#include "kernel/texturededup.hpp"
+#include "kernel/texfile.hpp"
+#include "logger.hpp"
+
+// Both storages can be alive at once, they mustn't be handed out for each other
+static Uint64 Key(Uint64 contentHash, eTextureStorage storage)
+{
+    return contentHash ^ (static_cast<Uint64>(storage) * 0x9e3779b97f4a7c15ULL);
+}
+
+std::shared_ptr<const Texture> TextureDedup::Load(TexFile&& tex, eTextureStorage storage, bool& duplicate)
+{
+    const Uint64 key = Key(tex.ContentHash(), storage);
+
+    // Converted outside the lock and compared in full, the hash alone isn't proof
+    auto texture = std::make_shared<const Texture>(std::move(tex), storage);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::weak_ptr<const Texture>& entry = mShared[key];
+    auto shared = entry.lock();
+    duplicate = shared && shared->SameContent(*texture);
+    if (duplicate)
+    {
+        texture = std::move(shared);
+    }
+    else if (!shared)
+    {
+        // A collision keeps the first texture shared and this one to itself
+        entry = texture;
+    }
+
+    const size_t saved = duplicate ? texture->ResidentBytes() : 0;
+    for (Stats* stats : { &mSceneStats, &mTotalStats })
+    {
+        stats->loads++;
+        stats->duplicates += duplicate ? 1 : 0;
+        stats->bytesSaved += saved;
+    }
+
+    if (mShared.size() >= mPruneAt)
+    {
+        PruneExpired();
+    }
+    return texture;
+}
+
+// Entries of textures that have been freed stay until the table has doubled
+void TextureDedup::PruneExpired()
+{
+    for (auto it = std::begin(mShared); it != std::end(mShared);)
+    {
+        it = it->second.expired() ? mShared.erase(it) : std::next(it);
+    }
+    mPruneAt = std::max<size_t>(64, mShared.size() * 2);
+}
+
+void TextureDedup::BeginScene(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mScene.empty() || mSceneStats.loads > 0)
+    {
+        LOG_INFO("Textures in " << (mScene.empty() ? "startup" : mScene) << ": " << mSceneStats.loads << " loaded, "
+            << mSceneStats.duplicates << " shared, " << mSceneStats.bytesSaved / 1024 << " KB saved");
+    }
+    mScene = name;
+    mSceneStats = Stats{};
+}
+
+TextureDedup::Stats TextureDedup::SceneStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSceneStats;
+}
+
+TextureDedup::Stats TextureDedup::TotalStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mTotalStats;
+}
+
+size_t TextureDedup::SharedCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    size_t count = 0;
+    for (const auto& shared : mShared)
+    {
+        count += shared.second.expired() ? 0 : 1;
+    }
+    return count;
+}
+
+void TextureDedup::LogStats() const
+{
+    const Stats stats = TotalStats();
+    LOG_INFO("Textures: " << stats.loads << " loaded, " << stats.duplicates << " shared, "
+        << stats.bytesSaved / 1024 << " KB saved, " << SharedCount() << " distinct alive");
+}
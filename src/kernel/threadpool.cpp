@@ -0,0 +1,232 @@
+#include "kernel/threadpool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include "logger.hpp"
+
+// Lets Post and ParallelFor know when they are running on one of the pool's workers
+static thread_local const ThreadPool* tCurrentPool = nullptr;
+static thread_local size_t tCurrentWorker = 0;
+
+static const size_t kChunksPerThread = 4;
+
+ThreadPool::ThreadPool(size_t threadCount)
+    : mNextQueue(0)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        mQueues.emplace_back(std::make_unique<WorkerQueue>());
+    }
+
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        mThreads.emplace_back(&ThreadPool::Worker, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mJobAdded.notify_all();
+
+    for (std::thread& thread : mThreads)
+    {
+        thread.join();
+    }
+}
+
+int ThreadPool::CurrentWorker() const
+{
+    return tCurrentPool == this ? static_cast<int>(tCurrentWorker) : -1;
+}
+
+void ThreadPool::Post(std::function<void()> job)
+{
+    const int worker = CurrentWorker();
+    const size_t index = worker >= 0 ? static_cast<size_t>(worker) : mNextQueue++ % mQueues.size();
+    {
+        // Counted before a worker can see the job, RunJob takes it off again straight away
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueued++;
+        mPending++;
+
+        std::lock_guard<std::mutex> queueLock(mQueues[index]->mutex);
+        mQueues[index]->jobs.emplace_back(std::move(job));
+    }
+    mJobAdded.notify_one();
+}
+
+bool ThreadPool::TakeJob(size_t index, std::function<void()>& job)
+{
+    // Newest of our own first, it is most likely to still be in the cache
+    {
+        WorkerQueue& own = *mQueues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty())
+        {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < mQueues.size(); i++)
+    {
+        WorkerQueue& victim = *mQueues[(index + i) % mQueues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty())
+        {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::RunJob(std::function<void()>& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueued--;
+    }
+
+    // A throwing job mustn't take the worker down or leave Wait hanging
+    try
+    {
+        job();
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR("Thread pool job threw: " << ex.what());
+    }
+    catch (...)
+    {
+        LOG_ERROR("Thread pool job threw an unknown exception");
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPending--;
+    if (mPending == 0)
+    {
+        mIdle.notify_all();
+    }
+}
+
+void ThreadPool::Worker(size_t index)
+{
+    tCurrentPool = this;
+    tCurrentWorker = index;
+
+    for (;;)
+    {
+        std::function<void()> job;
+        if (TakeJob(index, job))
+        {
+            RunJob(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mJobAdded.wait(lock, [this]() { return mQuit || mQueued > 0; });
+        if (mQuit && mQueued == 0)
+        {
+            // Queued jobs are drained before quitting
+            return;
+        }
+    }
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mIdle.wait(lock, [this]() { return mPending == 0; });
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+    struct Batch
+    {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t remaining;
+        std::exception_ptr error;
+    };
+
+    // A job an index costs more than a small func does, so the range is split in to
+    // a few chunks a thread, enough to even out indices that take longer than others
+    const size_t chunks = std::min(count, (mThreads.size() + 1) * kChunksPerThread);
+    const size_t chunkSize = chunks > 0 ? (count + chunks - 1) / chunks : 0;
+
+    auto batch = std::make_shared<Batch>();
+    batch->remaining = chunks > 0 ? (count + chunkSize - 1) / chunkSize : 0;
+    for (size_t begin = 0; begin < count; begin += chunkSize)
+    {
+        const size_t end = std::min(count, begin + chunkSize);
+        Post([batch, &func, begin, end]()
+        {
+            // Every index runs even once one has thrown, as when they were posted singly
+            std::exception_ptr error;
+            for (size_t i = begin; i < end; i++)
+            {
+                try
+                {
+                    func(i);
+                }
+                catch (...)
+                {
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(batch->mutex);
+            if (error && !batch->error)
+            {
+                batch->error = error;
+            }
+            if (--batch->remaining == 0)
+            {
+                batch->done.notify_all();
+            }
+        });
+    }
+
+    const int worker = CurrentWorker();
+    const size_t helper = worker >= 0 ? static_cast<size_t>(worker) : 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(batch->mutex);
+            if (batch->remaining == 0)
+            {
+                // The first exception thrown by func, once every other call is done
+                if (batch->error)
+                {
+                    std::rethrow_exception(batch->error);
+                }
+                return;
+            }
+        }
+
+        std::function<void()> job;
+        if (TakeJob(helper, job))
+        {
+            RunJob(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->done.wait_for(lock, std::chrono::milliseconds(1), [&batch]() { return batch->remaining == 0; });
+    }
+}
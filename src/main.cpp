@@ -17,6 +17,16 @@ void sdl_cleanup();
 
 int main(int argc, char *argv[])
 {
-    Engine e;
+    // --record-accesses <file> writes the log 7-Gears-LgpTool optimize repacks with
+    std::string accessLogFile;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (std::string(argv[i]) == "--record-accesses")
+        {
+            accessLogFile = argv[++i];
+        }
+    }
+
+    Engine e(accessLogFile);
     return e.Run();
 }
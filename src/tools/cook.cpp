@@ -0,0 +1,120 @@
+#include <chrono>
+#include <cstdio>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <set>
+#include "kernel/cookedpack.hpp"
+#include "kernel/field.hpp"
+#include "kernel/kernelbin.hpp"
+#include "kernel/filesystem.hpp"
+#include "kernel/lgp.hpp"
+#include "kernel/lzss.hpp"
+#include "kernel/texfile.hpp"
+#include "kernel/threadpool.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+static bool IsDirectory(const std::string& path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && (info.st_mode & S_IFDIR) != 0;
+}
+
+// Archive name without folders or extension, "data/field/flevel.lgp" gives "flevel"
+static std::string BaseName(const std::string& path)
+{
+    const size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    const size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        printf("usage: %s <output.pack> <archive.lgp or folder>...\n", argv[0]);
+        printf("       LGP entries are stored as <archive name>/<entry>, folders as is\n");
+        printf("       TEX, KERNEL.BIN and LZSS files (KERNEL2.BIN, fields) are stored decoded\n");
+        return 1;
+    }
+
+    try
+    {
+        const auto start = std::chrono::steady_clock::now();
+        ThreadPool pool;
+        PackCooker cooker;
+
+        // The formats the game would otherwise decode every time it loads them
+        cooker.AddConverter(".tex", TexFile::Cook);
+        cooker.AddConverter("kernel.bin", KernelBin::Cook);
+        cooker.AddConverter("kernel2.bin", Lzss::Cook);
+
+        // The archives have to stay open until the pack has been written
+        std::vector<std::unique_ptr<Lgp>> archives;
+        size_t bytes = 0;
+        size_t files = 0;
+        for (int i = 2; i < argc; i++)
+        {
+            const std::string input = argv[i];
+            if (IsDirectory(input))
+            {
+                std::vector<std::string> names;
+                FileSystem::ListDirectory(input, names);
+                for (const std::string& name : names)
+                {
+                    Stream data(input + "/" + name);
+                    bytes += data.Size();
+                    cooker.Add(name, std::move(data));
+                }
+                files += names.size();
+            }
+            else
+            {
+                archives.push_back(std::make_unique<Lgp>(input));
+                const Lgp& lgp = *archives.back();
+                const std::string prefix = BaseName(input) + "/";
+
+                // Field files have no extension, flevel.lgp's maplist says which they are
+                std::set<std::string> fields;
+                if (lgp.Contains("maplist"))
+                {
+                    Stream maplist = lgp.Open("maplist");
+                    const FieldList list(maplist);
+                    for (Uint16 id = 0; id < list.Count(); id++)
+                    {
+                        fields.insert(Lgp::NormalizeName(list.Name(id)));
+                    }
+                }
+
+                for (size_t j = 0; j < lgp.EntryCount(); j++)
+                {
+                    bytes += lgp.EntrySize(j);
+                    const std::string name = lgp.EntryName(j);
+                    if (fields.count(name))
+                    {
+                        cooker.Add(prefix + name, lgp.Open(j), Lzss::Cook);
+                    }
+                    else
+                    {
+                        cooker.Add(prefix + name, lgp.Open(j));
+                    }
+                }
+                files += lgp.EntryCount();
+            }
+        }
+
+        const size_t packSize = cooker.Write(argv[1], pool);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double mb = static_cast<double>(bytes) / (1024.0 * 1024.0);
+        printf("Cooked %zu files, %.2f MB in to %.2f MB in %.1f ms on %zu threads (%.2f MB/s)\n",
+            files, mb, static_cast<double>(packSize) / (1024.0 * 1024.0), seconds * 1000.0, pool.ThreadCount(),
+            seconds > 0.0 ? mb / seconds : 0.0);
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR(ex.what());
+        return 1;
+    }
+    return 0;
+}
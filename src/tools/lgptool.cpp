@@ -0,0 +1,241 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "kernel/accesslog.hpp"
+#include "kernel/filesystem.hpp"
+#include "kernel/lgp.hpp"
+#include "kernel/lgpwriter.hpp"
+#include "kernel/lzss.hpp"
+#include "kernel/threadpool.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+static void MakeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+// Makes every folder leading up to the file
+static void MakeParentDirectories(const std::string& fileName)
+{
+    for (size_t slash = fileName.find('/', 1); slash != std::string::npos; slash = fileName.find('/', slash + 1))
+    {
+        MakeDirectory(fileName.substr(0, slash));
+    }
+}
+
+class Timer
+{
+public:
+    double Seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+    }
+private:
+    std::chrono::steady_clock::time_point mStart = std::chrono::steady_clock::now();
+};
+
+static void Report(const char* action, size_t files, size_t bytes, double seconds, size_t threads)
+{
+    const double mb = static_cast<double>(bytes) / (1024.0 * 1024.0);
+    printf("%s %zu files, %.2f MB in %.1f ms on %zu threads (%.2f MB/s)\n",
+        action, files, mb, seconds * 1000.0, threads, seconds > 0.0 ? mb / seconds : 0.0);
+}
+
+static int List(const std::string& archive)
+{
+    Lgp lgp(archive);
+    for (size_t i = 0; i < lgp.EntryCount(); i++)
+    {
+        printf("%10u %s\n", lgp.EntrySize(i), lgp.EntryName(i).c_str());
+    }
+    return 0;
+}
+
+static int Extract(const std::string& archive, const std::string& outDir, ThreadPool& pool)
+{
+    Timer timer;
+    Lgp lgp(archive);
+    MakeDirectory(outDir);
+
+    std::atomic<size_t> bytes(0);
+    std::atomic<size_t> failures(0);
+    pool.ParallelFor(lgp.EntryCount(), [&](size_t i)
+    {
+        const std::string fileName = outDir + "/" + lgp.EntryName(i);
+        MakeParentDirectories(fileName);
+
+        // Written straight out of the archive's mapping
+        Stream entry = lgp.Open(i);
+        std::ofstream out(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(entry.ReadView(entry.Size())), entry.Size());
+        if (!out)
+        {
+            LOG_ERROR("Failed to write " << fileName);
+            failures++;
+            return;
+        }
+        bytes += entry.Size();
+    });
+
+    Report("Extracted", lgp.EntryCount(), bytes, timer.Seconds(), pool.ThreadCount());
+    return failures == 0 ? 0 : 1;
+}
+
+static int Create(const std::string& inDir, const std::string& archive, ThreadPool& pool)
+{
+    Timer timer;
+    std::vector<std::string> files;
+    FileSystem::ListDirectory(inDir, files);
+
+    LgpWriter writer;
+    size_t bytes = 0;
+    for (const std::string& file : files)
+    {
+        Stream data(inDir + "/" + file);
+        bytes += data.Size();
+        writer.Add(file, std::move(data));
+    }
+
+    writer.Write(archive, pool);
+    Report("Packed", files.size(), bytes, timer.Seconds(), pool.ThreadCount());
+    return 0;
+}
+
+static int Optimize(const std::string& archive, const std::string& logFile, const std::string& outArchive, ThreadPool& pool)
+{
+    Timer timer;
+    AccessLog log;
+    log.Load(logFile);
+
+    Lgp lgp(archive);
+    LgpWriter writer;
+    size_t bytes = 0;
+    for (size_t i = 0; i < lgp.EntryCount(); i++)
+    {
+        Stream entry = lgp.Open(i);
+        bytes += entry.Size();
+        writer.Add(lgp.EntryName(i), std::move(entry));
+    }
+
+    // Each scene's entries together and page aligned, in the order they were loaded
+    const size_t kPageSize = 4096;
+    const auto groups = log.Groups(lgp, archive);
+    writer.SetDataGroups(groups, kPageSize);
+    writer.Write(outArchive, pool);
+    Report("Repacked", lgp.EntryCount(), bytes, timer.Seconds(), pool.ThreadCount());
+
+    Lgp optimized(outArchive);
+    size_t before = 0;
+    size_t after = 0;
+    for (const AccessLog::Scene& scene : log.Scenes())
+    {
+        const size_t readsBefore = log.CountReads(lgp, archive, scene, kPageSize);
+        const size_t readsAfter = log.CountReads(optimized, archive, scene, kPageSize);
+        if (readsBefore > 0)
+        {
+            printf("  %-24s %6zu reads -> %zu\n", scene.name.c_str(), readsBefore, readsAfter);
+        }
+        before += readsBefore;
+        after += readsAfter;
+    }
+    printf("%zu groups, %zu reads -> %zu\n", groups.size(), before, after);
+    return 0;
+}
+
+static bool WriteFile(const std::string& fileName, const std::vector<Uint8>& data)
+{
+    std::ofstream out(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!out)
+    {
+        LOG_ERROR("Failed to write " << fileName);
+        return false;
+    }
+    return true;
+}
+
+// Single files in the game's LZSS format, with its size header
+static int Compress(const std::string& inFile, const std::string& outFile, ThreadPool& pool)
+{
+    Timer timer;
+    Stream in(inFile);
+    const std::vector<Uint8> compressed = Lzss::CompressFile(in.ReadView(in.Size()), in.Size(), &pool);
+    if (!WriteFile(outFile, compressed))
+    {
+        return 1;
+    }
+    Report("Compressed", 1, in.Size(), timer.Seconds(), pool.ThreadCount());
+    printf("%zu bytes -> %zu\n", in.Size(), compressed.size());
+    return 0;
+}
+
+static int Decompress(const std::string& inFile, const std::string& outFile)
+{
+    Timer timer;
+    Stream in(inFile);
+    const std::vector<Uint8> data = Lzss::Decompress(in);
+    if (!WriteFile(outFile, data))
+    {
+        return 1;
+    }
+    Report("Decompressed", 1, data.size(), timer.Seconds(), 1);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string command = argc > 1 ? argv[1] : "";
+    try
+    {
+        ThreadPool pool;
+        if (command == "list" && argc == 3)
+        {
+            return List(argv[2]);
+        }
+        else if (command == "extract" && argc == 4)
+        {
+            return Extract(argv[2], argv[3], pool);
+        }
+        else if (command == "create" && argc == 4)
+        {
+            return Create(argv[2], argv[3], pool);
+        }
+        else if (command == "optimize" && argc == 5)
+        {
+            return Optimize(argv[2], argv[3], argv[4], pool);
+        }
+        else if (command == "compress" && argc == 4)
+        {
+            return Compress(argv[2], argv[3], pool);
+        }
+        else if (command == "decompress" && argc == 4)
+        {
+            return Decompress(argv[2], argv[3]);
+        }
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR(ex.what());
+        return 1;
+    }
+
+    printf("usage: %s list <archive.lgp>\n", argv[0]);
+    printf("       %s extract <archive.lgp> <output folder>\n", argv[0]);
+    printf("       %s create <input folder> <archive.lgp>\n", argv[0]);
+    printf("       %s optimize <archive.lgp> <access log> <output.lgp>\n", argv[0]);
+    printf("       %s compress <file> <output.lzs>\n", argv[0]);
+    printf("       %s decompress <file.lzs> <output>\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "kernel/filesystem.hpp"
+#include "kernel/lgp.hpp"
+#include "kernel/png.hpp"
+#include "kernel/stream.hpp"
+#include "kernel/texfile.hpp"
+#include "kernel/threadpool.hpp"
+#include "logger.hpp"
+#include "exceptions.hpp"
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+static void MakeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+// Makes every folder leading up to the file
+static void MakeParentDirectories(const std::string& fileName)
+{
+    for (size_t slash = fileName.find('/', 1); slash != std::string::npos; slash = fileName.find('/', slash + 1))
+    {
+        MakeDirectory(fileName.substr(0, slash));
+    }
+}
+
+static bool IsDirectory(const std::string& path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && (info.st_mode & S_IFDIR) != 0;
+}
+
+static bool HasExtension(const std::string& name, const std::string& extension)
+{
+    if (name.size() < extension.size())
+    {
+        return false;
+    }
+    return std::equal(extension.begin(), extension.end(), name.end() - extension.size(),
+        [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); });
+}
+
+// Name without folders or extension, "data/field/flevel.lgp" gives "flevel"
+static std::string BaseName(const std::string& path)
+{
+    const size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    const size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+static std::string WithoutExtension(const std::string& name)
+{
+    const size_t dot = name.find_last_of('.');
+    const size_t slash = name.find_last_of("/\\");
+    return dot == std::string::npos || (slash != std::string::npos && dot < slash) ? name : name.substr(0, dot);
+}
+
+class Timer
+{
+public:
+    double Seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+    }
+private:
+    std::chrono::steady_clock::time_point mStart = std::chrono::steady_clock::now();
+};
+
+// One image to convert, either an archive entry or a loose file. Nothing is read
+// until a worker picks it up.
+struct Job
+{
+    const Lgp* archive;
+    size_t entry;
+    std::string fileName;
+    std::string outName;
+};
+
+static bool WriteFile(const std::string& fileName, const Uint8* data, size_t size)
+{
+    MakeParentDirectories(fileName);
+    std::ofstream out(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(data), size);
+    if (!out)
+    {
+        LOG_ERROR("Failed to write " << fileName);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string format = argc > 1 ? argv[1] : "";
+    if (argc < 4 || (format != "png" && format != "raw"))
+    {
+        printf("usage: %s <png|raw> <output folder> <.tex file, folder or archive.lgp>...\n", argv[0]);
+        printf("       LGP entries go to <output folder>/<archive name>/<entry>.png, raw images are\n");
+        printf("       RGBA8 named <entry>.<width>x<height>.rgba. Paletted images use their first palette.\n");
+        return 1;
+    }
+
+    try
+    {
+        Timer timer;
+        ThreadPool pool;
+        const std::string outDir = argv[2];
+        MakeDirectory(outDir);
+
+        // The archives stay open, and mapped, until every job is done
+        std::vector<std::unique_ptr<Lgp>> archives;
+        std::vector<Job> jobs;
+        for (int i = 3; i < argc; i++)
+        {
+            const std::string input = argv[i];
+            if (IsDirectory(input))
+            {
+                std::vector<std::string> names;
+                FileSystem::ListDirectory(input, names);
+                for (const std::string& name : names)
+                {
+                    if (HasExtension(name, ".tex"))
+                    {
+                        jobs.push_back(Job{ nullptr, 0, input + "/" + name, outDir + "/" + WithoutExtension(name) });
+                    }
+                }
+            }
+            else if (HasExtension(input, ".lgp"))
+            {
+                archives.emplace_back(std::make_unique<Lgp>(input));
+                const Lgp& lgp = *archives.back();
+                const std::string prefix = outDir + "/" + BaseName(input) + "/";
+                for (size_t entry = 0; entry < lgp.EntryCount(); entry++)
+                {
+                    const std::string name = lgp.EntryName(entry);
+                    if (HasExtension(name, ".tex"))
+                    {
+                        jobs.push_back(Job{ &lgp, entry, "", prefix + WithoutExtension(name) });
+                    }
+                }
+            }
+            else
+            {
+                jobs.push_back(Job{ nullptr, 0, input, outDir + "/" + BaseName(input) });
+            }
+        }
+
+        // One job per worker at a time, so at most one decoded image and its encoded
+        // copy a thread are alive however many images there are
+        const bool png = format == "png";
+        std::atomic<size_t> bytesIn(0);
+        std::atomic<size_t> bytesOut(0);
+        std::atomic<size_t> pixels(0);
+        std::atomic<size_t> failures(0);
+        pool.ParallelFor(jobs.size(), [&](size_t i)
+        {
+            const Job& job = jobs[i];
+            try
+            {
+                Stream stream = job.archive ? job.archive->Open(job.entry) : Stream(job.fileName);
+                const TexFile tex(stream);
+                const std::vector<Uint32> rgba = tex.ToRgba(size_t(0));
+
+                bool written = false;
+                if (png)
+                {
+                    const std::vector<Uint8> encoded = Png::Encode(rgba.data(), tex.Width(), tex.Height());
+                    written = WriteFile(job.outName + ".png", encoded.data(), encoded.size());
+                    bytesOut += encoded.size();
+                }
+                else
+                {
+                    const std::string size = "." + std::to_string(tex.Width()) + "x" + std::to_string(tex.Height());
+                    const size_t rawSize = rgba.size() * sizeof(Uint32);
+                    written = WriteFile(job.outName + size + ".rgba", reinterpret_cast<const Uint8*>(rgba.data()), rawSize);
+                    bytesOut += rawSize;
+                }
+
+                if (!written)
+                {
+                    failures++;
+                }
+                bytesIn += stream.Size();
+                pixels += rgba.size();
+            }
+            catch (const std::exception& ex)
+            {
+                LOG_ERROR((job.archive ? job.archive->EntryName(job.entry) : job.fileName) << ": " << ex.what());
+                failures++;
+            }
+        });
+
+        const double seconds = timer.Seconds();
+        const size_t converted = jobs.size() - failures;
+        const double mb = 1024.0 * 1024.0;
+        printf("Converted %zu images, %.2f MB -> %.2f MB, %.1f megapixels in %.1f ms on %zu threads (%.1f images/s)\n",
+            converted, bytesIn / mb, bytesOut / mb, pixels / 1e6, seconds * 1000.0, pool.ThreadCount(),
+            seconds > 0.0 ? converted / seconds : 0.0);
+        if (failures > 0)
+        {
+            printf("%zu failed\n", failures.load());
+        }
+        return failures == 0 ? 0 : 1;
+    }
+    catch (const std::exception& ex)
+    {
+        LOG_ERROR(ex.what());
+        return 1;
+    }
+}